@@ -10,6 +10,7 @@
  *****************************************************************************/
 #include    <stddef.h>
 #include    <stdio.h>
+#include    <stdlib.h>
 #include    <string.h>
 
 #include    "as.h"
@@ -19,7 +20,7 @@
 #define COPY(struct_name, field_name, bytes) \
  bytearray_write_##bytes##_bytes (struct_name##_file.field_name, struct_name##_internal->field_name, LITTLE_ENDIAN)
 
-static int write_struct_exec (FILE *outfile, struct exec_internal *exec_internal) {
+static unsigned char *write_struct_exec (unsigned char *pos, struct exec_internal *exec_internal) {
 
     struct exec_file exec_file;
 
@@ -32,30 +33,24 @@ static int write_struct_exec (FILE *outfile, struct exec_internal *exec_internal
     COPY(exec, a_trsize, 4);
     COPY(exec, a_drsize, 4);
 
-    if (fwrite (&exec_file, sizeof (exec_file), 1, outfile) != 1) {
-        return 1;
-    }
-
-    return 0;
+    memcpy (pos, &exec_file, sizeof (exec_file));
+    return pos + sizeof (exec_file);
 
 }
 
-static int write_struct_relocation_info (FILE *outfile, struct relocation_info_internal *relocation_info_internal) {
+static unsigned char *write_struct_relocation_info (unsigned char *pos, struct relocation_info_internal *relocation_info_internal) {
 
     struct relocation_info_file relocation_info_file;
 
     COPY(relocation_info, r_address, 4);
     COPY(relocation_info, r_symbolnum, 4);
 
-    if (fwrite (&relocation_info_file, sizeof (relocation_info_file), 1, outfile) != 1) {
-        return 1;
-    }
-
-    return 0;
+    memcpy (pos, &relocation_info_file, sizeof (relocation_info_file));
+    return pos + sizeof (relocation_info_file);
 
 }
 
-static int write_struct_nlist (FILE *outfile, struct nlist_internal *nlist_internal) {
+static unsigned char *write_struct_nlist (unsigned char *pos, struct nlist_internal *nlist_internal) {
 
     struct nlist_file nlist_file;
 
@@ -65,31 +60,25 @@ static int write_struct_nlist (FILE *outfile, struct nlist_internal *nlist_inter
     COPY(nlist, n_desc, 2);
     COPY(nlist, n_value, 4);
 
-    if (fwrite (&nlist_file, sizeof (nlist_file), 1, outfile) != 1) {
-        return 1;
-    }
-
-    return 0;
+    memcpy (pos, &nlist_file, sizeof (nlist_file));
+    return pos + sizeof (nlist_file);
 
 }
 
-static int write_struct_string_table_header (FILE *outfile, struct string_table_header_internal *string_table_header_internal) {
+static unsigned char *write_struct_string_table_header (unsigned char *pos, struct string_table_header_internal *string_table_header_internal) {
 
     struct string_table_header_file string_table_header_file;
 
     COPY(string_table_header, s_size, 4);
 
-    if (fwrite (&string_table_header_file, sizeof (string_table_header_file), 1, outfile) != 1) {
-        return 1;
-    }
-
-    return 0;
+    memcpy (pos, &string_table_header_file, sizeof (string_table_header_file));
+    return pos + sizeof (string_table_header_file);
 
 }
 
 #undef COPY
 
-static int output_relocation (FILE *outfile, struct fixup *fixup, unsigned long start_address_of_section) {
+static unsigned char *output_relocation (unsigned char *pos, struct fixup *fixup, unsigned long start_address_of_section) {
 
     struct relocation_info_internal reloc;
 
@@ -111,14 +100,7 @@ static int output_relocation (FILE *outfile, struct fixup *fixup, unsigned long
     
     } else {
     
-        struct symbol *symbol;
-        int symbol_number;
-        
-        for (symbol = symbols, symbol_number = 0; symbol && (symbol != fixup->add_symbol); symbol = symbol->next) {
-            symbol_number++;
-        }
-        
-        reloc.r_symbolnum  = symbol_number;
+        reloc.r_symbolnum  = symbol_get_symbol_table_index (fixup->add_symbol);
         reloc.r_symbolnum |= 1LU << 27;
     
     }
@@ -136,91 +118,51 @@ static int output_relocation (FILE *outfile, struct fixup *fixup, unsigned long
     
     }
     
-    if (write_struct_relocation_info (outfile, &reloc)) {
-    
-        as_error_at (NULL, 0, "Error writing relocation!");
-        return 1;
-    
-    }
-
-    return 0;
+    return write_struct_relocation_info (pos, &reloc);
 
 }
 
-void write_a_out_file (void) {
+static unsigned long get_section_size (section_t section) {
 
-    struct exec_internal header;
-    struct string_table_header_internal string_table_header = {sizeof (struct string_table_header_file)};
-    
     struct frag *frag;
+    unsigned long size = 0;
     
-    struct fixup *fixup;
-    unsigned long start_address_of_data;
-    
-    struct symbol *symbol;
-    unsigned long symbol_table_size;
-    
-    FILE *outfile;
-    
-    memset (&header, 0, sizeof (header));
-    header.a_info = 0x00640000LU | OMAGIC;
-    
-    if ((outfile = fopen (state->outfile, "wb")) == NULL) {
-    
-        as_error_at (NULL, 0, "Failed to open '%s' as output file", state->outfile);
-        return;
+    section_set (section);
     
+    for (frag = current_frag_chain->first_frag; frag; frag = frag->next) {
+        size += frag->fixed_size;
     }
     
-    if (fseek (outfile, sizeof (struct exec_file), SEEK_SET)) {
-    
-        as_error_at (NULL, 0, "Failed whilst seeking past header");
-        return;
-    
-    }
+    return size;
+
+}
+
+static unsigned long get_section_num_relocs (section_t section) {
+
+    struct fixup *fixup;
+    unsigned long num_relocs = 0;
     
-    section_set (text_section);
-    header.a_text = 0;
+    section_set (section);
     
-    for (frag = current_frag_chain->first_frag; frag; frag = frag->next) {
+    for (fixup = current_frag_chain->first_fixup; fixup; fixup = fixup->next) {
     
-        if (frag->fixed_size == 0) {
+        if (fixup->done) {
             continue;
         }
         
-        if (fwrite (frag->buf, frag->fixed_size, 1, outfile) != 1) {
-        
-            as_error_at (NULL, 0, "Failed whilst writing text!");
-            return;
-        
-        }
-        
-        header.a_text += frag->fixed_size;
+        num_relocs++;
     
     }
     
-    section_set (data_section);
-    header.a_data = 0;
-    
-    for (frag = current_frag_chain->first_frag; frag; frag = frag->next) {
-    
-        if (frag->fixed_size == 0) {
-            continue;
-        }
-        
-        if (fwrite (frag->buf, frag->fixed_size, 1, outfile) != 1) {
-        
-            as_error_at (NULL, 0, "Failed whilst writing data!");
-            return;
-        
-        }
-        
-        header.a_data += frag->fixed_size;
-    
-    }
+    return num_relocs;
+
+}
+
+static unsigned char *write_section_content (unsigned char *pos, section_t section) {
+
+    struct frag *frag;
     
-    section_set (bss_section);
-    header.a_bss = 0;
+    section_set (section);
     
     for (frag = current_frag_chain->first_frag; frag; frag = frag->next) {
     
@@ -228,12 +170,20 @@ void write_a_out_file (void) {
             continue;
         }
         
-        header.a_bss += frag->fixed_size;
+        memcpy (pos, frag->buf, frag->fixed_size);
+        pos += frag->fixed_size;
     
     }
     
-    header.a_trsize = 0;
-    section_set (text_section);
+    return pos;
+
+}
+
+static unsigned char *write_section_relocs (unsigned char *pos, section_t section, unsigned long start_address_of_section) {
+
+    struct fixup *fixup;
+    
+    section_set (section);
     
     for (fixup = current_frag_chain->first_fixup; fixup; fixup = fixup->next) {
     
@@ -241,103 +191,128 @@ void write_a_out_file (void) {
             continue;
         }
         
-        if (output_relocation (outfile, fixup, 0)) {
-            return;
-        }
-        
-        header.a_trsize += sizeof (struct relocation_info_file);
+        pos = output_relocation (pos, fixup, start_address_of_section);
     
     }
     
-    header.a_drsize = 0;
-    section_set (data_section);
+    return pos;
+
+}
+
+void write_a_out_file (void) {
+
+    struct exec_internal header;
+    struct string_table_header_internal string_table_header = {sizeof (struct string_table_header_file)};
     
-    start_address_of_data = current_frag_chain->first_frag->address;
+    struct symbol *symbol;
+    unsigned long symbol_number;
     
-    for (fixup = current_frag_chain->first_fixup; fixup; fixup = fixup->next) {
+    FILE *outfile;
+    unsigned char *file, *pos;
+    size_t file_size;
     
-        if (fixup->done) {
-            continue;
-        }
-        
-        if (output_relocation (outfile, fixup, start_address_of_data)) {
-            return;
-        }
-        
-        header.a_drsize += sizeof (struct relocation_info_file);
+    memset (&header, 0, sizeof (header));
+    header.a_info = 0x00640000LU | OMAGIC;
+    
+    if ((outfile = fopen (state->outfile, "wb")) == NULL) {
+    
+        as_error_at (NULL, 0, "Failed to open '%s' as output file", state->outfile);
+        return;
     
     }
     
-    symbol_table_size = 0;
+    /* Layout of the object file is:
+     * header, text, data, text relocations, data relocations,
+     * symbol table and string table.
+     * Everything is sized first and then written into a single buffer. */
+    header.a_text = get_section_size (text_section);
+    header.a_data = get_section_size (data_section);
+    header.a_bss = get_section_size (bss_section);
     
-    for (symbol = symbols; symbol; symbol = symbol->next) {
+    header.a_trsize = get_section_num_relocs (text_section) * sizeof (struct relocation_info_file);
+    header.a_drsize = get_section_num_relocs (data_section) * sizeof (struct relocation_info_file);
     
-        struct nlist_internal symbol_entry;
-        memset (&symbol_entry, 0, sizeof (symbol_entry));
-        
-        symbol_entry.n_strx = string_table_header.s_size;
+    for (symbol = symbols, symbol_number = 0; symbol; symbol = symbol->next, symbol_number++) {
+    
+        symbol_set_symbol_table_index (symbol, symbol_number);
         string_table_header.s_size += strlen (symbol->name) + 1;
-        
-        if (symbol->section == undefined_section) {
-            symbol_entry.n_type = N_UNDF;
-        } else if (symbol->section == text_section) {
-            symbol_entry.n_type = N_TEXT;
-        } else if (symbol->section == data_section) {
-            symbol_entry.n_type = N_DATA;
-        } else if (symbol->section == bss_section) {
-            symbol_entry.n_type = N_BSS;
-        } else if (symbol->section == absolute_section) {
-            symbol_entry.n_type = N_ABS;
-        } else {
-            as_internal_error_at_source_at (__FILE__, __LINE__, NULL, 0, "invalid section %s", section_get_name (symbol->section));
-        }
-        
-        if (symbol_is_external (symbol) || symbol_is_undefined (symbol)) {
-            symbol_entry.n_type |= N_EXT;
-        }
-        
-        symbol_entry.n_value = symbol_get_value (symbol);
-        
-        if (write_struct_nlist (outfile, &symbol_entry)) {
-        
-            as_error_at (NULL, 0, "Error writing symbol table!");
-            return;
-        
-        }
-        
-        symbol_table_size += sizeof (struct nlist_file);
     
     }
     
-    header.a_syms = symbol_table_size;
+    header.a_syms = symbol_number * sizeof (struct nlist_file);
     
-    if (write_struct_string_table_header (outfile, &string_table_header)) {
+    file_size = (sizeof (struct exec_file)
+                 + header.a_text + header.a_data
+                 + header.a_trsize + header.a_drsize
+                 + header.a_syms + string_table_header.s_size);
     
-        as_error_at (NULL, 0, "Failed to write string table!");
-        return;
+    file = xmalloc (file_size);
     
-    }
+    pos = write_struct_exec (file, &header);
     
-    for (symbol = symbols; symbol; symbol = symbol->next) {
+    pos = write_section_content (pos, text_section);
+    pos = write_section_content (pos, data_section);
+    
+    pos = write_section_relocs (pos, text_section, 0);
+    
+    section_set (data_section);
+    pos = write_section_relocs (pos, data_section, current_frag_chain->first_frag->address);
     
-        if (fwrite (symbol->name, strlen (symbol->name) + 1, 1, outfile) != 1) {
+    {
+    
+        unsigned long n_strx = sizeof (struct string_table_header_file);
         
-            as_error_at (NULL, 0, "Failed to write string table!");
-            return;
+        for (symbol = symbols; symbol; symbol = symbol->next) {
+        
+            struct nlist_internal symbol_entry;
+            memset (&symbol_entry, 0, sizeof (symbol_entry));
+            
+            symbol_entry.n_strx = n_strx;
+            n_strx += strlen (symbol->name) + 1;
+            
+            if (symbol->section == undefined_section) {
+                symbol_entry.n_type = N_UNDF;
+            } else if (symbol->section == text_section) {
+                symbol_entry.n_type = N_TEXT;
+            } else if (symbol->section == data_section) {
+                symbol_entry.n_type = N_DATA;
+            } else if (symbol->section == bss_section) {
+                symbol_entry.n_type = N_BSS;
+            } else if (symbol->section == absolute_section) {
+                symbol_entry.n_type = N_ABS;
+            } else {
+                as_internal_error_at_source_at (__FILE__, __LINE__, NULL, 0, "invalid section %s", section_get_name (symbol->section));
+            }
+            
+            if (symbol_is_external (symbol) || symbol_is_undefined (symbol)) {
+                symbol_entry.n_type |= N_EXT;
+            }
+            
+            symbol_entry.n_value = symbol_get_value (symbol);
+            
+            pos = write_struct_nlist (pos, &symbol_entry);
         
         }
     
     }
     
-    rewind (outfile);
+    pos = write_struct_string_table_header (pos, &string_table_header);
     
-    if (write_struct_exec (outfile, &header)) {
+    for (symbol = symbols; symbol; symbol = symbol->next) {
     
-        as_error_at (NULL, 0, "Failed to write header!");
-        return;
+        size_t name_size = strlen (symbol->name) + 1;
+        
+        memcpy (pos, symbol->name, name_size);
+        pos += name_size;
     
     }
     
+    if (fwrite (file, file_size, 1, outfile) != 1) {
+        as_error_at (NULL, 0, "Failed to write '%s'!", state->outfile);
+    } else as_statistics.bytes_emitted += file_size;
+    
+    free (file);
+    
     if (fclose (outfile)) {
         as_error_at (NULL, 0, "Failed to close file!");
     }
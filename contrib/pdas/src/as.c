@@ -13,6 +13,13 @@
 #include    <stdlib.h>
 #include    <string.h>
 
+#ifdef  AS_USE_FORK
+# define    AS_BATCH_USE_FORK
+# include   <sys/types.h>
+# include   <sys/wait.h>
+# include   <unistd.h>
+#endif
+
 #include    "as.h"
 #include    "libas.h"
 #include    "cfi.h"
@@ -20,33 +27,11 @@
 struct as_state *state;
 const char *program_name = 0;
 
-int main (int argc, char **argv)
+static int assemble (void)
 {
-    char **pargv = argv;
-    int pargc = argc;
-    
     int i;
     
-    if (argc && *argv) {
-        char *p;
-        program_name = *argv;
-        
-        if ((p = strrchr (program_name, '/'))) {
-            program_name = (p + 1);
-        }
-    }
-    
-    state = xmalloc (sizeof (*state));
-    memset (state, 0, sizeof (*state));
-    
-#if      defined (USE_COFF_BY_DEFAULT)
-    state->format = AS_FORMAT_COFF;
-#elif      defined (USE_ELF_BY_DEFAULT)
-    state->format = AS_FORMAT_ELF;
-#endif
-    
-    as_parse_args (&pargc, &pargv, 1);
-    
+    symbols_init ();
     sections_init ();
     process_init ();
     
@@ -54,14 +39,7 @@ int main (int argc, char **argv)
 
     as_use_defsyms ();
     
-    if (state->nb_files == 0) {
-        if (program_name) {
-            fprintf (stderr, "%s: ", program_name);
-        }
-        
-        fprintf (stderr, "error: no input files provided\n");
-        exit (EXIT_FAILURE);
-    }
+    as_phase_start (AS_PHASE_PROCESS);
     
     for (i = 0; i < state->nb_files; i++) {
         if (process (state->files[i])) {
@@ -73,6 +51,8 @@ int main (int argc, char **argv)
             continue;
         }
     }
+    
+    as_phase_end (AS_PHASE_PROCESS);
 
     cfi_finish ();
     
@@ -82,6 +62,8 @@ int main (int argc, char **argv)
         generate_listing ();
         listing_destroy ();
     }
+    
+    as_print_statistics ();
 
     machine_dependent_destroy ();
     process_destroy ();
@@ -95,3 +77,144 @@ int main (int argc, char **argv)
     
     return EXIT_SUCCESS;
 }
+
+#ifdef AS_BATCH_USE_FORK
+
+static char *batch_object_name (const char *filename)
+{
+    const char *base, *dot;
+    char *object_name;
+    
+    if ((base = strrchr (filename, '/'))) {
+        base++;
+    } else {
+        base = filename;
+    }
+    
+    if (!(dot = strrchr (base, '.')) || dot == base) {
+        dot = base + strlen (base);
+    }
+    
+    object_name = xmalloc (dot - filename + 3);
+    memcpy (object_name, filename, dot - filename);
+    strcpy (object_name + (dot - filename), ".o");
+    
+    return object_name;
+}
+
+/**
+ * Every input file is assembled into its own object file by a child process,
+ * so each unit starts from the same clean state the parent had
+ * after parsing the options and no global state is shared between units.
+ */
+static int assemble_batch (void)
+{
+    char **files = state->files;
+    int nb_files = state->nb_files;
+    
+    int next_file = 0, running = 0;
+    int ret = EXIT_SUCCESS;
+    
+    if (state->jobs <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        state->jobs = (int) sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+        if (state->jobs <= 0) state->jobs = 1;
+    }
+    
+    while (next_file < nb_files || running) {
+        int status;
+        
+        while (running < state->jobs && next_file < nb_files) {
+            pid_t pid;
+            
+            fflush (NULL);
+            
+            if ((pid = fork ()) == -1) {
+                if (program_name) {
+                    fprintf (stderr, "%s: ", program_name);
+                }
+                
+                fprintf (stderr, "error: failed to start assembling '%s'\n", files[next_file]);
+                ret = EXIT_FAILURE;
+                
+                next_file = nb_files;
+                break;
+            }
+            
+            if (pid == 0) {
+                state->files = &files[next_file];
+                state->nb_files = 1;
+                state->outfile = batch_object_name (files[next_file]);
+                
+                exit (assemble ());
+            }
+            
+            next_file++;
+            running++;
+        }
+        
+        if (running == 0) break;
+        
+        if (wait (&status) == -1) break;
+        running--;
+        
+        if (!WIFEXITED (status) || WEXITSTATUS (status) != EXIT_SUCCESS) {
+            ret = EXIT_FAILURE;
+        }
+    }
+    
+    return ret;
+}
+
+#endif
+
+int main (int argc, char **argv)
+{
+    char **pargv = argv;
+    int pargc = argc;
+    
+    if (argc && *argv) {
+        char *p;
+        program_name = *argv;
+        
+        if ((p = strrchr (program_name, '/'))) {
+            program_name = (p + 1);
+        }
+    }
+    
+    state = xmalloc (sizeof (*state));
+    memset (state, 0, sizeof (*state));
+    
+#if      defined (USE_COFF_BY_DEFAULT)
+    state->format = AS_FORMAT_COFF;
+#elif      defined (USE_ELF_BY_DEFAULT)
+    state->format = AS_FORMAT_ELF;
+#endif
+    
+    as_parse_args (&pargc, &pargv, 1);
+    
+    if (state->nb_files == 0) {
+        if (program_name) {
+            fprintf (stderr, "%s: ", program_name);
+        }
+        
+        fprintf (stderr, "error: no input files provided\n");
+        exit (EXIT_FAILURE);
+    }
+    
+    if (state->batch) {
+#ifdef AS_BATCH_USE_FORK
+        return assemble_batch ();
+#else
+        if (program_name) {
+            fprintf (stderr, "%s: ", program_name);
+        }
+        
+        fprintf (stderr, "error: --batch is not supported on this host\n");
+        exit (EXIT_FAILURE);
+#endif
+    }
+    
+    return assemble ();
+}
@@ -38,8 +38,17 @@ struct as_state {
 
     int no_pseudo_dot;
 
+    int batch;
+    int jobs;
+
+    int stats;
+
 };
 
+#define     AS_STATS_NONE               0
+#define     AS_STATS_TEXT               1
+#define     AS_STATS_JSON               2
+
 #define     ARRAY_SIZE(arr)             (sizeof (arr) / sizeof (arr[0]))
 
 extern struct as_state *state;
@@ -136,6 +145,7 @@ int machine_dependent_force_relocation_local (struct fixup *fixup);
 offset_t machine_dependent_estimate_size_before_relax (struct frag *frag, section_t section);
 offset_t machine_dependent_pcrel_from (struct fixup *fixup);
 offset_t machine_dependent_relax_frag (struct frag *frag, section_t section, offset_t change);
+int machine_dependent_relax_frag_is_final (struct frag *frag);
 
 void machine_dependent_apply_fixup (struct fixup *fixup, value_t value);
 void machine_dependent_finish_frag (struct frag *frag);
@@ -194,6 +204,36 @@ NORETURN void as_internal_error_at_source_at (const char *code_filename,
 /* libas.c */
 char *skip_whitespace (char *p);
 
+enum as_phase {
+
+    AS_PHASE_PROCESS,
+    AS_PHASE_RELAX,
+    AS_PHASE_FIXUP,
+    AS_PHASE_WRITE,
+    AS_PHASE_MAX
+
+};
+
+struct as_statistics {
+
+    unsigned long lines;
+    unsigned long instructions;
+    unsigned long frags;
+    unsigned long fixups;
+    unsigned long symbol_lookups;
+    unsigned long bytes_emitted;
+    unsigned long match_cache_lookups;
+    unsigned long match_cache_hits;
+
+};
+
+extern struct as_statistics as_statistics;
+
+void as_phase_start (enum as_phase phase);
+void as_phase_end (enum as_phase phase);
+void as_statistics_add_relax_passes (const char *section_name, unsigned long passes, int worklist);
+void as_print_statistics (void);
+
 void *xmalloc (size_t size);
 void *xrealloc (void *ptr, size_t size);
 
@@ -24,7 +24,7 @@ static unsigned short target_Machine;
 #define COPY(struct_name, field_name, bytes) \
  bytearray_write_##bytes##_bytes (struct_name##_file.field_name, struct_name##_internal->field_name, LITTLE_ENDIAN)
 
-static int write_struct_coff_header (FILE *outfile, struct coff_header_internal *coff_header_internal) {
+static unsigned char *write_struct_coff_header (unsigned char *pos, struct coff_header_internal *coff_header_internal) {
 
     struct coff_header_file coff_header_file;
 
@@ -36,15 +36,12 @@ static int write_struct_coff_header (FILE *outfile, struct coff_header_internal
     COPY(coff_header, SizeOfOptionalHeader, 2);
     COPY(coff_header, Characteristics, 2);
 
-    if (fwrite (&coff_header_file, sizeof (coff_header_file), 1, outfile) != 1) {
-        return 1;
-    }
-
-    return 0;
+    memcpy (pos, &coff_header_file, sizeof (coff_header_file));
+    return pos + sizeof (coff_header_file);
 
 }
 
-static int write_struct_section_table_entry (FILE *outfile, struct section_table_entry_internal *section_table_entry_internal) {
+static unsigned char *write_struct_section_table_entry (unsigned char *pos, struct section_table_entry_internal *section_table_entry_internal) {
 
     struct section_table_entry_file section_table_entry_file;
 
@@ -61,15 +58,12 @@ static int write_struct_section_table_entry (FILE *outfile, struct section_table
     COPY(section_table_entry, Characteristics, 4);
     
 
-    if (fwrite (&section_table_entry_file, sizeof (section_table_entry_file), 1, outfile) != 1) {
-        return 1;
-    }
-
-    return 0;
+    memcpy (pos, &section_table_entry_file, sizeof (section_table_entry_file));
+    return pos + sizeof (section_table_entry_file);
 
 }
 
-static int write_struct_relocation_entry (FILE *outfile, struct relocation_entry_internal *relocation_entry_internal) {
+static unsigned char *write_struct_relocation_entry (unsigned char *pos, struct relocation_entry_internal *relocation_entry_internal) {
 
     struct relocation_entry_file relocation_entry_file;
 
@@ -77,15 +71,12 @@ static int write_struct_relocation_entry (FILE *outfile, struct relocation_entry
     COPY(relocation_entry, SymbolTableIndex, 4);
     COPY(relocation_entry, Type, 2);
 
-    if (fwrite (&relocation_entry_file, sizeof (relocation_entry_file), 1, outfile) != 1) {
-        return 1;
-    }
-
-    return 0;
+    memcpy (pos, &relocation_entry_file, sizeof (relocation_entry_file));
+    return pos + sizeof (relocation_entry_file);
 
 }
 
-static int write_struct_symbol_table_entry (FILE *outfile, struct symbol_table_entry_internal *symbol_table_entry_internal) {
+static unsigned char *write_struct_symbol_table_entry (unsigned char *pos, struct symbol_table_entry_internal *symbol_table_entry_internal) {
 
     struct symbol_table_entry_file symbol_table_entry_file;
 
@@ -97,15 +88,12 @@ static int write_struct_symbol_table_entry (FILE *outfile, struct symbol_table_e
     COPY(symbol_table_entry, StorageClass, 1);
     COPY(symbol_table_entry, NumberOfAuxSymbols, 1);
 
-    if (fwrite (&symbol_table_entry_file, sizeof (symbol_table_entry_file), 1, outfile) != 1) {
-        return 1;
-    }
-
-    return 0;
+    memcpy (pos, &symbol_table_entry_file, sizeof (symbol_table_entry_file));
+    return pos + sizeof (symbol_table_entry_file);
 
 }
 
-static int write_struct_aux_section_symbol (FILE *outfile, struct aux_section_symbol_internal *aux_section_symbol_internal)
+static unsigned char *write_struct_aux_section_symbol (unsigned char *pos, struct aux_section_symbol_internal *aux_section_symbol_internal)
 {
     struct aux_section_symbol_file aux_section_symbol_file;
 
@@ -119,24 +107,18 @@ static int write_struct_aux_section_symbol (FILE *outfile, struct aux_section_sy
 
     memcpy (aux_section_symbol_file.Unused, aux_section_symbol_internal->Unused, sizeof (aux_section_symbol_file.Unused));
 
-    if (fwrite (&aux_section_symbol_file, sizeof (aux_section_symbol_file), 1, outfile) != 1) {
-        return 1;
-    }
-
-    return 0;
+    memcpy (pos, &aux_section_symbol_file, sizeof (aux_section_symbol_file));
+    return pos + sizeof (aux_section_symbol_file);
 }
 
-static int write_struct_string_table_header (FILE *outfile, struct string_table_header_internal *string_table_header_internal) {
+static unsigned char *write_struct_string_table_header (unsigned char *pos, struct string_table_header_internal *string_table_header_internal) {
 
     struct string_table_header_file string_table_header_file;
 
     COPY(string_table_header, StringTableSize, 4);
 
-    if (fwrite (&string_table_header_file, sizeof (string_table_header_file), 1, outfile) != 1) {
-        return 1;
-    }
-
-    return 0;
+    memcpy (pos, &string_table_header_file, sizeof (string_table_header_file));
+    return pos + sizeof (string_table_header_file);
 
 }
 
@@ -218,14 +200,14 @@ static unsigned long translate_alignment_power_to_Characteristics (int alignment
 
 }
 
-static int output_relocation (FILE *outfile, struct fixup *fixup)
+static unsigned char *output_relocation (unsigned char *pos, struct fixup *fixup)
 {
     struct relocation_entry_internal reloc_entry;
     reloc_entry.VirtualAddress = fixup->frag->address + fixup->where;
     
     if (fixup->add_symbol == NULL) {
         as_internal_error_at_source_at (__FILE__, __LINE__, NULL, 0, "+++output relocation fixup->add_symbol is NULL");
-        return 1;
+        return pos;
     }
     
     if (symbol_is_section_symbol (fixup->add_symbol)
@@ -330,11 +312,7 @@ static int output_relocation (FILE *outfile, struct fixup *fixup)
         }
     }
     
-    if (write_struct_relocation_entry (outfile, &reloc_entry)) {
-        return 1;
-    }
-    
-    return 0;
+    return write_struct_relocation_entry (pos, &reloc_entry);
 }
 
 static void sort_symbols (void)
@@ -368,6 +346,10 @@ void write_coff_file (void) {
     struct symbol *symbol;
     section_t section;
     
+    unsigned char *file, *pos;
+    size_t file_size;
+    unsigned long symbol_names_size = 0;
+    
     sections_number (1);
     sort_symbols ();
     memset (&header, 0, sizeof (header));
@@ -385,19 +367,19 @@ void write_coff_file (void) {
     header.Characteristics = IMAGE_FILE_LINE_NUMS_STRIPPED;
     if (target_Machine == IMAGE_FILE_MACHINE_I386) header.Characteristics |= IMAGE_FILE_32BIT_MACHINE;
     
-    if (fseek (outfile,
-               (sizeof (struct coff_header_file)
-                + sections_get_count () * sizeof (struct section_table_entry_file)),
-               SEEK_SET)) {
-    
-        as_error_at (NULL, 0, "Failed to fseek");
-        return;
-    
-    }
+    /* Layout of the object file is:
+     * COFF header, section table, content of sections,
+     * symbol table, string table and relocations of all sections.
+     * Everything is sized first and then written into a single buffer. */
+    file_size = (sizeof (struct coff_header_file)
+                 + sections_get_count () * sizeof (struct section_table_entry_file));
     
     for (section = sections; section; section = section_get_next_section (section)) {
     
         struct section_table_entry_internal *section_header = xmalloc (sizeof (*section_header));
+        struct frag *frag;
+        struct fixup *fixup;
+        
         section_set_object_format_dependent_data (section, section_header);
         
         memset (section_header, 0, sizeof (*section_header));
@@ -417,58 +399,97 @@ void write_coff_file (void) {
         section_header->Characteristics = translate_section_flags_to_Characteristics (section_get_flags (section));
         section_header->Characteristics |= translate_alignment_power_to_Characteristics (section_get_alignment_power (section));
         
-        if (section != bss_section) {
+        section_set (section);
         
-            struct frag *frag;
-            section_set (section);
-            
-            section_header->PointerToRawData = ftell (outfile);
-            section_header->SizeOfRawData = 0;
-            
-            for (frag = current_frag_chain->first_frag; frag; frag = frag->next) {
-            
-                if (frag->fixed_size == 0) {
-                    continue;
-                }
-                
-                if (fwrite (frag->buf, frag->fixed_size, 1, outfile) != 1) {
-                
-                    as_error_at (NULL, 0, "Failed whilst writing secton '%s'!", section_get_name (section));
-                    return;
-                
-                }
-                
-                section_header->SizeOfRawData += frag->fixed_size;
-            
+        for (frag = current_frag_chain->first_frag; frag; frag = frag->next) {
+            section_header->SizeOfRawData += frag->fixed_size;
+        }
+        
+        if (section != bss_section && section_header->SizeOfRawData) {
+        
+            section_header->PointerToRawData = file_size;
+            file_size += section_header->SizeOfRawData;
+        
+        }
+        
+        for (fixup = current_frag_chain->first_fixup; fixup; fixup = fixup->next) {
+        
+            if (fixup->done) {
+                continue;
             }
             
-            if (section_header->SizeOfRawData == 0) {
-                section_header->PointerToRawData = 0;
-            }
+            section_header->NumberOfRelocations++;
         
-        } else {
+        }
+    
+    }
+    
+    header.PointerToSymbolTable = file_size;
+    header.NumberOfSymbols = 0;
+    
+    for (symbol = symbols; symbol; symbol = symbol->next) {
+    
+        header.NumberOfSymbols++;
         
-            struct frag *frag;
-            
-            section_set (section);
-            section_header->PointerToRawData = 0;
-            section_header->SizeOfRawData = 0;
-            
-            for (frag = current_frag_chain->first_frag; frag; frag = frag->next) {
-            
-                if (frag->fixed_size == 0) {
-                    continue;
-                }
-                
-                section_header->SizeOfRawData += frag->fixed_size;
-            
+        if (symbol_is_section_symbol (symbol)
+            && (section_get_flags (symbol_get_section (symbol)) & SECTION_FLAG_LINK_ONCE)) {
+            header.NumberOfSymbols++;
+        }
+        
+        if (strlen (symbol->name) > 8) {
+            symbol_names_size += strlen (symbol->name) + 1;
+        }
+    
+    }
+    
+    file_size += header.NumberOfSymbols * sizeof (struct symbol_table_entry_file);
+    file_size += string_table_header.StringTableSize + symbol_names_size;
+    
+    for (section = sections; section; section = section_get_next_section (section)) {
+    
+        struct section_table_entry_internal *section_header = section_get_object_format_dependent_data (section);
+        
+        if (section_header->NumberOfRelocations) {
+        
+            section_header->PointerToRelocations = file_size;
+            file_size += section_header->NumberOfRelocations * sizeof (struct relocation_entry_file);
+        
+        }
+    
+    }
+    
+    file = xmalloc (file_size);
+    
+    pos = write_struct_coff_header (file, &header);
+    
+    for (section = sections; section; section = section_get_next_section (section)) {
+        pos = write_struct_section_table_entry (pos, section_get_object_format_dependent_data (section));
+    }
+    
+    for (section = sections; section; section = section_get_next_section (section)) {
+    
+        struct frag *frag;
+        
+        if (section == bss_section) {
+            continue;
+        }
+        
+        section_set (section);
+        
+        for (frag = current_frag_chain->first_frag; frag; frag = frag->next) {
+        
+            if (frag->fixed_size == 0) {
+                continue;
             }
+            
+            memcpy (pos, frag->buf, frag->fixed_size);
+            pos += frag->fixed_size;
         
         }
     
     }
     
-    header.PointerToSymbolTable = ftell (outfile);
+    /* Symbol table indexes are assigned here, so the relocations must be written afterwards. */
     header.NumberOfSymbols = 0;
     
     for (symbol = symbols; symbol; symbol = symbol->next) {
@@ -561,10 +582,7 @@ void write_coff_file (void) {
             sym_tbl_ent.NumberOfAuxSymbols = 1;
         }
         
-        if (write_struct_symbol_table_entry (outfile, &sym_tbl_ent)) {
-            as_error_at (NULL, 0, "Error writing symbol table!");
-            return;
-        }
+        pos = write_struct_symbol_table_entry (pos, &sym_tbl_ent);
         
         symbol_set_symbol_table_index (symbol, header.NumberOfSymbols);
         header.NumberOfSymbols++;
@@ -579,17 +597,7 @@ void write_coff_file (void) {
             memset (&aux_sym_ent, 0, sizeof (aux_sym_ent));
 
             aux_sym_ent.Length = section_header->SizeOfRawData;
-            {
-                struct fixup *fixup;
-
-                aux_sym_ent.NumberOfRelocations = 0;
-                section_set (section);
-                
-                for (fixup = current_frag_chain->first_fixup; fixup; fixup = fixup->next) {
-                    if (fixup->done) continue;                    
-                    aux_sym_ent.NumberOfRelocations++;
-                }
-            }
+            aux_sym_ent.NumberOfRelocations = section_header->NumberOfRelocations;
             aux_sym_ent.NumberOfLinenumbers = 0;
 
             aux_sym_ent.CheckSum = 0;
@@ -609,29 +617,21 @@ void write_coff_file (void) {
                 } else aux_sym_ent.Selection = 0;
             }
             
-            if (write_struct_aux_section_symbol (outfile, &aux_sym_ent)) {
-                as_error_at (NULL, 0, "Error writing symbol table!");
-                return;
-            }
+            pos = write_struct_aux_section_symbol (pos, &aux_sym_ent);
             header.NumberOfSymbols++;
         }
     }
     
-    if (write_struct_string_table_header (outfile, &string_table_header)) {
-        as_error_at (NULL, 0, "Failed to write string table!");
-        return;
-    }
+    pos = write_struct_string_table_header (pos, &string_table_header);
 
     for (section = sections; section; section = section_get_next_section (section)) {
 
         if (strlen (section_get_name (section)) > 8) {
 
-            if (fwrite (section_get_name (section), strlen (section_get_name (section)) + 1, 1, outfile) != 1) {
+            size_t name_size = strlen (section_get_name (section)) + 1;
             
-                as_error_at (NULL, 0, "Failed to write string table!");
-                return;
-            
-            }
+            memcpy (pos, section_get_name (section), name_size);
+            pos += name_size;
         
         }
 
@@ -641,12 +641,10 @@ void write_coff_file (void) {
     
         if (symbol->write_name_to_string_table) {
         
-            if (fwrite (symbol->name, strlen (symbol->name) + 1, 1, outfile) != 1) {
+            size_t name_size = strlen (symbol->name) + 1;
             
-                as_error_at (NULL, 0, "Failed to write string table!");
-                return;
-            
-            }
+            memcpy (pos, symbol->name, name_size);
+            pos += name_size;
         
         }
     
@@ -654,12 +652,8 @@ void write_coff_file (void) {
     
     for (section = sections; section; section = section_get_next_section (section)) {
     
-        struct section_table_entry_internal *section_header = section_get_object_format_dependent_data (section);
         struct fixup *fixup;
         
-        section_header->PointerToRelocations = ftell (outfile);
-        section_header->NumberOfRelocations = 0;
-        
         section_set (section);
         
         for (fixup = current_frag_chain->first_fixup; fixup; fixup = fixup->next) {
@@ -668,42 +662,19 @@ void write_coff_file (void) {
                 continue;
             }
             
-            if (output_relocation (outfile, fixup)) {
-            
-                as_error_at (NULL, 0, "Failed to write relocation!");
-                return;
-            
-            }
-            
-            section_header->NumberOfRelocations++;
+            pos = output_relocation (pos, fixup);
         
         }
         
-        if (section_header->NumberOfRelocations == 0) {
-            section_header->PointerToRelocations = 0;
-        }
+        free (section_get_object_format_dependent_data (section));
     
     }
     
-    rewind (outfile);
-    
-    if (write_struct_coff_header (outfile, &header)) {
-    
-        as_error_at (NULL, 0, "Failed to write header!");
-        return;
+    if (fwrite (file, file_size, 1, outfile) != 1) {
+        as_error_at (NULL, 0, "Failed to write '%s'!", state->outfile);
+    } else as_statistics.bytes_emitted += file_size;
     
-    }
-    
-    for (section = sections; section; section = section_get_next_section (section)) {
-        struct section_table_entry_internal *section_header = section_get_object_format_dependent_data (section);
-        
-        if (write_struct_section_table_entry (outfile, section_header)) {
-            as_error_at (NULL, 0, "Failed to write section header!");
-            return;
-        }
-
-        free (section_header);
-    }
+    free (file);
     
     if (fclose (outfile)) {
         as_error_at (NULL, 0, "Failed to close file!");
@@ -558,7 +558,7 @@ void write_elf_file (void)
 
     if (fwrite (file, file_size, 1, outfile) != 1) {
         as_error_at (NULL, 0, "writing '%s' file failed", state->outfile);
-    }
+    } else as_statistics.bytes_emitted += file_size;
     
     free (file);
     fclose (outfile);
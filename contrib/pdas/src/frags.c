@@ -8,6 +8,7 @@
  * commercial and non-commercial, without any restrictions, without
  * complying with any conditions and by any means.
  *****************************************************************************/
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -16,11 +17,110 @@
 struct frag zero_address_frag = { 0 };
 struct frag *current_frag;
 
+/**
+ * Frags and their buffers are bump-allocated from chunks
+ * that are only freed all at once by frags_destroy ().
+ * The buffer of the frag at the tail of the current chunk
+ * grows in place, other buffers are moved with geometric growth.
+ */
+union frag_arena_align {
+
+    long l;
+    double d;
+    void *p;
+
+};
+
+struct frag_arena_chunk {
+
+    struct frag_arena_chunk *prev;
+    union frag_arena_align data[1];
+
+};
+
+static struct frag_arena_chunk *frag_arena_chunks = NULL;
+
+static unsigned char *frag_arena_ptr = NULL;
+static unsigned char *frag_arena_end = NULL;
+
+/* All sizes taken from the arena are rounded up so the next allocation stays aligned. */
+#define     FRAG_ARENA_ROUND(size)      \
+    (((size) + sizeof (union frag_arena_align) - 1) / sizeof (union frag_arena_align) * sizeof (union frag_arena_align))
+
+static void *frag_arena_alloc (size_t size) {
+
+    unsigned char *p;
+    
+    size = FRAG_ARENA_ROUND (size);
+    
+    if (frag_arena_ptr == NULL || (size_t) (frag_arena_end - frag_arena_ptr) < size) {
+    
+        size_t chunk_size = (size > FRAG_ARENA_CHUNK_SIZE) ? size : FRAG_ARENA_CHUNK_SIZE;
+        struct frag_arena_chunk *chunk = xmalloc (offsetof (struct frag_arena_chunk, data) + chunk_size);
+        
+        chunk->prev = frag_arena_chunks;
+        frag_arena_chunks = chunk;
+        
+        frag_arena_ptr = (unsigned char *) chunk->data;
+        frag_arena_end = frag_arena_ptr + chunk_size;
+    
+    }
+    
+    p = frag_arena_ptr;
+    frag_arena_ptr += size;
+    
+    return p;
+
+}
+
+/** Makes sure the frag buffer has space for at least the requested number of bytes. */
+static void frag_reserve (struct frag *frag, value_t size) {
+
+    unsigned char *new_buf;
+    value_t new_size;
+    
+    if (size <= frag->size) {
+        return;
+    }
+    
+    size = FRAG_ARENA_ROUND (size);
+    
+    if (frag->buf && frag->buf + frag->size == frag_arena_ptr
+        && (value_t) (frag_arena_end - frag->buf) >= size) {
+    
+        frag_arena_ptr = frag->buf + size;
+        frag->size = size;
+        return;
+    
+    }
+    
+    new_size = frag->size * 2;
+    
+    if (new_size < FRAG_BUF_MIN_SIZE) {
+        new_size = FRAG_BUF_MIN_SIZE;
+    }
+    
+    if (new_size < size) {
+        new_size = size;
+    }
+    
+    new_buf = frag_arena_alloc (new_size);
+    
+    if (frag->size) {
+        memcpy (new_buf, frag->buf, frag->size);
+    }
+    
+    frag->buf  = new_buf;
+    frag->size = new_size;
+
+}
+
 struct frag *frag_alloc (void)
 {
-    struct frag *frag = xmalloc (sizeof (*frag));
+    struct frag *frag = frag_arena_alloc (sizeof (*frag));
     
     memset (frag, 0, sizeof (*frag));
+    as_statistics.frags++;
     
     return frag;
 }
@@ -137,13 +237,7 @@ int frags_is_greater_than_offset (value_t offset2, const struct frag *frag2, val
 
 unsigned char *frag_alloc_space (value_t space) {
 
-    if (current_frag->fixed_size + space >= current_frag->size) {
-    
-        current_frag->size += ((space > FRAG_BUF_REALLOC_STEP) ? space : FRAG_BUF_REALLOC_STEP);
-        current_frag->buf   = xrealloc (current_frag->buf, current_frag->size);
-    
-    }
-    
+    frag_reserve (current_frag, current_frag->fixed_size + space);
     return current_frag->buf + current_frag->fixed_size;
 
 }
@@ -160,13 +254,7 @@ unsigned char *frag_increase_fixed_size (value_t increase) {
 unsigned char *finished_frag_increase_fixed_size_by_frag_offset (struct frag *frag) {
 
     frag->fixed_size += frag->offset;
-
-    if (frag->fixed_size > frag->size) {
-        
-        frag->buf = xrealloc (frag->buf, frag->fixed_size);
-        frag->size = frag->fixed_size;
-
-    }
+    frag_reserve (frag, frag->fixed_size);
 
     return (frag->buf + frag->fixed_size - frag->offset);
 }
@@ -188,10 +276,7 @@ void frag_align_code (offset_t alignment, offset_t max_bytes_to_skip) {
 void frag_append_1_char (unsigned char ch) {
 
     if (current_frag->fixed_size == current_frag->size) {
-    
-        current_frag->size += FRAG_BUF_REALLOC_STEP;
-        current_frag->buf   = xrealloc (current_frag->buf, current_frag->size);
-    
+        frag_reserve (current_frag, current_frag->fixed_size + 1);
     }
     
     current_frag->buf[current_frag->fixed_size++] = ch;
@@ -211,12 +296,17 @@ void frag_new (void) {
 
 }
 
-void frag_destroy (struct frag *frag)
+void frags_destroy (void)
 {
-    if (frag == NULL) return;
-
-    free (frag->buf);
-    free (frag);
+    struct frag_arena_chunk *chunk, *prev_chunk;
+    
+    for (chunk = frag_arena_chunks; chunk; chunk = prev_chunk) {
+        prev_chunk = chunk->prev;
+        free (chunk);
+    }
+    
+    frag_arena_chunks = NULL;
+    frag_arena_ptr = frag_arena_end = NULL;
 }
 
 void frag_set_as_variant (relax_type_t relax_type, relax_subtype_t relax_subtype, struct symbol *symbol, offset_t offset, value_t opcode_offset_in_buf) {
@@ -30,11 +30,14 @@ struct frag {
     unsigned long line_number;
     
     int relax_marker;
+    unsigned long relax_index;
+    
     struct frag *next;
 
 };
 
-#define     FRAG_BUF_REALLOC_STEP       16
+#define     FRAG_BUF_MIN_SIZE           64
+#define     FRAG_ARENA_CHUNK_SIZE       65536
 
 extern struct frag zero_address_frag;
 extern struct frag *current_frag;
@@ -53,5 +56,5 @@ void frag_align (offset_t alignment, int fill_char, offset_t max_bytes_to_skip);
 void frag_align_code (offset_t alignment, offset_t max_bytes_to_skip);
 void frag_append_1_char (unsigned char ch);
 void frag_new (void);
-void frag_destroy (struct frag *frag);
+void frags_destroy (void);
 void frag_set_as_variant (relax_type_t relax_type, relax_subtype_t relax_subtype, struct symbol *symbol, offset_t offset, value_t opcode_offset_in_buf);
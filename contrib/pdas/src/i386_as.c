@@ -15,7 +15,6 @@
 #include <string.h>
 
 #include "as.h"
-#include "hashtab.h"
 #include "options.h"
 #include "i386_opc.h"
 #include "i386_tbl.h"
@@ -52,18 +51,6 @@
 #define ESP_REG_NUM 4
 #define EBP_REG_NUM 5
 
-/**
- * Groups together instruction templates with the same name for hash table search.
- * Templates start at start (included) and end at end (not included).
- */
-struct templates {
-
-    const char *name;
-    const struct template *start;
-    const struct template *end;
-
-};
-
 struct modrm_byte {
 
     unsigned int regmem;
@@ -303,8 +290,28 @@ static int operand_exprs_count;
 
 static const struct templates *current_templates;
 
-static struct hashtab *templates_hashtab;
-static struct hashtab *reg_entry_hashtab;
+/**
+ * Remembers which template matched for a given mnemonic, suffix
+ * and operand types, so repeated instruction shapes skip the search.
+ * The result also depends on bits and cpu_arch_flags,
+ * so the cache is cleared whenever they change.
+ */
+#define MATCH_CACHE_SIZE 1024
+
+struct match_cache_entry {
+
+    const struct templates *templates;
+    char mnemonic_suffix;
+    char suffix;
+    int operands;
+    struct operand_type types[MAX_OPERANDS];
+
+    const struct template *template;
+    unsigned int found_reverse_match;
+
+};
+
+static struct match_cache_entry match_cache[MATCH_CACHE_SIZE];
 
 static void set_bits (int new_bits, int cause_fatal_error);
 
@@ -312,93 +319,35 @@ static void set_bits (int new_bits, int cause_fatal_error);
 static int intel_parse_name (struct expr *expr, char *name);
 static int intel_parse_operand (char *operand_string);
 
-static hash_value_t hash_templates (const void *p)
-{
-    const struct templates *templates = (const struct templates *) p;
-    return hashtab_help_default_hash_string (templates->name);
-}
-
-static int equal_templates (const void *p1, const void *p2)
-{
-    const struct templates *templates1 = (const struct templates *) p1;
-    const struct templates *templates2 = (const struct templates *) p2;
-    
-    return strcmp (templates1->name, templates2->name) == 0;
-}
-
 static const struct templates *find_templates (const char *name)
 {
-    struct templates fake = { NULL, NULL, NULL };
-    fake.name = name;
-    
-    return (const struct templates *) hashtab_find (templates_hashtab, &fake);
-}
+    const struct templates *templates;
+    unsigned long displacement;
 
-static hash_value_t hash_reg_entry (const void *p)
-{
-    const struct reg_entry *reg_entry = (const struct reg_entry *) p;
-    return hashtab_help_default_hash_string (reg_entry->name);
-}
+    displacement = templates_hash_displacements[i386_hash_name (0, name) & (TEMPLATES_HASH_BUCKETS - 1)];
+    templates = templates_hash_table[i386_hash_name (displacement, name) & (TEMPLATES_HASH_SIZE - 1)];
 
-static int equal_reg_entry (const void *p1, const void *p2)
-{
-    const struct reg_entry *reg_entry1 = (const struct reg_entry *) p1;
-    const struct reg_entry *reg_entry2 = (const struct reg_entry *) p2;
-       
-    return strcmp (reg_entry1->name, reg_entry2->name) == 0;
+    if (templates && strcmp (templates->name, name) == 0) return templates;
+    return NULL;
 }
 
 static const struct reg_entry *find_reg_entry (const char *name)
 {
-    struct reg_entry fake = { NULL };
-    fake.name = name;
-    
-    return (const struct reg_entry *) hashtab_find (reg_entry_hashtab, &fake);
+    const struct reg_entry *reg_entry;
+    unsigned long displacement;
+
+    displacement = reg_hash_displacements[i386_hash_name (0, name) & (REG_HASH_BUCKETS - 1)];
+    reg_entry = reg_hash_table[i386_hash_name (displacement, name) & (REG_HASH_SIZE - 1)];
+
+    if (reg_entry && strcmp (reg_entry->name, name) == 0) return reg_entry;
+    return NULL;
 }
 
 void machine_dependent_init (void)
 {
-    const struct template *template;
     const struct reg_entry *reg_entry;
-    
-    struct templates *templates;
     int c;
     
-    templates_hashtab = hashtab_create_hashtab (0, hash_templates, equal_templates, &xmalloc, &free);
-    
-    if (templates_hashtab == NULL) {
-        as_internal_error_at_source_at (__FILE__, __LINE__, NULL, 0, "error creating templates_hashtab");
-    }
-    
-    template = template_table;
-    templates = xmalloc (sizeof (*templates));
-    templates->name = template->name;
-    templates->start = template;
-    
-    while (1) {
-        template++;
-        
-        if (template->name == NULL || strcmp (template->name, (template - 1)->name)) {
-            templates->end = template;
-            
-            if ((templates = (struct templates *) hashtab_insert (templates_hashtab, templates))) {
-                as_internal_error_at_source_at (__FILE__, __LINE__, NULL, 0, "error inserting '%s' into templates_hashtab", templates->name);
-            }
-            
-            if (template->name == NULL) { break; }
-            
-            templates = xmalloc (sizeof (*templates));
-            templates->name = template->name;
-            templates->start = template;
-        }
-    }
-    
-    reg_entry_hashtab = hashtab_create_hashtab (0, hash_reg_entry, equal_reg_entry, &xmalloc, &free);
-    
-    if (reg_entry_hashtab == NULL) {
-        as_internal_error_at_source_at (__FILE__, __LINE__, NULL, 0, "error creating reg_entry_hashtab");
-    }
-    
     for (reg_entry = reg_table; reg_entry->name; reg_entry++) {
         if (reg_entry->type.float_reg) {
             if (!reg_entry->type.float_acc) continue;
@@ -415,10 +364,6 @@ void machine_dependent_init (void)
                 case 3: reg_ds = reg_entry; break;
             }
         }
-        
-        if (hashtab_insert (reg_entry_hashtab, reg_entry)) {
-            as_internal_error_at_source_at (__FILE__, __LINE__, NULL, 0, "error inserting into reg_entry_hashtab");
-        }
     }
     
     /* Fills lexical table. */
@@ -440,16 +385,9 @@ void machine_dependent_init (void)
     if (state->format == AS_FORMAT_COFF) coff_x86_set_bits (bits);
 }
 
-static void templates_destroy (void *p)
-{
-    free (p);
-}
-
 void machine_dependent_destroy (void)
 {
-    hashtab_destroy_hashtab (reg_entry_hashtab);
-    hashtab_for_each_element (templates_hashtab, &templates_destroy); 
-    hashtab_destroy_hashtab (templates_hashtab);
+    /* The mnemonic and register tables are static, nothing to free. */
 }
 
 void machine_dependent_number_to_chars (unsigned char *p, value_t number, unsigned long size)
@@ -2466,6 +2404,40 @@ static int operand_type_match (struct operand_type overlap, struct operand_type
     return 1;
 }
 
+static void match_cache_clear (void)
+{
+    memset (match_cache, 0, sizeof (match_cache));
+}
+
+static struct match_cache_entry *match_cache_slot (char mnemonic_suffix)
+{
+    const unsigned char *p = (const unsigned char *) instruction.types;
+    const unsigned char *end = p + sizeof (instruction.types[0]) * instruction.operands;
+    unsigned long hash;
+
+    hash = (unsigned long) (current_templates - templates_table);
+    hash = hash * 31 + (unsigned char) mnemonic_suffix;
+    hash = hash * 31 + (unsigned char) instruction.suffix;
+    hash = hash * 31 + instruction.operands;
+
+    for (; p < end; p++) {
+        hash = (hash ^ *p) * 16777619UL;
+    }
+
+    return &match_cache[(hash ^ (hash >> 16)) & (MATCH_CACHE_SIZE - 1)];
+}
+
+static int match_cache_entry_equal (const struct match_cache_entry *entry, char mnemonic_suffix)
+{
+    return (entry->templates == current_templates
+            && entry->mnemonic_suffix == mnemonic_suffix
+            && entry->suffix == instruction.suffix
+            && entry->operands == instruction.operands
+            && !memcmp (entry->types,
+                        instruction.types,
+                        sizeof (instruction.types[0]) * instruction.operands));
+}
+
 static int match_template (char mnemonic_suffix)
 {
     const struct template *template;
@@ -2473,6 +2445,18 @@ static int match_template (char mnemonic_suffix)
     
     unsigned int found_reverse_match = 0;
     struct opcode_modifier suffix_check = {0};
+    struct match_cache_entry *cache_entry;
+
+    as_statistics.match_cache_lookups++;
+    cache_entry = match_cache_slot (mnemonic_suffix);
+
+    if (match_cache_entry_equal (cache_entry, mnemonic_suffix)) {
+        as_statistics.match_cache_hits++;
+        
+        template = cache_entry->template;
+        found_reverse_match = cache_entry->found_reverse_match;
+        goto found;
+    }
     
     switch (mnemonic_suffix) {
     
@@ -2639,7 +2623,16 @@ static int match_template (char mnemonic_suffix)
         as_error ("%s for '%s'", error_msg, current_templates->name);
         return 1;
     }
-    
+
+    cache_entry->templates = current_templates;
+    cache_entry->mnemonic_suffix = mnemonic_suffix;
+    cache_entry->suffix = instruction.suffix;
+    cache_entry->operands = instruction.operands;
+    memcpy (cache_entry->types, instruction.types, sizeof (instruction.types[0]) * instruction.operands);
+    cache_entry->template = template;
+    cache_entry->found_reverse_match = found_reverse_match;
+
+found:
     instruction.template = *template;
     
     if (found_reverse_match) {
@@ -3231,6 +3224,12 @@ offset_t machine_dependent_relax_frag (struct frag *frag, section_t section, off
     return growth;
 }
 
+/* Returns 1 if the frag cannot grow anymore. */
+int machine_dependent_relax_frag_is_final (struct frag *frag)
+{
+    return relax_table[frag->relax_subtype].next_subtype == 0;
+}
+
 void machine_dependent_apply_fixup (struct fixup *fixup, value_t value)
 {
     unsigned char *p = fixup->where + fixup->frag->buf;
@@ -3356,6 +3355,7 @@ static void set_bits (int new_bits, int cause_fatal_error)
     }
 
     bits = new_bits;
+    match_cache_clear ();
 
     if (bits == 64) {
         cpu_arch_flags.cpu_no64 = 0;
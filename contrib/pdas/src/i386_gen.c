@@ -132,6 +132,87 @@ static struct name_bitfield operand_type_nb[] = {
 };
 #undef GENERATOR_MACRO
 
+static unsigned int bitfield_value (const struct name_bitfield *start_nb, const char *name)
+{
+    const struct name_bitfield *nb;
+
+    for (nb = start_nb; nb->name; nb++) {
+        if (!strcmp (nb->name, name)) return nb->value;
+    }
+
+    return 0;
+}
+
+/**
+ * Names which should be findable through the generated perfect hash tables.
+ * For mnemonics start and end delimit the group of templates with that name,
+ * for registers start is the index into reg_table.
+ */
+struct hash_key {
+
+    char *name;
+    unsigned long start;
+    unsigned long end;
+
+};
+
+struct hash_keys {
+
+    struct hash_key *keys;
+    unsigned long count;
+    unsigned long capacity;
+
+};
+
+static struct hash_keys template_keys;
+static unsigned long template_count;
+
+static struct hash_keys reg_keys;
+static unsigned long reg_count;
+
+static char *copy_quoted_name (const char *line)
+{
+    const char *end;
+    char *name;
+
+    if (*line != '"') return NULL;
+    line++;
+
+    end = strchr (line, '"');
+    if (!end) return NULL;
+
+    name = xmalloc (end - line + 1);
+    memcpy (name, line, end - line);
+    name[end - line] = '\0';
+
+    return name;
+}
+
+static struct hash_key *add_hash_key (struct hash_keys *keys, char *name, unsigned long start)
+{
+    struct hash_key *key;
+
+    if (keys->count == keys->capacity) {
+        keys->capacity = keys->capacity ? keys->capacity * 2 : 256;
+        keys->keys = xrealloc (keys->keys, sizeof (*keys->keys) * keys->capacity);
+    }
+
+    key = &keys->keys[keys->count++];
+    key->name = name;
+    key->start = start;
+    key->end = start + 1;
+
+    return key;
+}
+
+static void free_hash_keys (struct hash_keys *keys)
+{
+    unsigned long i;
+
+    for (i = 0; i < keys->count; i++) free (keys->keys[i].name);
+    free (keys->keys);
+}
+
 static int process_bitfield_init (FILE *outfile, char *line, struct name_bitfield *start_nb)
 {
     struct name_bitfield *nb;
@@ -255,6 +336,31 @@ static int generate_template (FILE *outfile, char *line)
 
     if (!*line) return 0;
 
+    {
+        char *name = copy_quoted_name (line);
+        unsigned long i;
+
+        if (!name) return 1;
+
+        if (template_keys.count
+            && !strcmp (template_keys.keys[template_keys.count - 1].name, name)) {
+            template_keys.keys[template_keys.count - 1].end = template_count + 1;
+            free (name);
+        } else {
+            for (i = 0; i < template_keys.count; i++) {
+                if (!strcmp (template_keys.keys[i].name, name)) {
+                    fprintf (stderr, "error: templates for '%s' are not consecutive\n", name);
+                    free (name);
+                    return 1;
+                }
+            }
+
+            add_hash_key (&template_keys, name, template_count);
+        }
+
+        template_count++;
+    }
+
     safe_fputs ("    { ", outfile);
 
     /* First three fields should be copied verbatim. */
@@ -320,6 +426,140 @@ static int generate_template (FILE *outfile, char *line)
     return 0;
 }
 
+#define MAX_DISPLACEMENT 0xFFFF
+
+/**
+ * Hash and displace: keys are split into buckets by i386_hash_name (0, name)
+ * and for each bucket, largest first, a displacement is searched for
+ * that puts all keys of the bucket into free slots
+ * when used as the seed of i386_hash_name ().
+ */
+static int try_perfect_hash (const struct hash_keys *keys,
+                             unsigned long size,
+                             unsigned long buckets,
+                             unsigned long *displacements,
+                             long *slots)
+{
+    unsigned long *bucket_of = xmalloc (sizeof (*bucket_of) * (keys->count + 1));
+    unsigned long *bucket_sizes = xmalloc (sizeof (*bucket_sizes) * buckets);
+    unsigned long max_bucket_size = 0;
+    unsigned long bucket_size, bucket, i, j;
+    int ret = 1;
+
+    for (i = 0; i < size; i++) slots[i] = -1;
+    for (i = 0; i < buckets; i++) {
+        displacements[i] = 0;
+        bucket_sizes[i] = 0;
+    }
+
+    for (i = 0; i < keys->count; i++) {
+        bucket_of[i] = i386_hash_name (0, keys->keys[i].name) & (buckets - 1);
+        if (++bucket_sizes[bucket_of[i]] > max_bucket_size) {
+            max_bucket_size = bucket_sizes[bucket_of[i]];
+        }
+    }
+
+    for (bucket_size = max_bucket_size; ret && bucket_size; bucket_size--) {
+        for (bucket = 0; bucket < buckets; bucket++) {
+            unsigned long displacement;
+            
+            if (bucket_sizes[bucket] != bucket_size) continue;
+
+            for (displacement = 1; displacement <= MAX_DISPLACEMENT; displacement++) {
+                for (i = 0; i < keys->count; i++) {
+                    unsigned long slot;
+                    
+                    if (bucket_of[i] != bucket) continue;
+
+                    slot = i386_hash_name (displacement, keys->keys[i].name) & (size - 1);
+                    if (slots[slot] != -1) break;
+                    slots[slot] = i;
+                }
+
+                if (i == keys->count) break;
+
+                for (j = 0; j < i; j++) {
+                    if (bucket_of[j] != bucket) continue;
+                    slots[i386_hash_name (displacement, keys->keys[j].name) & (size - 1)] = -1;
+                }
+            }
+
+            if (displacement > MAX_DISPLACEMENT) {
+                ret = 0;
+                break;
+            }
+
+            displacements[bucket] = displacement;
+        }
+    }
+
+    free (bucket_of);
+    free (bucket_sizes);
+
+    return ret;
+}
+
+static int generate_perfect_hash (FILE *outfile,
+                                  const struct hash_keys *keys,
+                                  const char *macro_prefix,
+                                  const char *array_prefix,
+                                  const char *element_type,
+                                  const char *element_table,
+                                  int index_is_start)
+{
+    unsigned long size, buckets, i;
+    unsigned long *displacements;
+    long *slots;
+
+    for (size = 4; size < keys->count; size <<= 1) {}
+
+    while (1) {
+        buckets = size / 4;
+        displacements = xmalloc (sizeof (*displacements) * buckets);
+        slots = xmalloc (sizeof (*slots) * size);
+
+        if (try_perfect_hash (keys, size, buckets, displacements, slots)) break;
+
+        free (displacements);
+        free (slots);
+        size <<= 1;
+    }
+
+    if (fprintf (outfile, "\n#define %s_HASH_BUCKETS %lu\n", macro_prefix, buckets) < 0
+        || fprintf (outfile, "#define %s_HASH_SIZE %lu\n", macro_prefix, size) < 0
+        || fprintf (outfile, "\nstatic const unsigned short %s_hash_displacements[%s_HASH_BUCKETS] = {\n\n",
+                    array_prefix, macro_prefix) < 0) {
+        return 1;
+    }
+
+    for (i = 0; i < buckets; i++) {
+        if (fprintf (outfile, "%s%lu,%s",
+                     (i % 16) ? " " : "    ",
+                     displacements[i],
+                     (i % 16 == 15 || i + 1 == buckets) ? "\n" : "") < 0) return 1;
+    }
+
+    if (fprintf (outfile, "\n};\n\nstatic %s %s_hash_table[%s_HASH_SIZE] = {\n\n",
+                 element_type, array_prefix, macro_prefix) < 0) return 1;
+
+    for (i = 0; i < size; i++) {
+        if (slots[i] == -1) {
+            safe_fputs ("    0,\n", outfile);
+        } else if (fprintf (outfile, "    &%s[%lu],\n",
+                            element_table,
+                            index_is_start ? keys->keys[slots[i]].start : (unsigned long) slots[i]) < 0) {
+            return 1;
+        }
+    }
+
+    safe_fputs ("\n};\n", outfile);
+
+    free (displacements);
+    free (slots);
+
+    return 0;
+}
+
 static int generate_templates (FILE *outfile, char **pos_p)
 {
     char *pos = *pos_p;
@@ -345,12 +585,33 @@ static int generate_templates (FILE *outfile, char **pos_p)
 
     safe_fputs ("    { 0 }\n\n};\n", outfile);
 
+    {
+        unsigned long i;
+
+        safe_fputs ("\nstatic const struct templates templates_table[] = {\n\n", outfile);
+
+        for (i = 0; i < template_keys.count; i++) {
+            if (fprintf (outfile, "    { \"%s\", template_table + %lu, template_table + %lu },\n",
+                         template_keys.keys[i].name,
+                         template_keys.keys[i].start,
+                         template_keys.keys[i].end) < 0) return 1;
+        }
+
+        safe_fputs ("\n};\n", outfile);
+    }
+
+    if (generate_perfect_hash (outfile, &template_keys,
+                               "TEMPLATES", "templates",
+                               "const struct templates *const", "templates_table", 0)) return 1;
+
     *pos_p = pos;
     return 0;
 }
 
 static int generate_reg (FILE *outfile, char *line)
 {
+    char *name;
+    
     skip_spaces (&line);
 
     if (!*line) return 0;
@@ -363,6 +624,8 @@ static int generate_reg (FILE *outfile, char *line)
         if (!p) return 1;
         *p = '\0';
 
+        if (!(name = copy_quoted_name (line))) return 1;
+
         safe_fputs (line, outfile);
         safe_fputs (", ", outfile);
 
@@ -375,12 +638,24 @@ static int generate_reg (FILE *outfile, char *line)
         if (!p) return 1;
         *p = '\0';
         
-        if (process_bitfield_init (outfile, line, operand_type_nb)) return 1;
+        if (process_bitfield_init (outfile, line, operand_type_nb)) {
+            free (name);
+            return 1;
+        }
         safe_fputs (", ", outfile);
 
         line = p + 1;
     }
 
+    /* Only %st (%st(0)) is looked up by name,
+     * the other floating point registers are found relative to it. */
+    if (bitfield_value (operand_type_nb, "float_reg")
+        && !bitfield_value (operand_type_nb, "float_acc")) {
+        free (name);
+    } else add_hash_key (&reg_keys, name, reg_count);
+
+    reg_count++;
+
     skip_spaces (&line);
     safe_fputs (line, outfile);
     
@@ -414,6 +689,10 @@ static int generate_regs (FILE *outfile, char **pos_p)
 
     safe_fputs ("    { 0 }\n\n};\n", outfile);
 
+    if (generate_perfect_hash (outfile, &reg_keys,
+                               "REG", "reg",
+                               "const struct reg_entry *const", "reg_table", 1)) return 1;
+
     *pos_p = pos;
     return 0;
 }
@@ -562,6 +841,9 @@ static int generate (FILE *outfile, const char *in_template_filename)
         return 1;
     }
 
+    free_hash_keys (&template_keys);
+    free_hash_keys (&reg_keys);
+
     free (real_file);
     return 0;
 }
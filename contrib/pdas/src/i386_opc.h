@@ -161,3 +161,31 @@ struct reg_entry {
 #define REG_FLAT_NUMBER ((unsigned int) ~0)
 #define REG_IP_NUMBER ((unsigned int) ~0)
 
+/**
+ * Groups together instruction templates with the same name for hash table search.
+ * Templates start at start (included) and end at end (not included).
+ */
+struct templates {
+
+    const char *name;
+    const struct template *start;
+    const struct template *end;
+
+};
+
+/**
+ * Hash function shared by i386_gen.c, which builds the perfect hash tables
+ * in i386_tbl.h, and i386_as.c, which searches them.
+ * Only the low 32 bits are used so the result does not depend on the host.
+ */
+static unsigned long i386_hash_name (unsigned long seed, const char *name)
+{
+    unsigned long hash = (2166136261UL ^ (seed * 0x9E3779B1UL)) & 0xFFFFFFFFUL;
+
+    for (; *name; name++) {
+        hash ^= (unsigned char) *name;
+        hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+    }
+
+    return hash ^ (hash >> 15);
+}
@@ -14,6 +14,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#ifdef  AS_USE_GETTIMEOFDAY
+# define    AS_STATISTICS_USE_GETTIMEOFDAY
+# include   <sys/time.h>
+#endif
 
 #include "as.h"
 #include "cstr.h"
@@ -23,25 +29,32 @@
 enum option_index {
 
     AS_OPTION_IGNORED = 0,
+    AS_OPTION_BATCH,
     AS_OPTION_DEFSYM,
     AS_OPTION_HELP,
     AS_OPTION_INCLUDE,
+    AS_OPTION_JOBS,
     AS_OPTION_LISTING,
     AS_OPTION_NO_PSEUDO_DOT,
     AS_OPTION_OUTFILE,
-    AS_OPTION_OFORMAT
+    AS_OPTION_OFORMAT,
+    AS_OPTION_STATS
 
 };
 
 static const struct as_option as_options[] = {
 
     { "a",              AS_OPTION_LISTING,       AS_OPTION_HAS_OPTIONAL_ARG  },
+    { "-batch",         AS_OPTION_BATCH,         AS_OPTION_NO_ARG            },
     { "-defsym",        AS_OPTION_DEFSYM,        AS_OPTION_HAS_ARG           },
     { "-help",          AS_OPTION_HELP,          AS_OPTION_NO_ARG            },
     { "I",              AS_OPTION_INCLUDE,       AS_OPTION_HAS_ARG           },
+    { "j",              AS_OPTION_JOBS,          AS_OPTION_HAS_ARG           },
+    { "-jobs",          AS_OPTION_JOBS,          AS_OPTION_HAS_ARG           },
     { "o",              AS_OPTION_OUTFILE,       AS_OPTION_HAS_ARG           },
     { "-no-pseudo-dot", AS_OPTION_NO_PSEUDO_DOT, AS_OPTION_NO_ARG            },
     { "-oformat",       AS_OPTION_OFORMAT,       AS_OPTION_HAS_ARG           },
+    { "-stats",         AS_OPTION_STATS,         AS_OPTION_HAS_OPTIONAL_ARG  },
     { NULL,             0,                       0                           }
 
 };
@@ -135,13 +148,18 @@ static void _print_help (const char *name)
     printf ("Usage: %s [options] asmfile...\n\n", name);
 
     printf ("    -a[=FILE]             Print listings to stdout or a specified file\n");
+    printf ("    --batch               Assemble each asmfile into its own object file\n");
+    printf ("                              (asmfile with its extension replaced by .o)\n");
     printf ("    --defsym SYM=VAL      Define symbol SYM to given value\n");
     printf ("    --help                Print this help information\n");
     printf ("    -I DIR                Add DIR to search list for .include directives\n");
+    printf ("    -j N, --jobs N        Assemble up to N files at once in --batch mode\n");
+    printf ("                              (default is the number of processors)\n");
     printf ("    --no-pseudo-dot       Accept pseudo-ops without dot prefix\n");
     printf ("    -o OBJFILE            Name the object-file output OBJFILE (default a.out)\n");
     printf ("    --oformat FORMAT      Create an output file in format FORMAT (default %s)\n", default_format);
     printf ("                              Supported formats are: a.out, coff, elf\n");
+    printf ("    --stats[=json]        Print phase times and counters to stderr\n");
 
     machine_dependent_print_help ();
     
@@ -259,6 +277,10 @@ void as_parse_args (int *pargc, char ***pargv, int optind)
         
         switch (popt->index) {
 
+            case AS_OPTION_BATCH:
+                state->batch = 1;
+                break;
+            
             case AS_OPTION_DEFSYM:
                 {
                     struct defsym *defsym;
@@ -288,6 +310,20 @@ void as_parse_args (int *pargc, char ***pargv, int optind)
                 _add_include_path (optarg);
                 break;
             
+            case AS_OPTION_JOBS: {
+            
+                char *end;
+                
+                state->jobs = (int) strtol (optarg, &end, 10);
+                
+                if (*end != '\0' || state->jobs <= 0) {
+                    _error ("invalid number of jobs '%s'", optarg);
+                }
+                
+                break;
+            
+            }
+            
             case AS_OPTION_LISTING:
             
                 state->generate_listing = 1;
@@ -334,6 +370,18 @@ void as_parse_args (int *pargc, char ***pargv, int optind)
             
             }
             
+            case AS_OPTION_STATS:
+            
+                if (*optarg == '\0') {
+                    state->stats = AS_STATS_TEXT;
+                } else if (xstrcasecmp (optarg, "json") == 0) {
+                    state->stats = AS_STATS_JSON;
+                } else {
+                    _error ("invalid --stats format '%s'", optarg);
+                }
+                
+                break;
+            
             default:
             
                 _error ("unsupported option '%s'", r);
@@ -343,6 +391,18 @@ void as_parse_args (int *pargc, char ***pargv, int optind)
     
     }
     
+    if (state->batch) {
+    
+        if (state->outfile) {
+            _error ("-o cannot be used with --batch, object files are named after the input files");
+        }
+        
+        if (state->generate_listing) {
+            _error ("-a cannot be used with --batch");
+        }
+    
+    }
+    
     if (!state->outfile) { state->outfile = "a.out"; }
 }
 
@@ -362,6 +422,179 @@ void as_use_defsyms (void)
     }
 }
 
+struct as_statistics as_statistics;
+
+static const char *phase_names[AS_PHASE_MAX] = {
+
+    "process",
+    "relax",
+    "fixup",
+    "write"
+
+};
+
+static double phase_wall_times[AS_PHASE_MAX];
+static double phase_cpu_times[AS_PHASE_MAX];
+
+static double phase_wall_start[AS_PHASE_MAX];
+static clock_t phase_cpu_start[AS_PHASE_MAX];
+
+/**
+ * passes counts full relaxation passes over the section,
+ * or the jumps taken off the worklist when worklist is set.
+ */
+struct relax_passes {
+
+    struct relax_passes *next;
+    char *section_name;
+    unsigned long passes;
+    int worklist;
+
+};
+
+static struct relax_passes *relax_passes = NULL;
+static struct relax_passes **last_relax_passes_p = &relax_passes;
+
+static double get_wall_time (void)
+{
+#ifdef AS_STATISTICS_USE_GETTIMEOFDAY
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+#else
+    return (double) time (NULL);
+#endif
+}
+
+void as_phase_start (enum as_phase phase)
+{
+    if (!state->stats) return;
+
+    phase_wall_start[phase] = get_wall_time ();
+    phase_cpu_start[phase] = clock ();
+}
+
+void as_phase_end (enum as_phase phase)
+{
+    if (!state->stats) return;
+
+    phase_wall_times[phase] += get_wall_time () - phase_wall_start[phase];
+    phase_cpu_times[phase] += (double) (clock () - phase_cpu_start[phase]) / CLOCKS_PER_SEC;
+}
+
+void as_statistics_add_relax_passes (const char *section_name, unsigned long passes, int worklist)
+{
+    struct relax_passes *rp;
+
+    if (!state->stats) return;
+
+    rp = xmalloc (sizeof (*rp));
+    rp->next = NULL;
+    rp->section_name = xstrdup (section_name);
+    rp->passes = passes;
+    rp->worklist = worklist;
+
+    *last_relax_passes_p = rp;
+    last_relax_passes_p = &rp->next;
+}
+
+static void print_json_string (const char *str)
+{
+    fputc ('"', stderr);
+
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            fprintf (stderr, "\\%c", *str);
+        } else if ((unsigned char) *str < 0x20) {
+            fprintf (stderr, "\\u%04x", (unsigned char) *str);
+        } else fputc (*str, stderr);
+    }
+
+    fputc ('"', stderr);
+}
+
+void as_print_statistics (void)
+{
+    struct relax_passes *rp, *next_rp;
+    int i;
+
+    if (state->stats == AS_STATS_JSON) {
+        fprintf (stderr, "{\"output\": ");
+        print_json_string (state->outfile);
+
+        fprintf (stderr, ", \"phases\": {");
+        for (i = 0; i < AS_PHASE_MAX; i++) {
+            fprintf (stderr, "%s\"%s\": {\"wall\": %.6f, \"cpu\": %.6f}",
+                     i ? ", " : "",
+                     phase_names[i],
+                     phase_wall_times[i],
+                     phase_cpu_times[i]);
+        }
+
+        fprintf (stderr, "}, \"counters\": {\"lines\": %lu, \"instructions\": %lu, \"frags\": %lu, "
+                 "\"fixups\": %lu, \"symbol_lookups\": %lu, \"bytes_emitted\": %lu, "
+                 "\"match_cache_hits\": %lu, \"match_cache_misses\": %lu}",
+                 as_statistics.lines,
+                 as_statistics.instructions,
+                 as_statistics.frags,
+                 as_statistics.fixups,
+                 as_statistics.symbol_lookups,
+                 as_statistics.bytes_emitted,
+                 as_statistics.match_cache_hits,
+                 as_statistics.match_cache_lookups - as_statistics.match_cache_hits);
+
+        fprintf (stderr, ", \"relax_passes\": [");
+        for (rp = relax_passes; rp; rp = rp->next) {
+            fprintf (stderr, "%s{\"section\": ", rp == relax_passes ? "" : ", ");
+            print_json_string (rp->section_name);
+            fprintf (stderr, ", \"%s\": %lu, \"worklist\": %s}",
+                     rp->worklist ? "worklist_iterations" : "passes",
+                     rp->passes,
+                     rp->worklist ? "true" : "false");
+        }
+
+        fprintf (stderr, "]}\n");
+    } else if (state->stats == AS_STATS_TEXT) {
+        fprintf (stderr, "%s: statistics for '%s':\n", program_name ? program_name : "as", state->outfile);
+        fprintf (stderr, "    %-18s %12s %12s\n", "phase", "wall (s)", "cpu (s)");
+
+        for (i = 0; i < AS_PHASE_MAX; i++) {
+            fprintf (stderr, "    %-18s %12.6f %12.6f\n",
+                     phase_names[i],
+                     phase_wall_times[i],
+                     phase_cpu_times[i]);
+        }
+
+        fprintf (stderr, "    %-18s %12lu\n", "lines", as_statistics.lines);
+        fprintf (stderr, "    %-18s %12lu\n", "instructions", as_statistics.instructions);
+        fprintf (stderr, "    %-18s %12lu\n", "frags", as_statistics.frags);
+        fprintf (stderr, "    %-18s %12lu\n", "fixups", as_statistics.fixups);
+        fprintf (stderr, "    %-18s %12lu\n", "symbol lookups", as_statistics.symbol_lookups);
+        fprintf (stderr, "    %-18s %12lu\n", "bytes emitted", as_statistics.bytes_emitted);
+        fprintf (stderr, "    %-18s %12lu\n", "match cache hits", as_statistics.match_cache_hits);
+        fprintf (stderr, "    %-18s %12lu\n", "match cache misses", as_statistics.match_cache_lookups - as_statistics.match_cache_hits);
+
+        fprintf (stderr, "    relaxation:\n");
+        for (rp = relax_passes; rp; rp = rp->next) {
+            fprintf (stderr, "        %-12s %12lu %s\n",
+                     rp->section_name,
+                     rp->passes,
+                     rp->worklist ? "worklist iterations" : "passes");
+        }
+    }
+
+    for (rp = relax_passes; rp; rp = next_rp) {
+        next_rp = rp->next;
+
+        free (rp->section_name);
+        free (rp);
+    }
+
+    relax_passes = NULL;
+    last_relax_passes_p = &relax_passes;
+}
+
 void dynarray_add (int *nb_ptr, void *ptab, void *data) {
 
     int nb, nb_alloc;
@@ -13,16 +13,42 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* AS_USE_MMAP is defined by the Unix makefile. */
+#ifdef  AS_USE_MMAP
+# define    LOAD_LINE_USE_MMAP
+# include   <sys/mman.h>
+# include   <sys/stat.h>
+#endif
+
 #include "as.h"
 
-#define CAPACITY_INCREMENT 256
+#define CAPACITY_INITIAL 256
+#define READ_SIZE_INITIAL 65536
 
+/**
+ * The whole input is loaded at once (mapped if possible)
+ * and lines that do not need any changes are returned in place.
+ * Single tabs are replaced by spaces in place, only lines with comments,
+ * runs of whitespace or carriage returns are copied into the line buffer.
+ */
 struct load_line_data {
-
-    char *line, *real_line;
     
-    size_t capacity, read_size;
-    size_t end_of_prev_real_line;
+    char *data;
+    size_t size, pos;
+    
+    int loaded;
+    int mapped;
+    
+    /* Character overwritten by '\0' after the last line returned in place. */
+    char *saved_char_p;
+    char saved_char;
+    
+    char *line;
+    size_t line_capacity;
+    
+    /* Copy of the unterminated last line, "...\n" is appended to it. */
+    char *real_line;
+    size_t real_line_capacity;
     
     /**
      * Optional pointer for improving the warning message issued
@@ -32,205 +58,426 @@ struct load_line_data {
 
 };
 
-int load_line (char **line_p, char **line_end_p, char **real_line_p, size_t *real_line_len_p,
-               unsigned long *newlines_p, FILE *input_file,
-               void **load_line_internal_data_p)
+static int load_whole_file (struct load_line_data *l_l_data, FILE *input_file)
 {
-    struct load_line_data *l_l_data;
-    size_t pos_in_line = 0, pos_in_real_line = 0;
-    
-    unsigned long newlines = 0;
-    
-    int in_block_comment = 0, in_line_comment = 0, skipping_spaces = 0, in_escape = 0, in_quote = 0;
-    int possible_start_or_end_of_comment = 0;
+    size_t capacity;
+
+#if     defined (LOAD_LINE_USE_MMAP)
+    struct stat st;
     
-    l_l_data = *load_line_internal_data_p;
+    if (fstat (fileno (input_file), &st) == 0 && S_ISREG (st.st_mode)) {
+        
+        void *p;
+        
+        if (st.st_size == 0) {
+            return 0;
+        }
+        
+        /* Private mapping, processing the line modifies it in place. */
+        p = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno (input_file), 0);
+        
+        if (p != MAP_FAILED) {
+            
+            l_l_data->data = p;
+            l_l_data->size = st.st_size;
+            l_l_data->mapped = 1;
+            
+            return 0;
+        
+        }
     
-    if (l_l_data->end_of_prev_real_line) {
-        memmove (l_l_data->real_line,
-                 l_l_data->real_line + l_l_data->end_of_prev_real_line,
-                 l_l_data->read_size - l_l_data->end_of_prev_real_line);
-        l_l_data->read_size -= l_l_data->end_of_prev_real_line;;
     }
+#endif
+    
+    capacity = READ_SIZE_INITIAL;
+    l_l_data->data = xmalloc (capacity + 1);
     
     while (1) {
-        if (pos_in_line >= l_l_data->capacity || pos_in_real_line >= l_l_data->capacity) {
-            l_l_data->capacity += CAPACITY_INCREMENT;
-            l_l_data->line = xrealloc (l_l_data->line, l_l_data->capacity + 3);
-            l_l_data->real_line = xrealloc (l_l_data->real_line, l_l_data->capacity + 5);
+        
+        l_l_data->size += fread (l_l_data->data + l_l_data->size, 1, capacity - l_l_data->size, input_file);
+        
+        if (ferror (input_file)) {
+            /* Error while reading. */
+            return 2;
+        }
+        
+        if (l_l_data->size < capacity) {
+            break;
         }
         
-        if (pos_in_real_line >= l_l_data->read_size) {
-            l_l_data->read_size = fread (l_l_data->real_line + pos_in_real_line,
-                                         1,
-                                         l_l_data->capacity - pos_in_real_line,
-                                         input_file) + pos_in_real_line;
+        capacity *= 2;
+        l_l_data->data = xrealloc (l_l_data->data, capacity + 1);
+    
+    }
+    
+    return 0;
+}
+
+/**
+ * Finds the end of the real line if it can be used without any changes.
+ * Returns 0 if the line has to be copied.
+ */
+static int find_end_of_clean_line (struct load_line_data *l_l_data, size_t *end_p, unsigned long *newlines_p, int *tabs_p)
+{
+    const char *p = l_l_data->data + l_l_data->pos;
+    const char *end = l_l_data->data + l_l_data->size;
+    
+    unsigned long newlines = 0;
+    int in_quote = 0, in_escape = 0;
+    
+    *tabs_p = 0;
+    
+    for (; p < end; p++) {
+        
+        if (in_quote) {
+            
+            if (in_escape) {
+                in_escape = 0;
+            } else if (*p == '\"') {
+                in_quote = 0;
+            } else if (*p == '\\') {
+                in_escape = 1;
+            }
             
-            if (ferror (input_file)) {
-                /* Error while reading. */
-                return 2;
+            if (*p == '\n') {
+                newlines++;
             }
             
-            l_l_data->real_line[l_l_data->read_size] = '\0';
+            continue;
+        
         }
-    
-    copying:
-        if (in_block_comment) {
-            while (pos_in_real_line < l_l_data->read_size) {
-                if (possible_start_or_end_of_comment && l_l_data->real_line[pos_in_real_line] == '/') {              
-                    possible_start_or_end_of_comment = 0;
-                    pos_in_real_line++;
-                    
-                    in_block_comment = 0;
-                    break;                
+        
+        switch (*p) {
+            
+            case '\n':
+                
+                /* The '\0' after the line must still be inside the input. */
+                if (p + 1 == end) {
+                    return 0;
                 }
                 
-                possible_start_or_end_of_comment = 0;
+                *end_p = p - l_l_data->data;
+                *newlines_p = newlines;
+                return 1;
+            
+            case '\t':
+                
+                *tabs_p = 1;
+                /* fall through */
+            
+            case ' ':
                 
-                if (l_l_data->real_line[pos_in_real_line] == '*') {
-                    possible_start_or_end_of_comment = 1;
+                if (p + 1 < end && (p[1] == ' ' || p[1] == '\t')) {
+                    return 0;
                 }
                 
-                if (l_l_data->real_line[pos_in_real_line] == '\n') {
-                    newlines++;
+                break;
+            
+            case '/':
+                
+                if (p + 1 < end && p[1] == '*') {
+                    return 0;
                 }
                 
-                pos_in_real_line++;            
-            }        
+                break;
+            
+            case '\r':
+            case '#':
+                
+                return 0;
+            
+            case '\"':
+                
+                in_quote = 1;
+                break;
+            
+            default:
+                
+                break;
+        
         }
+    
+    }
+    
+    return 0;
+}
+
+/* Tabs outside of strings become spaces, as when the line is copied. */
+static void replace_tabs (char *p, char *end)
+{
+    int in_quote = 0, in_escape = 0;
+    
+    for (; p < end; p++) {
         
-        if (in_line_comment) {
-            while (pos_in_real_line < l_l_data->read_size) {
-                if (l_l_data->real_line[pos_in_real_line] == '\n') {
-                    in_line_comment = 0;
-                    break;
-                }
-                
-                pos_in_real_line++;
+        if (in_quote) {
+            
+            if (in_escape) {
+                in_escape = 0;
+            } else if (*p == '\"') {
+                in_quote = 0;
+            } else if (*p == '\\') {
+                in_escape = 1;
             }
+        
+        } else if (*p == '\"') {
+            in_quote = 1;
+        } else if (*p == '\t') {
+            *p = ' ';
         }
+    
+    }
+}
+
+int load_line (char **line_p, char **line_end_p, char **real_line_p, size_t *real_line_len_p,
+               unsigned long *newlines_p, FILE *input_file,
+               void **load_line_internal_data_p)
+{
+    struct load_line_data *l_l_data;
+    size_t pos_in_line = 0, pos_in_real_line, end_of_line;
+    
+    const char *real_line;
+    size_t real_line_size;
+    
+    unsigned long newlines = 0;
+    
+    int in_block_comment = 0, in_line_comment = 0, skipping_spaces = 0, in_escape = 0, in_quote = 0;
+    int possible_start_or_end_of_comment = 0;
+    int tabs;
+    
+    l_l_data = *load_line_internal_data_p;
+    
+    if (l_l_data->saved_char_p) {
         
-        if (skipping_spaces) {
-            while (pos_in_real_line < l_l_data->read_size) {
-                if (l_l_data->real_line[pos_in_real_line] != ' '
-                    && l_l_data->real_line[pos_in_real_line] != '\t') {
-                    skipping_spaces = 0;
-                    break;
-                }
-                
-                pos_in_real_line++;
-            }
+        *(l_l_data->saved_char_p) = l_l_data->saved_char;
+        l_l_data->saved_char_p = NULL;
+    
+    }
+    
+    if (!l_l_data->loaded) {
+        
+        l_l_data->loaded = 1;
+        
+        if (load_whole_file (l_l_data, input_file)) {
+            return 2;
         }
+    
+    }
+    
+    if (l_l_data->pos >= l_l_data->size) {
+        return 1;
+    }
+    
+    if (find_end_of_clean_line (l_l_data, &end_of_line, &newlines, &tabs)) {
+        
+        *real_line_p = l_l_data->data + l_l_data->pos;
+        *real_line_len_p = end_of_line + 1 - l_l_data->pos;
         
-        while (pos_in_real_line < l_l_data->read_size && pos_in_line < l_l_data->capacity) {
-            l_l_data->line[pos_in_line] = l_l_data->real_line[pos_in_real_line++];
+        if (tabs) {
             
-            if (in_quote) {
-                if (in_escape) {
-                    in_escape = 0;
-                } else if (l_l_data->line[pos_in_line] == '\"') {
-                    in_quote = 0;
-                } else if (l_l_data->line[pos_in_line] == '\\') {
-                    in_escape = 1;
-                }
+            /* The listing shows the line as it was written. */
+            if (state->generate_listing) {
                 
-                if (l_l_data->line[pos_in_line] == '\n') {
-                    newlines++;
-                }
-            } else {
-                if (possible_start_or_end_of_comment && l_l_data->line[pos_in_line] == '*') {
-                    possible_start_or_end_of_comment = 0;
-                    l_l_data->line[pos_in_line - 1] = ' ';
+                if (l_l_data->real_line_capacity < *real_line_len_p) {
                     
-                    in_block_comment = 1;
-                    goto copying;
-                }
+                    l_l_data->real_line_capacity = *real_line_len_p + 5;
+                    l_l_data->real_line = xrealloc (l_l_data->real_line, l_l_data->real_line_capacity);
                 
-                possible_start_or_end_of_comment = 0;
-                
-                if (l_l_data->line[pos_in_line] == ' ' || l_l_data->line[pos_in_line] == '\t') {
-                    l_l_data->line[pos_in_line++] = ' ';
-                    
-                    skipping_spaces = 1;
-                    goto copying;
-                } else if (l_l_data->line[pos_in_line] == '\n') {
-                    /* Checks for a carriage return before the line feed and if present, removes it. */
-                    if (pos_in_line > 0 && l_l_data->line[pos_in_line - 1] == '\r') {
-                        l_l_data->line[--pos_in_line] = '\n';
-                    }
-                    
-                    /* Done reading a line. */
-                    l_l_data->line[pos_in_line + 1] = '\0';
-                    l_l_data->end_of_prev_real_line = pos_in_real_line;
-                    
-                    *line_p = l_l_data->line;
-                    *line_end_p = l_l_data->line + pos_in_line;
-                    *real_line_p = l_l_data->real_line;
-                    *real_line_len_p = pos_in_real_line;
-                    *newlines_p = newlines;
-                    
-                    return 0;
-                } else if (l_l_data->line[pos_in_line] == '#') {
-                    in_line_comment = 1;
-                    goto copying;
-                } else if (l_l_data->line[pos_in_line] == '\"') {
-                    in_quote = 1;
-                } else if (l_l_data->line[pos_in_line] == '/') {
-                    possible_start_or_end_of_comment = 1;
                 }
+                
+                memcpy (l_l_data->real_line, *real_line_p, *real_line_len_p);
+                *real_line_p = l_l_data->real_line;
+            
             }
             
-            pos_in_line++;
+            replace_tabs (l_l_data->data + l_l_data->pos, l_l_data->data + end_of_line);
+        
         }
         
-        if (feof (input_file)) {
-            const char *filename;
-            unsigned long line_number;
-            
-            if (l_l_data->read_size == 0) return 1;
+        l_l_data->saved_char_p = l_l_data->data + end_of_line + 1;
+        l_l_data->saved_char = *(l_l_data->saved_char_p);
+        *(l_l_data->saved_char_p) = '\0';
+        
+        *line_p = l_l_data->data + l_l_data->pos;
+        *line_end_p = l_l_data->data + end_of_line;
+        *newlines_p = newlines;
+        
+        l_l_data->pos = end_of_line + 1;
+        return 0;
+    
+    }
+    
+    real_line = l_l_data->data + l_l_data->pos;
+    real_line_size = l_l_data->size - l_l_data->pos;
+    
+    pos_in_real_line = 0;
 
-            strcpy (l_l_data->real_line + pos_in_real_line, "...\n");
-            pos_in_real_line += 4;
+copying:
+    if (in_block_comment) {
+        while (pos_in_real_line < real_line_size) {
+            if (possible_start_or_end_of_comment && real_line[pos_in_real_line] == '/') {
+                possible_start_or_end_of_comment = 0;
+                pos_in_real_line++;
+                
+                in_block_comment = 0;
+                break;
+            }
             
-            if (in_quote) {
-                l_l_data->line[pos_in_line] = '"';
-                l_l_data->line[pos_in_line + 1] = '\n';
-                l_l_data->line[pos_in_line + 2] = '\0';
-            } else {
-                l_l_data->line[pos_in_line] = '\n';
-                l_l_data->line[pos_in_line + 1] = '\0';
+            possible_start_or_end_of_comment = 0;
+            
+            if (real_line[pos_in_real_line] == '*') {
+                possible_start_or_end_of_comment = 1;
             }
             
-            get_filename_and_line_number (&filename, &line_number);
+            if (real_line[pos_in_real_line] == '\n') {
+                newlines++;
+            }
             
-            /**
-             * The line number obtained might not be correct as it has yet to be updated, so it not used.
-             * If new_line_number_p is provided, the correct line number is obtained using it.
-             */
-            if (l_l_data->new_line_number_p) {
-                line_number = *(l_l_data->new_line_number_p);
-            } else {
-                line_number = 0;
+            pos_in_real_line++;
+        }
+    }
+    
+    if (in_line_comment) {
+        while (pos_in_real_line < real_line_size) {
+            if (real_line[pos_in_real_line] == '\n') {
+                in_line_comment = 0;
+                break;
             }
             
-            if (in_quote) {
-                as_warn_at (filename, line_number, "end of file in string; '\"' inserted");
-            } else if (in_block_comment) {
-                as_warn_at (filename, line_number, "end of file in comment");
-            } else {
-                as_warn_at (filename, line_number, "end of file not at end of line; newline inserted");
+            pos_in_real_line++;
+        }
+    }
+    
+    if (skipping_spaces) {
+        while (pos_in_real_line < real_line_size) {
+            if (real_line[pos_in_real_line] != ' '
+                && real_line[pos_in_real_line] != '\t') {
+                skipping_spaces = 0;
+                break;
+            }
+            
+            pos_in_real_line++;
+        }
+    }
+    
+    while (pos_in_real_line < real_line_size) {
+        /* Space for '\"', '\n' and '\0' added at the end of file is kept as well. */
+        if (pos_in_line + 3 >= l_l_data->line_capacity) {
+            l_l_data->line_capacity = (l_l_data->line_capacity < CAPACITY_INITIAL) ? CAPACITY_INITIAL : l_l_data->line_capacity * 2;
+            l_l_data->line = xrealloc (l_l_data->line, l_l_data->line_capacity);
+        }
+        
+        l_l_data->line[pos_in_line] = real_line[pos_in_real_line++];
+        
+        if (in_quote) {
+            if (in_escape) {
+                in_escape = 0;
+            } else if (l_l_data->line[pos_in_line] == '\"') {
+                in_quote = 0;
+            } else if (l_l_data->line[pos_in_line] == '\\') {
+                in_escape = 1;
             }
             
-            l_l_data->end_of_prev_real_line = l_l_data->read_size = 0;
+            if (l_l_data->line[pos_in_line] == '\n') {
+                newlines++;
+            }
+        } else {
+            if (possible_start_or_end_of_comment && l_l_data->line[pos_in_line] == '*') {
+                possible_start_or_end_of_comment = 0;
+                l_l_data->line[pos_in_line - 1] = ' ';
+                
+                in_block_comment = 1;
+                goto copying;
+            }
             
-            *line_p = l_l_data->line;
-            *line_end_p = l_l_data->line + pos_in_line;
-            *real_line_p = l_l_data->real_line;
-            *real_line_len_p = pos_in_real_line;
-            *newlines_p = newlines;
+            possible_start_or_end_of_comment = 0;
             
-            return 0;
+            if (l_l_data->line[pos_in_line] == ' ' || l_l_data->line[pos_in_line] == '\t') {
+                l_l_data->line[pos_in_line++] = ' ';
+                
+                skipping_spaces = 1;
+                goto copying;
+            } else if (l_l_data->line[pos_in_line] == '\n') {
+                /* Checks for a carriage return before the line feed and if present, removes it. */
+                if (pos_in_line > 0 && l_l_data->line[pos_in_line - 1] == '\r') {
+                    l_l_data->line[--pos_in_line] = '\n';
+                }
+                
+                /* Done reading a line. */
+                l_l_data->line[pos_in_line + 1] = '\0';
+                
+                *line_p = l_l_data->line;
+                *line_end_p = l_l_data->line + pos_in_line;
+                *real_line_p = l_l_data->data + l_l_data->pos;
+                *real_line_len_p = pos_in_real_line;
+                *newlines_p = newlines;
+                
+                l_l_data->pos += pos_in_real_line;
+                return 0;
+            } else if (l_l_data->line[pos_in_line] == '#') {
+                in_line_comment = 1;
+                goto copying;
+            } else if (l_l_data->line[pos_in_line] == '\"') {
+                in_quote = 1;
+            } else if (l_l_data->line[pos_in_line] == '/') {
+                possible_start_or_end_of_comment = 1;
+            }
         }
+        
+        pos_in_line++;
+    }
+    
+    {
+        const char *filename;
+        unsigned long line_number;
+        
+        if (l_l_data->real_line_capacity < real_line_size + 5) {
+            
+            l_l_data->real_line_capacity = real_line_size + 5;
+            l_l_data->real_line = xrealloc (l_l_data->real_line, l_l_data->real_line_capacity);
+        
+        }
+        
+        memcpy (l_l_data->real_line, real_line, real_line_size);
+        strcpy (l_l_data->real_line + real_line_size, "...\n");
+        
+        if (in_quote) {
+            l_l_data->line[pos_in_line] = '"';
+            l_l_data->line[pos_in_line + 1] = '\n';
+            l_l_data->line[pos_in_line + 2] = '\0';
+        } else {
+            l_l_data->line[pos_in_line] = '\n';
+            l_l_data->line[pos_in_line + 1] = '\0';
+        }
+        
+        get_filename_and_line_number (&filename, &line_number);
+        
+        /**
+         * The line number obtained might not be correct as it has yet to be updated, so it not used.
+         * If new_line_number_p is provided, the correct line number is obtained using it.
+         */
+        if (l_l_data->new_line_number_p) {
+            line_number = *(l_l_data->new_line_number_p);
+        } else {
+            line_number = 0;
+        }
+        
+        if (in_quote) {
+            as_warn_at (filename, line_number, "end of file in string; '\"' inserted");
+        } else if (in_block_comment) {
+            as_warn_at (filename, line_number, "end of file in comment");
+        } else {
+            as_warn_at (filename, line_number, "end of file not at end of line; newline inserted");
+        }
+        
+        l_l_data->pos = l_l_data->size;
+        
+        *line_p = l_l_data->line;
+        *line_end_p = l_l_data->line + pos_in_line;
+        *real_line_p = l_l_data->real_line;
+        *real_line_len_p = real_line_size + 4;
+        *newlines_p = newlines;
+        
+        return 0;
     }
 }
 
@@ -239,13 +486,7 @@ void *load_line_create_internal_data (unsigned long *new_line_number_p)
     struct load_line_data *l_l_data;
     
     l_l_data = xmalloc (sizeof (*l_l_data));
-    
-    l_l_data->capacity = 0;
-    l_l_data->line = NULL;
-    l_l_data->real_line = NULL;
-    
-    l_l_data->read_size = 0;
-    l_l_data->end_of_prev_real_line = 0;
+    memset (l_l_data, 0, sizeof (*l_l_data));
     
     l_l_data->new_line_number_p = new_line_number_p;
     return l_l_data;
@@ -255,8 +496,18 @@ void load_line_destroy_internal_data (void *load_line_internal_data)
 {
     if (load_line_internal_data) {
         struct load_line_data *l_l_data;
-    
+        
         l_l_data = load_line_internal_data;
+
+#if     defined (LOAD_LINE_USE_MMAP)
+        if (l_l_data->mapped) {
+            munmap (l_l_data->data, l_l_data->size);
+        } else {
+            free (l_l_data->data);
+        }
+#else
+        free (l_l_data->data);
+#endif
         
         free (l_l_data->line);
         free (l_l_data->real_line);
@@ -1212,6 +1212,8 @@ int process (const char *fname)
         line_number = new_line_number;
         new_line_number += newlines + 1;
         
+        as_statistics.lines += newlines + 1;
+        
         if (state->generate_listing) {
             update_listing_line (current_frag);
             add_listing_line (real_line, real_line_len, filename, line_number);
@@ -1281,6 +1283,7 @@ int process (const char *fname)
                 *line = '\0';
                 
                 machine_dependent_assemble_line (skip_whitespace (start_p));
+                as_statistics.instructions++;
                 
                 *(line++) = saved_c;
                 
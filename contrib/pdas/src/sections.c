@@ -266,13 +266,8 @@ void sections_destroy (void)
         
         for (frag_chain = section->frag_chain; frag_chain; frag_chain = next_frag_chain) {
             if (!frags_chained || frag_chain == section->frag_chain) {
-                struct frag *frag, *next_frag;
                 struct fixup *fixup, *next_fixup;
 
-                for (frag = frag_chain->first_frag; frag; frag = next_frag) {
-                    next_frag = frag->next;
-                    frag_destroy (frag);
-                }
                 for (fixup = frag_chain->first_fixup; fixup; fixup = next_fixup) {
                     next_fixup = fixup->next;
                     free (fixup);
@@ -288,6 +283,9 @@ void sections_destroy (void)
         free (section->name);
         free (section);
     }
+    
+    /* Frags are not freed one by one, they all live in the frag arena. */
+    frags_destroy ();
 }
 
 void section_set_object_format_dependent_data (section_t section, void *data) {
@@ -13,16 +13,51 @@
 #include <stdlib.h>
 
 #include "as.h"
+#include "hashtab.h"
 
 static struct symbol **pointer_to_pointer_to_next_symbol = &symbols;
 static struct symbol *symbols_to_free = NULL;
 
+/* Indexes the symbols in the chain by name,
+ * the chain itself keeps the order for the output writers. */
+static struct hashtab *symbols_hashtab = NULL;
+
 struct symbol *symbols = NULL;
 int finalize_symbols = 0;
 
+static hash_value_t hash_symbol (const void *p) {
+
+    const struct symbol *symbol = (const struct symbol *) p;
+    return hashtab_help_default_hash_string (symbol->name);
+
+}
+
+static int equal_symbols (const void *p1, const void *p2) {
+
+    const struct symbol *symbol1 = (const struct symbol *) p1;
+    const struct symbol *symbol2 = (const struct symbol *) p2;
+    
+    return strcmp (symbol1->name, symbol2->name) == 0;
+
+}
+
+void symbols_init (void)
+{
+    symbols_hashtab = hashtab_create_hashtab (0, hash_symbol, equal_symbols, &xmalloc, &free);
+    
+    if (symbols_hashtab == NULL) {
+        as_internal_error_at_source_at (__FILE__, __LINE__, NULL, 0, "error creating symbols_hashtab");
+    }
+}
+
 void symbols_destroy (void)
 {
     struct symbol *symbol, *next_symbol;
+    
+    if (symbols_hashtab) {
+        hashtab_destroy_hashtab (symbols_hashtab);
+        symbols_hashtab = NULL;
+    }
 
     for (symbol = symbols_to_free; symbol; symbol = next_symbol) {
         next_symbol = symbol->next_to_free;
@@ -60,10 +95,11 @@ struct symbol *symbol_create (const char *name, section_t section, unsigned long
 
 struct symbol *symbol_find (const char *name) {
 
-    struct symbol *symbol;
+    struct symbol fake;
+    fake.name = (char *) name;
     
-    for (symbol = symbols; symbol && strcmp (symbol->name, name); symbol = symbol->next);
-    return symbol;
+    as_statistics.symbol_lookups++;
+    return (struct symbol *) hashtab_find (symbols_hashtab, &fake);
 
 }
 
@@ -776,6 +812,12 @@ void symbol_add_to_chain (struct symbol *symbol) {
 
     *pointer_to_pointer_to_next_symbol = symbol;
     pointer_to_pointer_to_next_symbol = &symbol->next;
+    
+    /* The first symbol with a given name in the chain is the one found,
+     * so a duplicate name (section symbol and label) is not an error. */
+    if (hashtab_insert (symbols_hashtab, symbol) && hashtab_find (symbols_hashtab, symbol) == NULL) {
+        as_internal_error_at_source_at (__FILE__, __LINE__, NULL, 0, "error inserting '%s' into symbols_hashtab", symbol->name);
+    }
 
 }
 
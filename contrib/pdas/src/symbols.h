@@ -39,6 +39,7 @@ struct symbol {
 extern struct symbol *symbols;
 extern int finalize_symbols;
 
+void symbols_init (void);
 void symbols_destroy (void);
 
 struct expr *symbol_get_value_expression (struct symbol *symbol);
@@ -9,6 +9,8 @@
  * complying with any conditions and by any means.
  *****************************************************************************/
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "as.h"
 #include "cfi.h"
@@ -36,6 +38,8 @@ static struct fixup *fixup_new_internal (struct frag *frag,
     fixup->reloc_type   = reloc_type;
     fixup->next         = NULL;
     
+    as_statistics.fixups++;
+    
     if (current_frag_chain->last_fixup) {
         current_frag_chain->last_fixup->next = fixup;
         current_frag_chain->last_fixup = fixup;
@@ -57,11 +61,378 @@ static unsigned long relax_align (unsigned long address, unsigned long alignment
 
 }
 
+/**
+ * Jump frags of a section relaxed with the worklist.
+ * A jump has to be re-examined only when a frag inside [low, high) grows,
+ * where low and high are the indexes of the jump frag and of its target frag.
+ */
+struct relax_jump {
+
+    struct frag *frag;
+    struct frag *target_frag;
+    
+    unsigned long low, high;
+    unsigned long max_high;
+    
+    int queued;
+
+};
+
+struct relax_worklist {
+
+    struct relax_jump *jumps;
+    unsigned long *stack;
+    unsigned long stack_count;
+    
+    /* Addresses before the relaxation and a Fenwick tree of frag growths,
+     * current addresses are computed from them without a rescan. */
+    unsigned long *base_addresses;
+    offset_t *growths;
+    offset_t *growth_tree;
+    unsigned long frag_count;
+
+};
+
+static void growth_tree_add (struct relax_worklist *worklist, unsigned long index, offset_t growth)
+{
+    worklist->growths[index] += growth;
+    
+    for (index++; index <= worklist->frag_count; index += index & (~index + 1)) {
+        worklist->growth_tree[index] += growth;
+    }
+}
+
+/* Returns the sum of growths of all frags before the frag with the given index. */
+static offset_t growth_tree_prefix (struct relax_worklist *worklist, unsigned long index)
+{
+    offset_t sum = 0;
+    
+    for (; index; index -= index & (~index + 1)) {
+        sum += worklist->growth_tree[index];
+    }
+    
+    return sum;
+}
+
+static unsigned long relax_current_address (struct relax_worklist *worklist, struct frag *frag)
+{
+    return worklist->base_addresses[frag->relax_index] + growth_tree_prefix (worklist, frag->relax_index);
+}
+
+/* Returns the growth of the jump frag. */
+static offset_t relax_jump (struct relax_worklist *worklist, section_t section, struct relax_jump *jump)
+{
+    offset_t growth;
+    
+    jump->frag->address = relax_current_address (worklist, jump->frag);
+    jump->target_frag->address = relax_current_address (worklist, jump->target_frag);
+    
+    /* Both addresses are current, so no change needs to be applied to the target. */
+    if ((growth = machine_dependent_relax_frag (jump->frag, section, 0))) {
+        growth_tree_add (worklist, jump->frag->relax_index, growth);
+    }
+    
+    return growth;
+}
+
+/* Jumps are sorted by low, each middle element keeps the maximal high of its subrange. */
+static unsigned long relax_jumps_build (struct relax_jump *jumps, unsigned long start, unsigned long end)
+{
+    unsigned long middle, max_high, high;
+    
+    if (start >= end) {
+        return 0;
+    }
+    
+    middle = start + (end - start) / 2;
+    max_high = jumps[middle].high;
+    
+    if ((high = relax_jumps_build (jumps, start, middle)) > max_high) {
+        max_high = high;
+    }
+    
+    if ((high = relax_jumps_build (jumps, middle + 1, end)) > max_high) {
+        max_high = high;
+    }
+    
+    jumps[middle].max_high = max_high;
+    return max_high;
+}
+
+static unsigned long relax_jumps_max_high (struct relax_jump *jumps, unsigned long start, unsigned long end)
+{
+    return (start < end) ? jumps[start + (end - start) / 2].max_high : 0;
+}
+
+/* Removes a jump that cannot grow anymore, it never needs to be queued again. */
+static void relax_jumps_remove (struct relax_jump *jumps, unsigned long start, unsigned long end, unsigned long position)
+{
+    unsigned long middle = start + (end - start) / 2;
+    unsigned long max_high, high;
+    
+    if (position < middle) {
+        relax_jumps_remove (jumps, start, middle, position);
+    } else if (position > middle) {
+        relax_jumps_remove (jumps, middle + 1, end, position);
+    } else {
+        jumps[middle].high = jumps[middle].low;
+    }
+    
+    max_high = jumps[middle].high;
+    
+    if ((high = relax_jumps_max_high (jumps, start, middle)) > max_high) {
+        max_high = high;
+    }
+    
+    if ((high = relax_jumps_max_high (jumps, middle + 1, end)) > max_high) {
+        max_high = high;
+    }
+    
+    jumps[middle].max_high = max_high;
+}
+
+/* Queues all jumps whose [low, high) contains the index of the grown frag. */
+static void relax_jumps_queue_containing (struct relax_worklist *worklist, unsigned long start, unsigned long end, unsigned long index)
+{
+    while (start < end) {
+    
+        unsigned long middle = start + (end - start) / 2;
+        struct relax_jump *jump = &worklist->jumps[middle];
+        
+        if (jump->max_high <= index) {
+            return;
+        }
+        
+        if (jump->low > index) {
+        
+            end = middle;
+            continue;
+        
+        }
+        
+        if (jump->high > index && !jump->queued) {
+        
+            jump->queued = 1;
+            worklist->stack[worklist->stack_count++] = middle;
+        
+        }
+        
+        relax_jumps_queue_containing (worklist, start, middle, index);
+        start = middle + 1;
+    
+    }
+}
+
+/**
+ * Relaxes a section containing only jump frags with plain labels as targets.
+ * The jump growth is monotonic then and the result is the least fixed point,
+ * the same one the pass based relaxation reaches, so only the jumps
+ * affected by a growth need to be relaxed again.
+ *
+ * Returns 0 without changing anything if the section cannot be relaxed this way.
+ * Otherwise stores the number of jumps taken off the worklist in *iterations_p.
+ */
+static int relax_section_with_worklist (section_t section, struct frag *root_frag, unsigned long frag_count, unsigned long *iterations_p)
+{
+    struct relax_worklist worklist;
+    struct frag *frag, **frags;
+    
+    unsigned long *low_counts, *grown_indexes;
+    unsigned long i, position, active_count, grown_count, jump_count = 0;
+    offset_t change;
+    
+    for (frag = root_frag; frag; frag = frag->next) {
+    
+        struct symbol *symbol = frag->symbol;
+        
+        if (frag->relax_type == RELAX_TYPE_NONE_NEEDED) {
+            continue;
+        }
+        
+        if (frag->relax_type != RELAX_TYPE_MACHINE_DEPENDENT
+            || symbol == NULL
+            || frag->offset != 0
+            || symbol->value.type != EXPR_TYPE_CONSTANT
+            || symbol_get_section (symbol) != section
+            || symbol->frag->relax_index >= frag_count
+            || symbol->value.add_number > symbol->frag->fixed_size) {
+            return 0;
+        }
+        
+        jump_count++;
+    
+    }
+    
+    if (jump_count == 0) {
+        return 0;
+    }
+    
+    frags = xmalloc (sizeof (*frags) * frag_count);
+    
+    for (i = 0, frag = root_frag; frag; i++, frag = frag->next) {
+        frags[i] = frag;
+    }
+    
+    /* Symbols from a frag that is not in this section chain (zero_address_frag) cannot be handled. */
+    for (frag = root_frag; frag; frag = frag->next) {
+    
+        if (frag->relax_type == RELAX_TYPE_MACHINE_DEPENDENT
+            && frags[frag->symbol->frag->relax_index] != frag->symbol->frag) {
+        
+            free (frags);
+            return 0;
+        
+        }
+    
+    }
+    
+    low_counts = xmalloc (sizeof (*low_counts) * (frag_count + 1));
+    
+    memset (low_counts, 0, sizeof (*low_counts) * (frag_count + 1));
+    
+    worklist.jumps = xmalloc (sizeof (*worklist.jumps) * jump_count);
+    worklist.stack = xmalloc (sizeof (*worklist.stack) * jump_count);
+    worklist.stack_count = 0;
+    worklist.base_addresses = xmalloc (sizeof (*worklist.base_addresses) * frag_count);
+    worklist.growths = xmalloc (sizeof (*worklist.growths) * frag_count);
+    worklist.growth_tree = xmalloc (sizeof (*worklist.growth_tree) * (frag_count + 1));
+    worklist.frag_count = frag_count;
+    
+    grown_indexes = xmalloc (sizeof (*grown_indexes) * jump_count);
+    
+    memset (worklist.growths, 0, sizeof (*worklist.growths) * frag_count);
+    memset (worklist.growth_tree, 0, sizeof (*worklist.growth_tree) * (frag_count + 1));
+    
+    for (i = 0; i < frag_count; i++) {
+    
+        worklist.base_addresses[i] = frags[i]->address;
+        
+        if (frags[i]->relax_type == RELAX_TYPE_MACHINE_DEPENDENT) {
+        
+            unsigned long target_index = frags[i]->symbol->frag->relax_index;
+            low_counts[(i < target_index) ? i : target_index]++;
+        
+        }
+    
+    }
+    
+    /* Counting sort of the jumps by low. */
+    for (i = 0, position = 0; i <= frag_count; i++) {
+    
+        unsigned long count = low_counts[i];
+        
+        low_counts[i] = position;
+        position += count;
+    
+    }
+    
+    for (i = 0; i < frag_count; i++) {
+    
+        if (frags[i]->relax_type == RELAX_TYPE_MACHINE_DEPENDENT) {
+        
+            unsigned long target_index = frags[i]->symbol->frag->relax_index;
+            unsigned long low = (i < target_index) ? i : target_index;
+            struct relax_jump *jump = &worklist.jumps[low_counts[low]++];
+            
+            jump->frag        = frags[i];
+            jump->target_frag = frags[target_index];
+            jump->low         = low;
+            jump->high        = (i < target_index) ? target_index : i;
+            jump->queued      = 0;
+        
+        }
+    
+    }
+    
+    /* The first sweep is an ordinary relaxation pass over the frags,
+     * only the jumps affected by growths after they were relaxed are queued.
+     * Jumps that cannot grow anymore (usually the long ones) are left out. */
+    for (i = 0, change = 0, grown_count = 0; i < frag_count; i++) {
+    
+        frag = frags[i];
+        frag->address = worklist.base_addresses[i] + change;
+        
+        if (frag->relax_type == RELAX_TYPE_MACHINE_DEPENDENT) {
+        
+            struct frag *target_frag = frag->symbol->frag;
+            offset_t growth;
+            
+            if (target_frag->relax_index > i) {
+                target_frag->address = worklist.base_addresses[target_frag->relax_index] + change;
+            }
+            
+            if ((growth = machine_dependent_relax_frag (frag, section, 0))) {
+            
+                change += growth;
+                
+                growth_tree_add (&worklist, i, growth);
+                grown_indexes[grown_count++] = i;
+            
+            }
+        
+        }
+    
+    }
+    
+    for (i = 0, active_count = 0; i < jump_count; i++) {
+    
+        if (!machine_dependent_relax_frag_is_final (worklist.jumps[i].frag)) {
+            worklist.jumps[active_count++] = worklist.jumps[i];
+        }
+    
+    }
+    
+    relax_jumps_build (worklist.jumps, 0, active_count);
+    
+    for (i = 0; i < grown_count; i++) {
+        relax_jumps_queue_containing (&worklist, 0, active_count, grown_indexes[i]);
+    }
+    
+    *iterations_p = 0;
+    
+    while (worklist.stack_count) {
+    
+        unsigned long jump_index = worklist.stack[--worklist.stack_count];
+        struct relax_jump *jump = &worklist.jumps[jump_index];
+        
+        jump->queued = 0;
+        (*iterations_p)++;
+        
+        if (relax_jump (&worklist, section, jump)) {
+            relax_jumps_queue_containing (&worklist, 0, active_count, jump->frag->relax_index);
+        }
+        
+        if (jump->high != jump->low && machine_dependent_relax_frag_is_final (jump->frag)) {
+            relax_jumps_remove (worklist.jumps, 0, active_count, jump_index);
+        }
+    
+    }
+    
+    for (i = 0, change = 0; i < frag_count; i++) {
+    
+        frags[i]->address = worklist.base_addresses[i] + change;
+        change += worklist.growths[i];
+    
+    }
+    
+    free (worklist.growth_tree);
+    free (worklist.growths);
+    free (worklist.stack);
+    free (worklist.jumps);
+    free (worklist.base_addresses);
+    free (grown_indexes);
+    free (low_counts);
+    free (frags);
+    
+    return 1;
+}
+
 static void relax_section (section_t section)
 {
     struct frag *root_frag, *frag;
     unsigned long address, frag_count, max_iterations;
     unsigned long alignment_needed;
+    unsigned long passes = 0;
     
     int changed;
     
@@ -73,6 +444,7 @@ static void relax_section (section_t section)
     for (frag_count = 0, frag = root_frag; frag; frag_count++, frag = frag->next) {
     
         frag->relax_marker  = 0;
+        frag->relax_index   = frag_count;
         frag->address       = address;
         
         address += frag->fixed_size;
@@ -120,6 +492,11 @@ static void relax_section (section_t section)
     
     }
     
+    if (relax_section_with_worklist (section, root_frag, frag_count, &passes)) {
+        as_statistics_add_relax_passes (section_get_name (section), passes, 1);
+        return;
+    }
+    
     /**
      * Prevents an infinite loop caused by frag growing because of a symbol that moves when the frag grows.
      *
@@ -138,6 +515,7 @@ static void relax_section (section_t section)
     do {
         long change = 0;
         changed = 0;
+        passes++;
         
         for (frag = root_frag; frag; frag = frag->next) {
         
@@ -262,6 +640,8 @@ static void relax_section (section_t section)
     
     } while (changed && --max_iterations);
     
+    as_statistics_add_relax_passes (section_get_name (section), passes, 0);
+    
     if (changed) {
         as_fatal_error_at (NULL, 0,
                            "Infinite loop encountered whilst attempting to compute the addresses in section %s",
@@ -533,10 +913,14 @@ void write_object_file (void) {
     
     sections_chain_subsection_frags ();
     
+    as_phase_start (AS_PHASE_RELAX);
+    
     for (section = sections; section; section = section_get_next_section (section)) {
         relax_section (section);
     }
     
+    as_phase_end (AS_PHASE_RELAX);
+    
     for (section = sections; section; section = section_get_next_section (section)) {
         finish_frags_after_relaxation (section);
     }
@@ -581,10 +965,15 @@ void write_object_file (void) {
         adjust_reloc_symbols_of_section (section);
     }
     
+    as_phase_start (AS_PHASE_FIXUP);
+    
     for (section = sections; section; section = section_get_next_section (section)) {
         fixup_section (section);
     }
     
+    as_phase_end (AS_PHASE_FIXUP);
+    as_phase_start (AS_PHASE_WRITE);
+    
     if (state->format == AS_FORMAT_A_OUT) {
         write_a_out_file ();
     } else if (state->format == AS_FORMAT_COFF) {
@@ -592,5 +981,7 @@ void write_object_file (void) {
     } else if (state->format == AS_FORMAT_ELF) {
         write_elf_file ();
     }
+    
+    as_phase_end (AS_PHASE_WRITE);
 
 }
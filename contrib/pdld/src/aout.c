@@ -261,9 +261,9 @@ static int read_aout_object (unsigned char *file, size_t file_size, const char *
     
     part = section_part_new (section, of);
     part->content_size = exec.a_text;
-    part->content = xmalloc (part->content_size);
     CHECK_READ (pos, part->content_size);
-    memcpy (part->content, pos, part->content_size);
+    part->content = pos;
+    part->content_is_view = 1;
     pos += part->content_size;
     section_append_section_part (section, part);
     part_p_array[1] = part;
@@ -274,9 +274,9 @@ static int read_aout_object (unsigned char *file, size_t file_size, const char *
     
     part = section_part_new (section, of);
     part->content_size = exec.a_data;
-    part->content = xmalloc (part->content_size);
     CHECK_READ (pos, part->content_size);
-    memcpy (part->content, pos, part->content_size);
+    part->content = pos;
+    part->content_is_view = 1;
     pos += part->content_size;
     section_append_section_part (section, part);
     part_p_array[2] = part;
@@ -416,15 +416,22 @@ static int read_aout_object (unsigned char *file, size_t file_size, const char *
     return 0;
 }
 
-int aout_read (unsigned char *file, size_t file_size, const char *filename)
+int aout_is_object (const unsigned char *file, size_t file_size)
 {
     unsigned long a_info;
-    
-    CHECK_READ (file, 4);
+
+    if (file_size < 4) return 0;
 
     bytearray_read_4_bytes (&a_info, file, LITTLE_ENDIAN);
 
-    if ((a_info & 0xffff) == OMAGIC) {
+    return (a_info & 0xffff) == OMAGIC;
+}
+
+int aout_read (unsigned char *file, size_t file_size, const char *filename)
+{
+    CHECK_READ (file, 4);
+
+    if (aout_is_object (file, file_size)) {
         if (read_aout_object (file, file_size, filename)) return INPUT_FILE_ERROR;
         return INPUT_FILE_FINISHED;
     }
@@ -18,7 +18,7 @@
 #include "aout_bytearray.h"
 
 #define COPY(struct_name, field_name, bytes) \
- bytearray_read_##bytes##_bytes (&struct_name##_internal->field_name, struct_name##_file->field_name, LITTLE_ENDIAN)
+ struct_name##_internal->field_name = BYTEARRAY_READ_##bytes (struct_name##_file->field_name, LITTLE_ENDIAN)
 #define COPY_CHAR_ARRAY(struct_name, field_name) memcpy (struct_name##_internal->field_name, struct_name##_file->field_name, sizeof (struct_name##_file->field_name))
 
 void read_struct_exec (struct exec_internal *exec_internal, const void *memory)
@@ -60,7 +60,7 @@ void read_struct_nlist (struct nlist_internal *nlist_internal, const void *memor
 #undef COPY
 
 #define COPY(struct_name, field_name, bytes) \
- bytearray_write_##bytes##_bytes (struct_name##_file->field_name, struct_name##_internal->field_name, LITTLE_ENDIAN)
+ BYTEARRAY_WRITE_##bytes (struct_name##_file->field_name, struct_name##_internal->field_name, LITTLE_ENDIAN)
 #define COPY_CHAR_ARRAY(struct_name, field_name) memcpy (struct_name##_file->field_name, struct_name##_internal->field_name, sizeof (struct_name##_file->field_name))
 
 void write_struct_exec (void *memory, const struct exec_internal *exec_internal)
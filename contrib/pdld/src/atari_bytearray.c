@@ -18,7 +18,7 @@
 #include "atari_bytearray.h"
 
 #define COPY(struct_name, field_name, bytes) \
- bytearray_read_##bytes##_bytes (&struct_name##_internal->field_name, struct_name##_file->field_name, BIG_ENDIAN)
+ struct_name##_internal->field_name = BYTEARRAY_READ_##bytes (struct_name##_file->field_name, BIG_ENDIAN)
 #define COPY_CHAR_ARRAY(struct_name, field_name) memcpy (struct_name##_internal->field_name, struct_name##_file->field_name, sizeof (struct_name##_file->field_name))
 
 void read_struct_PH (struct PH_internal *PH_internal, const void *memory)
@@ -41,7 +41,7 @@ void read_struct_PH (struct PH_internal *PH_internal, const void *memory)
 #undef COPY
 
 #define COPY(struct_name, field_name, bytes) \
- bytearray_write_##bytes##_bytes (struct_name##_file->field_name, struct_name##_internal->field_name, BIG_ENDIAN)
+ BYTEARRAY_WRITE_##bytes (struct_name##_file->field_name, struct_name##_internal->field_name, BIG_ENDIAN)
 #define COPY_CHAR_ARRAY(struct_name, field_name) memcpy (struct_name##_file->field_name, struct_name##_internal->field_name, sizeof (struct_name##_file->field_name))
 
 void write_struct_PH (void *memory, const struct PH_internal *PH_internal)
@@ -24,3 +24,79 @@ void bytearray_write_1_bytes (unsigned char *dest, unsigned char value, int litt
 void bytearray_write_2_bytes (unsigned char *dest, unsigned short value, int little_endian);
 void bytearray_write_3_bytes (unsigned char *dest, unsigned long value, int little_endian);
 void bytearray_write_4_bytes (unsigned char *dest, unsigned long value, int little_endian);
+
+/* Fixed-width accessors expanded in place for frequently decoded fields.
+ * Arguments are evaluated more than once,
+ * so they must not have side effects. */
+#define BYTEARRAY_READ_1(src, little_endian) (((const unsigned char *) (src))[0])
+
+#define BYTEARRAY_READ_2_LE(src) \
+ ((unsigned short) (((const unsigned char *) (src))[0] \
+                    | ((unsigned short) ((const unsigned char *) (src))[1] << 8)))
+#define BYTEARRAY_READ_2_BE(src) \
+ ((unsigned short) (((const unsigned char *) (src))[1] \
+                    | ((unsigned short) ((const unsigned char *) (src))[0] << 8)))
+
+#define BYTEARRAY_READ_3_LE(src) \
+ ((unsigned long) ((const unsigned char *) (src))[0] \
+  | ((unsigned long) ((const unsigned char *) (src))[1] << 8) \
+  | ((unsigned long) ((const unsigned char *) (src))[2] << 16))
+#define BYTEARRAY_READ_3_BE(src) \
+ ((unsigned long) ((const unsigned char *) (src))[2] \
+  | ((unsigned long) ((const unsigned char *) (src))[1] << 8) \
+  | ((unsigned long) ((const unsigned char *) (src))[0] << 16))
+
+#define BYTEARRAY_READ_4_LE(src) \
+ ((unsigned long) ((const unsigned char *) (src))[0] \
+  | ((unsigned long) ((const unsigned char *) (src))[1] << 8) \
+  | ((unsigned long) ((const unsigned char *) (src))[2] << 16) \
+  | ((unsigned long) ((const unsigned char *) (src))[3] << 24))
+#define BYTEARRAY_READ_4_BE(src) \
+ ((unsigned long) ((const unsigned char *) (src))[3] \
+  | ((unsigned long) ((const unsigned char *) (src))[2] << 8) \
+  | ((unsigned long) ((const unsigned char *) (src))[1] << 16) \
+  | ((unsigned long) ((const unsigned char *) (src))[0] << 24))
+
+#define BYTEARRAY_READ_2(src, little_endian) \
+ ((little_endian) ? BYTEARRAY_READ_2_LE (src) : BYTEARRAY_READ_2_BE (src))
+#define BYTEARRAY_READ_3(src, little_endian) \
+ ((little_endian) ? BYTEARRAY_READ_3_LE (src) : BYTEARRAY_READ_3_BE (src))
+#define BYTEARRAY_READ_4(src, little_endian) \
+ ((little_endian) ? BYTEARRAY_READ_4_LE (src) : BYTEARRAY_READ_4_BE (src))
+
+#define BYTEARRAY_WRITE_1(dest, value, little_endian) \
+ (((unsigned char *) (dest))[0] = (unsigned char) (value))
+
+#define BYTEARRAY_WRITE_2_LE(dest, value) \
+ (((unsigned char *) (dest))[0] = (unsigned char) ((value) & 0xFF), \
+  ((unsigned char *) (dest))[1] = (unsigned char) (((value) >> 8) & 0xFF))
+#define BYTEARRAY_WRITE_2_BE(dest, value) \
+ (((unsigned char *) (dest))[1] = (unsigned char) ((value) & 0xFF), \
+  ((unsigned char *) (dest))[0] = (unsigned char) (((value) >> 8) & 0xFF))
+
+#define BYTEARRAY_WRITE_3_LE(dest, value) \
+ (((unsigned char *) (dest))[0] = (unsigned char) ((value) & 0xFF), \
+  ((unsigned char *) (dest))[1] = (unsigned char) (((value) >> 8) & 0xFF), \
+  ((unsigned char *) (dest))[2] = (unsigned char) (((value) >> 16) & 0xFF))
+#define BYTEARRAY_WRITE_3_BE(dest, value) \
+ (((unsigned char *) (dest))[2] = (unsigned char) ((value) & 0xFF), \
+  ((unsigned char *) (dest))[1] = (unsigned char) (((value) >> 8) & 0xFF), \
+  ((unsigned char *) (dest))[0] = (unsigned char) (((value) >> 16) & 0xFF))
+
+#define BYTEARRAY_WRITE_4_LE(dest, value) \
+ (((unsigned char *) (dest))[0] = (unsigned char) ((value) & 0xFF), \
+  ((unsigned char *) (dest))[1] = (unsigned char) (((value) >> 8) & 0xFF), \
+  ((unsigned char *) (dest))[2] = (unsigned char) (((value) >> 16) & 0xFF), \
+  ((unsigned char *) (dest))[3] = (unsigned char) (((value) >> 24) & 0xFF))
+#define BYTEARRAY_WRITE_4_BE(dest, value) \
+ (((unsigned char *) (dest))[3] = (unsigned char) ((value) & 0xFF), \
+  ((unsigned char *) (dest))[2] = (unsigned char) (((value) >> 8) & 0xFF), \
+  ((unsigned char *) (dest))[1] = (unsigned char) (((value) >> 16) & 0xFF), \
+  ((unsigned char *) (dest))[0] = (unsigned char) (((value) >> 24) & 0xFF))
+
+#define BYTEARRAY_WRITE_2(dest, value, little_endian) \
+ ((little_endian) ? BYTEARRAY_WRITE_2_LE (dest, value) : BYTEARRAY_WRITE_2_BE (dest, value))
+#define BYTEARRAY_WRITE_3(dest, value, little_endian) \
+ ((little_endian) ? BYTEARRAY_WRITE_3_LE (dest, value) : BYTEARRAY_WRITE_3_BE (dest, value))
+#define BYTEARRAY_WRITE_4(dest, value, little_endian) \
+ ((little_endian) ? BYTEARRAY_WRITE_4_LE (dest, value) : BYTEARRAY_WRITE_4_BE (dest, value))
@@ -273,12 +273,68 @@ static address_type translate_Characteristics_to_alignment (unsigned long Charac
     return alignment;
 }
 
-static void write_sections (unsigned char *file)
+/* The checksum is the 32-bit one's complement sum of all 32-bit
+ * little-endian words (except the checksum field and the incomplete last word)
+ * folded into 16 bits plus the file size.
+ * That is the same as the 16-bit one's complement sum of the 16-bit halves,
+ * so the file can be summed in pieces of any size and order
+ * by keeping separate sums of bytes at even and at odd offsets.
+ * Carries are folded once per block instead of once per word. */
+struct pe_checksum {
+    unsigned long sum;
+    size_t file_size;
+};
+
+/* Largest block whose byte sums cannot overflow 32 bits. */
+#define CHECKSUM_BLOCK_SIZE 0x1000000LU
+
+static void pe_checksum_init (struct pe_checksum *checksum, size_t file_size)
+{
+    checksum->sum = 0;
+    checksum->file_size = file_size;
+}
+
+static void pe_checksum_add (struct pe_checksum *checksum, const unsigned char *data, size_t offset, size_t size)
+{
+    size_t end = checksum->file_size - checksum->file_size % 4;
+
+    if (offset >= end) return;
+    if (size > end - offset) size = end - offset;
+
+    while (size) {
+        size_t block_size = size < CHECKSUM_BLOCK_SIZE ? size : CHECKSUM_BLOCK_SIZE;
+        unsigned long even_bytes = 0, odd_bytes = 0;
+        size_t i = 0;
+
+        if (offset % 2) odd_bytes += data[i++];
+
+        for (; i + 1 < block_size; i += 2) {
+            even_bytes += data[i];
+            odd_bytes += data[i + 1];
+        }
+
+        if (i < block_size) even_bytes += data[i];
+
+        checksum->sum += (even_bytes & 0xFFFF) + (even_bytes >> 16);
+        checksum->sum += ((odd_bytes & 0xFF) << 8) + (odd_bytes >> 8);
+        while (checksum->sum >> 16) checksum->sum = (checksum->sum & 0xFFFF) + (checksum->sum >> 16);
+
+        data += block_size;
+        offset += block_size;
+        size -= block_size;
+    }
+}
+
+static unsigned long pe_checksum_finish (const struct pe_checksum *checksum)
+{
+    return (checksum->sum + checksum->file_size) & 0xFFFFFFFFLU;
+}
+
+static void write_sections (struct output_stream *stream, struct pe_checksum *checksum)
 {
-    unsigned char *pos;
     struct section *section;
 
-    pos = file + size_of_headers;
+    output_stream_write_zeros (stream, size_of_headers);
 
     for (section = all_sections; section; section = section->next) {
         
@@ -298,11 +354,19 @@ static void write_sections (unsigned char *file)
         hdr->VirtualAddress = section->rva;
 
         if (!section->is_bss) {
+            struct section_part *part;
+            size_t offset = output_stream_offset (stream);
+            
             hdr->SizeOfRawData = ALIGN (section->total_size, FileAlignment);
-            hdr->PointerToRawData = pos - file;
+            hdr->PointerToRawData = offset;
+
+            for (part = section->first_part; part; part = part->next) {
+                pe_checksum_add (checksum, part->content, offset, part->content_size);
+                offset += part->content_size + part->padding;
+            }
 
-            section_write (section, pos);
-            pos += ALIGN (section->total_size, FileAlignment);
+            section_write_to_stream (section, stream);
+            output_stream_write_zeros (stream, hdr->SizeOfRawData - section->total_size);
         } else {
             hdr->SizeOfRawData = 0;
             hdr->PointerToRawData = 0;
@@ -1222,41 +1286,20 @@ void coff_after_link (void)
                                         saved_part,
                                         saved_i);
     }
-}
-
-static unsigned long calculate_checksum (const unsigned char *data, size_t checksum_offset, size_t data_size)
-{
-    unsigned long sum = 0;
-    size_t i;
 
-    for (i = 0; i < data_size / 4; i++) {
-        unsigned long temp;
-        int carry;
-
-        if (i == checksum_offset / 4) continue;
-
-        bytearray_read_4_bytes (&temp, data + i * 4, LITTLE_ENDIAN);
-        /* ULONG_MAX might be bigger than this value on some systems. */
-        carry = sum > 0xFFFFFFFFLU - temp;
-        sum += temp;
-        sum += carry;
-        sum &= 0xFFFFFFFFLU;
+    /* --gc-sections might have removed all parts needing base relocations
+     * and empty .reloc section must not be generated. */
+    if (reloc_section->first_part == NULL) {
+        generate_reloc_section = 0;
+        section_discard (reloc_section);
     }
-
-    sum = (sum >> 16) + (sum & 0xFFFF);
-    sum += sum >> 16;
-    sum &= 0xFFFF;
-
-    sum += data_size;
-    sum &= 0xFFFFFFFFLU;
-
-    return sum;
 }
 
 void coff_write (const char *filename)
 {
-    FILE *outfile;
-    unsigned char *file;
+    struct output_stream *stream;
+    struct pe_checksum checksum;
+    unsigned char *headers;
     size_t file_size;
     unsigned char *pos;
     unsigned char *checksum_pos;
@@ -1268,10 +1311,7 @@ void coff_write (const char *filename)
 
     struct section *section;
 
-    if (!(outfile = fopen (filename, "wb"))) {
-        ld_error ("cannot open '%s' for writing", filename);
-        return;
-    }
+    if (!(stream = output_stream_open (filename))) return;
 
     {
         size_t total_section_size_to_write = 0;
@@ -1283,12 +1323,15 @@ void coff_write (const char *filename)
         file_size = size_of_headers + total_section_size_to_write;
     }
 
-    file = xmalloc (file_size);
-    memset (file, 0, file_size);
+    /* Sections are written first, so their contents are never copied
+     * and headers are written over the space left for them at the end. */
+    pe_checksum_init (&checksum, file_size);
+    write_sections (stream, &checksum);
 
-    write_sections (file);
+    headers = xmalloc (size_of_headers);
+    memset (headers, 0, size_of_headers);
 
-    pos = file;
+    pos = headers;
 
     if (stub_file) {
         read_struct_IMAGE_DOS_HEADER (&dos_hdr, stub_file);
@@ -1509,8 +1552,11 @@ void coff_write (const char *filename)
         free (hdr);
     }
 
+    /* The checksum field is not included in the checksum. */
+    bytearray_write_4_bytes (checksum_pos, 0, LITTLE_ENDIAN);
+    pe_checksum_add (&checksum, headers, 0, size_of_headers);
     bytearray_write_4_bytes (checksum_pos,
-                             calculate_checksum (file, checksum_pos - file, file_size),
+                             pe_checksum_finish (&checksum),
                              LITTLE_ENDIAN);
 
     if (convert_to_flat
@@ -1520,20 +1566,15 @@ void coff_write (const char *filename)
     }
 
     if (convert_to_flat) {
-        file = xrealloc (file, optional_hdr.SizeOfImage);
-        memset (file + file_size, '\0', optional_hdr.SizeOfImage - file_size);
-        file_size = optional_hdr.SizeOfImage;
-        file[0] = 0xE9;
-        bytearray_write_4_bytes (file + 1, ld_state->entry_point - 5, LITTLE_ENDIAN);
+        output_stream_pad_to (stream, optional_hdr.SizeOfImage);
+        headers[0] = 0xE9;
+        bytearray_write_4_bytes (headers + 1, ld_state->entry_point - 5, LITTLE_ENDIAN);
     }
 
-    if (fwrite (file, file_size, 1, outfile) != 1) {
-        ld_error ("writing '%s' file failed", filename);
-    }
-    
+    output_stream_patch (stream, 0, headers, size_of_headers);
 
-    free (file);
-    fclose (outfile);
+    free (headers);
+    output_stream_close (stream);
     return;
 }
 
@@ -1684,7 +1725,152 @@ static union sym_tab_entry *read_symbol_table (unsigned char *file,
     return read_symtab;
 }
 
-static int read_coff_object (unsigned char *file, size_t file_size, const char *filename)
+/* The parts of reading a COFF object which depend only on the file itself
+ * (decoding the symbol table, symbol names and relocations)
+ * can be done in advance by coff_stage_object () on a worker thread.
+ * read_coff_object () then takes the results instead of decoding them itself
+ * and everything touching the global tables is still done in command-line order. */
+struct coff_staged_object {
+    union sym_tab_entry *read_symtab;
+    unsigned long *comdat_aux_symbol_indexes;
+    unsigned long *comdat_comdat_symbol_indexes;
+    char **symbol_names;
+    struct relocation_entry_internal **relocations;
+    unsigned long num_symbols;
+    unsigned long num_sections;
+};
+
+#define STAGE_CHECK_READ(memory_position, size_to_read) \
+    (((memory_position) - file + (size_to_read) > file_size) || (memory_position) < file)
+
+/* Must not report anything (it runs on a worker thread),
+ * so it returns NULL for anything unusual
+ * and the file is then read without staging, which reports the problems. */
+struct coff_staged_object *coff_stage_object (const unsigned char *file, size_t file_size)
+{
+    struct coff_staged_object *staged;
+    struct coff_header_internal coff_hdr;
+    struct string_table_header_internal string_table_hdr;
+    const unsigned char *pos;
+    const char *string_table;
+    unsigned long i;
+    unsigned char aux_num = 0;
+
+    pos = file;
+    if (STAGE_CHECK_READ (pos, SIZEOF_struct_coff_header_file)) return NULL;
+    read_struct_coff_header (&coff_hdr, pos);
+
+    if (coff_hdr.Machine != IMAGE_FILE_MACHINE_AMD64
+        && coff_hdr.Machine != IMAGE_FILE_MACHINE_ARM
+        && coff_hdr.Machine != IMAGE_FILE_MACHINE_ARMNT
+        && coff_hdr.Machine != IMAGE_FILE_MACHINE_I386
+        && coff_hdr.Machine != IMAGE_FILE_MACHINE_THUMB) return NULL;
+
+    pos = file + coff_hdr.PointerToSymbolTable;
+    if (STAGE_CHECK_READ (pos, SIZEOF_struct_symbol_table_entry_file * coff_hdr.NumberOfSymbols)) return NULL;
+
+    pos += SIZEOF_struct_symbol_table_entry_file * coff_hdr.NumberOfSymbols;
+    if (STAGE_CHECK_READ (pos, SIZEOF_struct_string_table_header_file)) return NULL;
+    read_struct_string_table_header (&string_table_hdr, pos);
+    if (string_table_hdr.StringTableSize < 4 || STAGE_CHECK_READ (pos, string_table_hdr.StringTableSize)) return NULL;
+    string_table = (const char *) pos;
+
+    pos = file + SIZEOF_struct_coff_header_file;
+    if (STAGE_CHECK_READ (pos, SIZEOF_struct_section_table_entry_file * coff_hdr.NumberOfSections)) return NULL;
+
+    staged = xcalloc (1, sizeof (*staged));
+    staged->num_symbols = coff_hdr.NumberOfSymbols;
+    staged->num_sections = coff_hdr.NumberOfSections;
+    staged->read_symtab = xmalloc (sizeof (*staged->read_symtab) * (coff_hdr.NumberOfSymbols + 1));
+    staged->symbol_names = xcalloc (coff_hdr.NumberOfSymbols + 1, sizeof (*staged->symbol_names));
+    staged->comdat_aux_symbol_indexes = xcalloc (coff_hdr.NumberOfSections + 1, sizeof (*staged->comdat_aux_symbol_indexes));
+    staged->comdat_comdat_symbol_indexes = xcalloc (coff_hdr.NumberOfSections + 1, sizeof (*staged->comdat_comdat_symbol_indexes));
+    staged->relocations = xcalloc (coff_hdr.NumberOfSections + 1, sizeof (*staged->relocations));
+
+    /* Same as read_symbol_table (). */
+    pos = file + coff_hdr.PointerToSymbolTable;
+    for (i = 0; i < coff_hdr.NumberOfSymbols; i++, pos += SIZEOF_struct_symbol_table_entry_file) {
+        struct symbol_table_entry_internal *coff_symbol = &staged->read_symtab[i].sym;
+
+        if (aux_num) {
+            memcpy (staged->read_symtab[i].aux, pos, sizeof (staged->read_symtab[i].aux));
+            aux_num--;
+            continue;
+        }
+
+        read_struct_symbol_table_entry (coff_symbol, pos);
+        aux_num = coff_symbol->NumberOfAuxSymbols;
+
+        if (coff_symbol->SectionNumber > 0
+            && coff_symbol->SectionNumber <= coff_hdr.NumberOfSections) {
+            short sec_num = coff_symbol->SectionNumber - 1;
+
+            if (!staged->comdat_aux_symbol_indexes[sec_num]) {
+                staged->comdat_aux_symbol_indexes[sec_num] = i + 1;
+            } else if (!staged->comdat_comdat_symbol_indexes[sec_num]) {
+                staged->comdat_comdat_symbol_indexes[sec_num] = i;
+            }
+        }
+
+        if (memcmp (coff_symbol->Name, "\0\0\0\0", 4) == 0) {
+            unsigned long offset = 0;
+
+            bytearray_read_4_bytes (&offset, (unsigned char *)(coff_symbol->Name + 4), LITTLE_ENDIAN);
+
+            if (offset >= string_table_hdr.StringTableSize) {
+                coff_staged_object_free (staged);
+                return NULL;
+            }
+            staged->symbol_names[i] = xstrdup (string_table + offset);
+        } else staged->symbol_names[i] = xstrndup (coff_symbol->Name, 8);
+    }
+
+    if (aux_num) {
+        coff_staged_object_free (staged);
+        return NULL;
+    }
+
+    for (i = 0; i < coff_hdr.NumberOfSections; i++) {
+        struct section_table_entry_internal section_hdr;
+
+        pos = file + SIZEOF_struct_coff_header_file + SIZEOF_struct_section_table_entry_file * i;
+        read_struct_section_table_entry (&section_hdr, pos);
+
+        if (!section_hdr.PointerToRelocations || !section_hdr.NumberOfRelocations) continue;
+
+        pos = file + section_hdr.PointerToRelocations;
+        if (STAGE_CHECK_READ (pos, SIZEOF_struct_relocation_entry_file * section_hdr.NumberOfRelocations)) {
+            coff_staged_object_free (staged);
+            return NULL;
+        }
+
+        staged->relocations[i] = xmalloc (sizeof (*staged->relocations[i]) * section_hdr.NumberOfRelocations);
+        read_struct_relocation_entries (staged->relocations[i], pos, section_hdr.NumberOfRelocations);
+    }
+
+    return staged;
+}
+
+void coff_staged_object_free (struct coff_staged_object *staged)
+{
+    unsigned long i;
+
+    for (i = 0; i < staged->num_symbols; i++) {
+        free (staged->symbol_names[i]);
+    }
+    for (i = 0; i < staged->num_sections; i++) {
+        free (staged->relocations[i]);
+    }
+
+    free (staged->read_symtab);
+    free (staged->symbol_names);
+    free (staged->comdat_aux_symbol_indexes);
+    free (staged->comdat_comdat_symbol_indexes);
+    free (staged->relocations);
+    free (staged);
+}
+
+static int read_coff_object (unsigned char *file, size_t file_size, const char *filename, struct coff_staged_object *staged)
 {
     struct coff_header_internal coff_hdr;
     struct string_table_header_internal string_table_hdr;
@@ -1730,9 +1916,18 @@ static int read_coff_object (unsigned char *file, size_t file_size, const char *
     bss_section = NULL;
     bss_section_number = 0;
 
-    comdat_aux_symbol_indexes = xcalloc (coff_hdr.NumberOfSections, sizeof *comdat_aux_symbol_indexes);
-    comdat_comdat_symbol_indexes = xcalloc (coff_hdr.NumberOfSections, sizeof *comdat_comdat_symbol_indexes);
-    if (coff_hdr.NumberOfSymbols) {
+    if (staged) {
+        read_symtab = staged->read_symtab;
+        comdat_aux_symbol_indexes = staged->comdat_aux_symbol_indexes;
+        comdat_comdat_symbol_indexes = staged->comdat_comdat_symbol_indexes;
+        staged->read_symtab = NULL;
+        staged->comdat_aux_symbol_indexes = NULL;
+        staged->comdat_comdat_symbol_indexes = NULL;
+    } else {
+        comdat_aux_symbol_indexes = xcalloc (coff_hdr.NumberOfSections, sizeof *comdat_aux_symbol_indexes);
+        comdat_comdat_symbol_indexes = xcalloc (coff_hdr.NumberOfSections, sizeof *comdat_comdat_symbol_indexes);
+    }
+    if (coff_hdr.NumberOfSymbols && !staged) {
         read_symtab = read_symbol_table (file, file_size, filename, &coff_hdr, comdat_aux_symbol_indexes, comdat_comdat_symbol_indexes);
         if (read_symtab == NULL) {
             free (comdat_aux_symbol_indexes);
@@ -1995,10 +2190,9 @@ static int read_coff_object (unsigned char *file, size_t file_size, const char *
                 part->content_size = section_hdr.SizeOfRawData;
                 if (section_hdr.PointerToRawData) {
                     pos = file + section_hdr.PointerToRawData;
-                    part->content = xmalloc (part->content_size);
-
                     CHECK_READ (pos, part->content_size);
-                    memcpy (part->content, pos, part->content_size);
+                    part->content = pos;
+                    part->content_is_view = 1;
                 }
                 if (section->is_bss) {
                     bss_section_number = i + 1;
@@ -2008,7 +2202,7 @@ static int read_coff_object (unsigned char *file, size_t file_size, const char *
                 if (section_hdr.PointerToRelocations && section_hdr.NumberOfRelocations) {
 
                     size_t j;
-                    struct relocation_entry_internal relocation;
+                    struct relocation_entry_internal *relocations;
 
                     if (!section_hdr.PointerToRawData) {
                         ld_fatal_error ("section '%s' is BSS but has relocations", section->name);
@@ -2019,12 +2213,18 @@ static int read_coff_object (unsigned char *file, size_t file_size, const char *
                     part->relocation_array = xcalloc (section_hdr.NumberOfRelocations, sizeof *part->relocation_array);
                     part->relocation_count = section_hdr.NumberOfRelocations;
                     
-                    CHECK_READ (pos, SIZEOF_struct_relocation_entry_file * section_hdr.NumberOfRelocations);
+                    if (staged) {
+                        relocations = staged->relocations[i];
+                        staged->relocations[i] = NULL;
+                    } else {
+                        CHECK_READ (pos, SIZEOF_struct_relocation_entry_file * section_hdr.NumberOfRelocations);
+                        relocations = xmalloc (sizeof (*relocations) * section_hdr.NumberOfRelocations);
+                        read_struct_relocation_entries (relocations, pos, section_hdr.NumberOfRelocations);
+                    }
                     for (j = 0; j < section_hdr.NumberOfRelocations; j++) {
-			read_struct_relocation_entry (&relocation,
-                                                      pos + SIZEOF_struct_relocation_entry_file * j);
-                        translate_relocation (part->relocation_array + j, &relocation, part);
+                        translate_relocation (part->relocation_array + j, relocations + j, part);
                     }
+                    free (relocations);
                 }
                 
                 if (subsection) {
@@ -2043,7 +2243,12 @@ static int read_coff_object (unsigned char *file, size_t file_size, const char *
         struct symbol_table_entry_internal *coff_symbol = &read_symtab[i].sym;
         struct symbol *symbol = of->symbol_array + i;
 
-        if (memcmp (coff_symbol->Name, "\0\0\0\0", 4) == 0) {
+        if (staged) {
+
+            symbol->name = staged->symbol_names[i];
+            staged->symbol_names[i] = NULL;
+
+        } else if (memcmp (coff_symbol->Name, "\0\0\0\0", 4) == 0) {
 
             unsigned long offset = 0;
 
@@ -2477,6 +2682,12 @@ static int read_import_object (unsigned char *file, size_t file_size, const char
     return 0;
 }
 
+int coff_read_staged_object (struct coff_staged_object *staged, unsigned char *file, size_t file_size, const char *filename)
+{
+    read_coff_object (file, file_size, filename, staged);
+    return INPUT_FILE_FINISHED;
+}
+
 int coff_read (unsigned char *file, size_t file_size, const char *filename)
 {
     unsigned short Machine;
@@ -2490,7 +2701,7 @@ int coff_read (unsigned char *file, size_t file_size, const char *filename)
         || Machine == IMAGE_FILE_MACHINE_ARMNT
         || Machine == IMAGE_FILE_MACHINE_I386
         || Machine == IMAGE_FILE_MACHINE_THUMB) {
-        read_coff_object (file, file_size, filename);
+        read_coff_object (file, file_size, filename, NULL);
         return INPUT_FILE_FINISHED;
     } else if (Machine == IMAGE_FILE_MACHINE_UNKNOWN) {
         unsigned short Magic2;
@@ -18,7 +18,7 @@
 #include "coff_bytearray.h"
 
 #define COPY(struct_name, field_name, bytes) \
- bytearray_read_##bytes##_bytes (&struct_name##_internal->field_name, struct_name##_file->field_name, LITTLE_ENDIAN)
+ struct_name##_internal->field_name = BYTEARRAY_READ_##bytes (struct_name##_file->field_name, LITTLE_ENDIAN)
 #define COPY_CHAR_ARRAY(struct_name, field_name) memcpy (struct_name##_internal->field_name, struct_name##_file->field_name, sizeof (struct_name##_file->field_name))
 
 void read_struct_IMAGE_DOS_HEADER (struct IMAGE_DOS_HEADER_internal *IMAGE_DOS_HEADER_internal, const void *memory)
@@ -174,6 +174,21 @@ void read_struct_relocation_entry (struct relocation_entry_internal *relocation_
     COPY(relocation_entry, Type, 2);
 }
 
+void read_struct_relocation_entries (struct relocation_entry_internal *relocation_entries, const void *memory, size_t count)
+{
+    const unsigned char *pos = memory;
+    size_t i;
+
+    for (i = 0; i < count; i++, pos += SIZEOF_struct_relocation_entry_file) {
+        const struct relocation_entry_file *relocation_entry_file = (const void *) pos;
+        struct relocation_entry_internal *relocation_entry_internal = relocation_entries + i;
+
+        COPY(relocation_entry, VirtualAddress, 4);
+        COPY(relocation_entry, SymbolTableIndex, 4);
+        COPY(relocation_entry, Type, 2);
+    }
+}
+
 void read_struct_symbol_table_entry (struct symbol_table_entry_internal *symbol_table_entry_internal, const void *memory)
 {
     const struct symbol_table_entry_file *symbol_table_entry_file = memory;
@@ -262,7 +277,7 @@ void read_struct_IMPORT_OBJECT_HEADER (struct IMPORT_OBJECT_HEADER_internal *IMP
 #undef COPY
 
 #define COPY(struct_name, field_name, bytes) \
- bytearray_write_##bytes##_bytes (struct_name##_file->field_name, struct_name##_internal->field_name, LITTLE_ENDIAN)
+ BYTEARRAY_WRITE_##bytes (struct_name##_file->field_name, struct_name##_internal->field_name, LITTLE_ENDIAN)
 #define COPY_CHAR_ARRAY(struct_name, field_name) memcpy (struct_name##_file->field_name, struct_name##_internal->field_name, sizeof (struct_name##_file->field_name))
 
 void write_struct_IMAGE_DOS_HEADER (void *memory, const struct IMAGE_DOS_HEADER_internal *IMAGE_DOS_HEADER_internal)
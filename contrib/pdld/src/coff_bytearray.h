@@ -15,6 +15,7 @@ void read_struct_optional_header_plus (struct optional_header_plus_internal *opt
 void read_struct_IMAGE_DATA_DIRECTORY (struct IMAGE_DATA_DIRECTORY_internal *IMAGE_DATA_DIRECTORY_internal, const void *memory);
 void read_struct_section_table_entry (struct section_table_entry_internal *section_table_entry_internal, const void *memory);
 void read_struct_relocation_entry (struct relocation_entry_internal *relocation_entry_internal, const void *memory);
+void read_struct_relocation_entries (struct relocation_entry_internal *relocation_entries, const void *memory, size_t count);
 void read_struct_symbol_table_entry (struct symbol_table_entry_internal *symbol_table_entry_internal, const void *memory);
 void read_struct_aux_section_symbol (struct aux_section_symbol_internal *aux_section_symbol_internal, const void *memory);
 void read_struct_string_table_header (struct string_table_header_internal *string_table_header_internal, const void *memory);
@@ -120,17 +120,16 @@ static size_t section_get_num_relocs (struct section *section)
     return num_relocs;
 }
 
-static unsigned char *write_relocs_for_section (unsigned char *file,
-                                                unsigned char *pos,
-                                                struct section *section,
-                                                struct Elf32_Shdr_internal *shdr_p)
+static int write_relocs_for_section (struct output_stream *stream,
+                                     struct section *section,
+                                     struct Elf32_Shdr_internal *shdr_p)
 {
     struct section_part *part;
+    unsigned char *rels;
     unsigned char *rel_pos;
-    unsigned char *saved_pos = pos;
 
-    pos = file + ALIGN (pos - file, RELOC_SECTION_ALIGNMENT);
-    rel_pos = pos;
+    rels = xmalloc (section_get_num_relocs (section) * SIZEOF_struct_Elf32_Rel_file + 1);
+    rel_pos = rels;
 
     for (part = section->first_part; part; part = part->next) {
         size_t i;
@@ -201,32 +200,39 @@ static unsigned char *write_relocs_for_section (unsigned char *file,
         }
     }
 
-    if (rel_pos == pos) return saved_pos;
+    if (rel_pos == rels) {
+        free (rels);
+        return 0;
+    }
+
+    output_stream_pad_to (stream, ALIGN (output_stream_offset (stream), RELOC_SECTION_ALIGNMENT));
 
     shdr_p->sh_type = SHT_REL;
     shdr_p->sh_flags = 0;
     shdr_p->sh_addr = 0;
-    shdr_p->sh_offset = pos - file;
-    shdr_p->sh_size = rel_pos - pos;
+    shdr_p->sh_offset = output_stream_offset (stream);
+    shdr_p->sh_size = rel_pos - rels;
     shdr_p->sh_link = 0; /* No symbol table exists. */
     shdr_p->sh_info = section->target_index;
     shdr_p->sh_addralign = RELOC_SECTION_ALIGNMENT;
     shdr_p->sh_entsize = SIZEOF_struct_Elf32_Rel_file;
+
+    output_stream_write (stream, rels, rel_pos - rels);
+    free (rels);
     
-    return rel_pos;
+    return 1;
 }
 
-static unsigned char *write_relocs_for_section64 (unsigned char *file,
-                                                  unsigned char *pos,
-                                                  struct section *section,
-                                                  Elf64_Shdr *shdr_p)
+static int write_relocs_for_section64 (struct output_stream *stream,
+                                       struct section *section,
+                                       Elf64_Shdr *shdr_p)
 {
     struct section_part *part;
+    Elf64_Rel *rels;
     Elf64_Rel *rel;
-    unsigned char *saved_pos = pos;
 
-    pos = file + ALIGN (pos - file, RELOC_SECTION_ALIGNMENT);
-    rel = (void *)pos;
+    rels = xmalloc (sizeof (*rels) * (section_get_num_relocs (section) + 1));
+    rel = rels;
 
     for (part = section->first_part; part; part = part->next) {
         size_t i;
@@ -274,37 +280,46 @@ static unsigned char *write_relocs_for_section64 (unsigned char *file,
         }
     }
 
-    if (rel == (void *)pos) return saved_pos;
+    if (rel == rels) {
+        free (rels);
+        return 0;
+    }
+
+    output_stream_pad_to (stream, ALIGN (output_stream_offset (stream), RELOC_SECTION_ALIGNMENT));
 
     shdr_p->sh_type = SHT_REL;
     shdr_p->sh_flags = 0;
     shdr_p->sh_addr = 0;
-    shdr_p->sh_offset = pos - file;
-    shdr_p->sh_size = (unsigned char *)rel - pos;
+    shdr_p->sh_offset = output_stream_offset (stream);
+    shdr_p->sh_size = (unsigned char *)rel - (unsigned char *)rels;
     shdr_p->sh_link = 0; /* No symbol table exists. */
     shdr_p->sh_info = section->target_index;
     shdr_p->sh_addralign = RELOC_SECTION_ALIGNMENT;
     shdr_p->sh_entsize = sizeof *rel;
+
+    output_stream_write (stream, rels, (unsigned char *)rel - (unsigned char *)rels);
+    free (rels);
     
-    return (unsigned char *)rel;
+    return 1;
 }
 
-static unsigned char *write_sections (unsigned char *file,
-                                      struct Elf32_Ehdr_internal *ehdr_p,
-                                      unsigned long shstrtab_i)
+/* Program and section header tables are at the end of the file,
+ * so they are filled in memory (tables points to e_phoff)
+ * while the contents are written. */
+static void write_sections (struct output_stream *stream,
+                            unsigned char *tables,
+                            struct Elf32_Ehdr_internal *ehdr_p,
+                            unsigned long shstrtab_i)
 {
-    unsigned char *pos;
     struct section *section;
     unsigned char *phdr_pos;
     unsigned char *shdr_pos = NULL;
 
-    pos = file + size_of_headers;
-
-    phdr_pos = file + ehdr_p->e_phoff;
+    phdr_pos = tables;
     if (generate_section_headers) {
         struct Elf32_Shdr_internal shdr = {0};
         
-        shdr_pos = file + ehdr_p->e_shoff;
+        shdr_pos = tables + (ehdr_p->e_shoff - ehdr_p->e_phoff);
         shdr.sh_type = SHT_NULL;
         shdr.sh_link = SHN_UNDEF;
 
@@ -321,11 +336,10 @@ static unsigned char *write_sections (unsigned char *file,
 
         if (!section->is_bss) {
             phdr.p_filesz = section->total_size;
-            pos = file + ALIGN (pos - file, section->section_alignment);
-            phdr.p_offset = pos - file;
+            output_stream_pad_to (stream, ALIGN (output_stream_offset (stream), section->section_alignment));
+            phdr.p_offset = output_stream_offset (stream);
 
-            section_write (section, pos);
-            pos += section->total_size;
+            section_write_to_stream (section, stream);
         } else {
             phdr.p_filesz = 0;
             phdr.p_offset = 0;
@@ -352,10 +366,8 @@ static unsigned char *write_sections (unsigned char *file,
 
             if (ld_state->emit_relocs) {
                 struct Elf32_Shdr_internal rel_shdr = {0};
-                unsigned char *saved_pos = pos;
 
-                pos = write_relocs_for_section (file, pos, section, &rel_shdr);
-                if (pos == saved_pos) {
+                if (!write_relocs_for_section (stream, section, &rel_shdr)) {
                     goto no_relocs_emitted;
                 }
 
@@ -379,22 +391,17 @@ no_relocs_emitted:
         write_struct_Elf32_Phdr (phdr_pos, &phdr, endianess);
         phdr_pos += SIZEOF_struct_Elf32_Phdr_file;
     }
-
-    return pos;
 }
 
-static unsigned char *write_sections64 (unsigned char *file, Elf64_Ehdr *ehdr_p)
+static void write_sections64 (struct output_stream *stream, unsigned char *tables, Elf64_Ehdr *ehdr_p)
 {
-    unsigned char *pos;
     struct section *section;
     Elf64_Phdr *phdr_p;
     Elf64_Shdr *shdr_p = NULL;
 
-    pos = file + size_of_headers;
-
-    phdr_p = (void *)(file + ehdr_p->e_phoff);
+    phdr_p = (void *)tables;
     if (generate_section_headers) {
-        shdr_p = (void *)(file + ehdr_p->e_shoff);
+        shdr_p = (void *)(tables + (ehdr_p->e_shoff - ehdr_p->e_phoff));
         shdr_p->sh_type = SHT_NULL;
         shdr_p->sh_link = SHN_UNDEF;
         shdr_p++;
@@ -407,11 +414,10 @@ static unsigned char *write_sections64 (unsigned char *file, Elf64_Ehdr *ehdr_p)
 
         if (!section->is_bss) {
             phdr_p->p_filesz = section->total_size;
-            pos = file + ALIGN (pos - file, section->section_alignment);
-            phdr_p->p_offset = pos - file;
+            output_stream_pad_to (stream, ALIGN (output_stream_offset (stream), section->section_alignment));
+            phdr_p->p_offset = output_stream_offset (stream);
 
-            section_write (section, pos);
-            pos += section->total_size;
+            section_write_to_stream (section, stream);
         } else {
             phdr_p->p_filesz = 0;
             phdr_p->p_offset = 0;
@@ -436,10 +442,7 @@ static unsigned char *write_sections64 (unsigned char *file, Elf64_Ehdr *ehdr_p)
             shdr_p++;
 
             if (ld_state->emit_relocs) {
-                unsigned char *saved_pos = pos;
-
-                pos = write_relocs_for_section64 (file, pos, section, shdr_p);
-                if (pos != saved_pos) {
+                if (write_relocs_for_section64 (stream, section, shdr_p)) {
                     shdr_p++;
                 }
             }
@@ -447,8 +450,6 @@ static unsigned char *write_sections64 (unsigned char *file, Elf64_Ehdr *ehdr_p)
 
         phdr_p++;
     }
-
-    return pos;
 }
 
 address_type elf_get_first_section_rva (void)
@@ -622,10 +623,9 @@ static void elf64_write (const char *filename);
 
 void elf_write (const char *filename)
 {
-    FILE *outfile;
-    unsigned char *file;
+    struct output_stream *stream;
+    unsigned char *tables;
     size_t file_size;
-    unsigned char *pos;
 
     struct Elf32_Ehdr_internal ehdr;
     unsigned long shstrtab_start_i = 0;
@@ -638,10 +638,7 @@ void elf_write (const char *filename)
         return;
     }
 
-    if (!(outfile = fopen (filename, "wb"))) {
-        ld_error ("cannot open '%s' for writing", filename);
-        return;
-    }
+    if (!(stream = output_stream_open (filename))) return;
 
     /* Relocations exist only in sections. */
     if (ld_state->emit_relocs) generate_section_headers = 1;
@@ -752,75 +749,66 @@ void elf_write (const char *filename)
         }
     }
 
-    file = xmalloc (file_size);
-    memset (file, 0, file_size);
+    /* The header is complete already, the tables are written last. */
+    {
+        unsigned char ehdr_file[SIZEOF_struct_Elf32_Ehdr_file];
+
+        write_struct_Elf32_Ehdr (ehdr_file, &ehdr, endianess);
+        output_stream_write (stream, ehdr_file, sizeof (ehdr_file));
+        output_stream_pad_to (stream, size_of_headers);
+    }
 
-    pos = write_sections (file, &ehdr, shstrtab_start_i);
+    tables = xmalloc (file_size - ehdr.e_phoff);
+    memset (tables, 0, file_size - ehdr.e_phoff);
+
+    write_sections (stream, tables, &ehdr, shstrtab_start_i);
 
     if (generate_section_headers) {
-        unsigned char *saved_pos;
         unsigned char *shdr_pos;
         
         struct Elf32_Shdr_internal shstrshdr = {0};
 
-        shdr_pos = file + ehdr.e_shoff + ehdr.e_shstrndx * SIZEOF_struct_Elf32_Shdr_file;
-        saved_pos = pos;
+        shdr_pos = tables + (ehdr.e_shoff - ehdr.e_phoff) + ehdr.e_shstrndx * SIZEOF_struct_Elf32_Shdr_file;
         
         shstrshdr.sh_name = 1;
         shstrshdr.sh_type = SHT_STRTAB;
-        shstrshdr.sh_offset = saved_pos - file;
+        shstrshdr.sh_offset = output_stream_offset (stream);
         shstrshdr.sh_addralign = 1;
 
-        *pos = '\0';
-        pos++;
-        memcpy (pos, ".shstrtab", sizeof (".shstrtab"));
-        pos += sizeof (".shstrtab");
+        output_stream_write (stream, "\0.shstrtab", sizeof ("\0.shstrtab"));
 
         for (section = all_sections; section; section = section->next) {
             int has_relocs = ld_state->emit_relocs && section_get_num_relocs (section);
-            size_t name_len = strlen (section->name);
 
             if (has_relocs) {
-                memcpy (pos, ".rel", sizeof (".rel") - 1);
-                pos += sizeof (".rel") - 1;
+                output_stream_write (stream, ".rel", sizeof (".rel") - 1);
             }
 
-            memcpy (pos, section->name, name_len);
-            pos[name_len] = '\0';
-            pos += name_len + 1;
+            output_stream_write (stream, section->name, strlen (section->name) + 1);
         }
 
-        shstrshdr.sh_size = pos - saved_pos;
+        shstrshdr.sh_size = output_stream_offset (stream) - shstrshdr.sh_offset;
         write_struct_Elf32_Shdr (shdr_pos, &shstrshdr, endianess);
     }
 
-    pos = file;
-
-    write_struct_Elf32_Ehdr (pos, &ehdr, endianess);
-
-    if (fwrite (file, file_size, 1, outfile) != 1) {
-        ld_error ("writing '%s' file failed", filename);
-    }
+    output_stream_pad_to (stream, ehdr.e_phoff);
+    output_stream_write (stream, tables, file_size - ehdr.e_phoff);
     
-    free (file);
-    fclose (outfile);
+    free (tables);
+    output_stream_close (stream);
 }
 
 static void elf64_write (const char *filename)
 {
-    FILE *outfile;
-    unsigned char *file;
+    struct output_stream *stream;
+    unsigned char *tables;
     size_t file_size;
-    unsigned char *pos;
 
     Elf64_Ehdr ehdr;
 
     struct section *section;
 
-    if (!(outfile = fopen (filename, "wb"))) {
-        ld_error ("cannot open '%s' for writing", filename);
-        return;
-    }
+    if (!(stream = output_stream_open (filename))) return;
 
     /* Relocations exist only in sections. */
     if (ld_state->emit_relocs) generate_section_headers = 1;
@@ -910,73 +898,231 @@ static void elf64_write (const char *filename)
         }
     }
 
-    file = xmalloc (file_size);
-    memset (file, 0, file_size);
+    /* The header is complete already, the tables are written last. */
+    output_stream_write (stream, &ehdr, sizeof (ehdr));
+    output_stream_pad_to (stream, size_of_headers);
+
+    tables = xmalloc (file_size - ehdr.e_phoff);
+    memset (tables, 0, file_size - ehdr.e_phoff);
 
-    pos = write_sections64 (file, &ehdr);
+    write_sections64 (stream, tables, &ehdr);
 
     if (generate_section_headers) {
-        unsigned char *saved_pos;
+        size_t shstrtab_offset;
         Elf64_Shdr *shdr_p, *shstrshdr_p;
 
-        shdr_p = (void *)(file + ehdr.e_shoff);
+        shdr_p = (void *)(tables + (ehdr.e_shoff - ehdr.e_phoff));
         shstrshdr_p = shdr_p + ehdr.e_shstrndx;
         shdr_p++;
-        saved_pos = pos;
+        shstrtab_offset = output_stream_offset (stream);
         
         shstrshdr_p->sh_name = 1;
         shstrshdr_p->sh_type = SHT_STRTAB;
-        shstrshdr_p->sh_offset = saved_pos - file;
+        shstrshdr_p->sh_offset = shstrtab_offset;
         shstrshdr_p->sh_addralign = 1;
 
-        *pos = '\0';
-        pos++;
-        memcpy (pos, ".shstrtab", sizeof (".shstrtab"));
-        pos += sizeof (".shstrtab");
+        output_stream_write (stream, "\0.shstrtab", sizeof ("\0.shstrtab"));
 
         for (section = all_sections; section; section = section->next) {
             int has_relocs = ld_state->emit_relocs && section_get_num_relocs (section);
-            size_t name_len = strlen (section->name);
 
             if (has_relocs) {
-                memcpy (pos, ".rel", sizeof (".rel") - 1);
-                pos += sizeof (".rel") - 1;
+                output_stream_write (stream, ".rel", sizeof (".rel") - 1);
             }
-            shdr_p->sh_name = pos - saved_pos;
+            shdr_p->sh_name = output_stream_offset (stream) - shstrtab_offset;
             if (has_relocs) {
                 shdr_p++;
-                shdr_p->sh_name = pos - saved_pos - (sizeof (".rel") - 1);
+                shdr_p->sh_name = output_stream_offset (stream) - shstrtab_offset - (sizeof (".rel") - 1);
             }
 
-            memcpy (pos, section->name, name_len);
-            pos[name_len] = '\0';
-            pos += name_len + 1;
+            output_stream_write (stream, section->name, strlen (section->name) + 1);
 
             shdr_p++;
         }
 
-        shstrshdr_p->sh_size = pos - saved_pos;
+        shstrshdr_p->sh_size = output_stream_offset (stream) - shstrtab_offset;
     }
 
-    pos = file;
-
-    memcpy (pos, &ehdr, sizeof (ehdr));
-
-    if (fwrite (file, file_size, 1, outfile) != 1) {
-        ld_error ("writing '%s' file failed", filename);
-    }
+    output_stream_pad_to (stream, ehdr.e_phoff);
+    output_stream_write (stream, tables, file_size - ehdr.e_phoff);
     
-    free (file);
-    fclose (outfile);
+    free (tables);
+    output_stream_close (stream);
 }
 
 #define CHECK_READ(memory_position, size_to_read) \
     do { if (((memory_position) - file + (size_to_read) > file_size) \
              || (memory_position) < file) ld_fatal_error ("corrupted input file"); } while (0)
 
+/* The parts of reading an ELF32 object which depend only on the file itself
+ * (decoding the symbol table, symbol names and relocations)
+ * can be done in advance by elf_stage_object () on a worker thread,
+ * like coff_stage_object () does for COFF. */
+struct elf_staged_object {
+    struct Elf32_Sym_internal *symbols;
+    char **symbol_names;
+    Elf32_Word num_symbols;
+    struct Elf32_Rel_internal **rels;
+    struct Elf32_Rela_internal **relas;
+    Elf32_Half num_sections;
+};
+
+#define STAGE_CHECK_READ(memory_position, size_to_read) \
+    (((memory_position) - file + (size_to_read) > file_size) || (memory_position) < file)
+
+/* Must not report anything (it runs on a worker thread),
+ * so it returns NULL for anything unusual
+ * and the file is then read without staging, which reports the problems. */
+struct elf_staged_object *elf_stage_object (const unsigned char *file, size_t file_size)
+{
+    struct elf_staged_object *staged;
+    struct Elf32_Ehdr_internal ehdr;
+    struct Elf32_Shdr_internal shdr;
+    const unsigned char *pos;
+    int file_endianess;
+    Elf32_Half i;
+    Elf32_Half symtab_index = 0;
+
+    pos = file;
+    if (STAGE_CHECK_READ (pos, SIZEOF_struct_Elf32_Ehdr_file)) return NULL;
+
+    if (file[EI_MAG0] != ELFMAG0
+        || file[EI_MAG1] != ELFMAG1
+        || file[EI_MAG2] != ELFMAG2
+        || file[EI_MAG3] != ELFMAG3
+        || file[EI_CLASS] != ELFCLASS32) return NULL;
+
+    if (file[EI_DATA] == ELFDATA2LSB) {
+        file_endianess = LITTLE_ENDIAN;
+    } else if (file[EI_DATA] == ELFDATA2MSB) {
+        file_endianess = BIG_ENDIAN;
+    } else return NULL;
+
+    read_struct_Elf32_Ehdr (&ehdr, pos, file_endianess);
+
+    if (ehdr.e_type != ET_REL
+        || ehdr.e_shoff == 0
+        || ehdr.e_shnum == 0
+        || ehdr.e_shentsize < SIZEOF_struct_Elf32_Shdr_file) return NULL;
+
+    pos = file + ehdr.e_shoff;
+    if (STAGE_CHECK_READ (pos, ehdr.e_shentsize * ehdr.e_shnum)) return NULL;
+
+    for (i = 1; i < ehdr.e_shnum; i++) {
+        pos = file + ehdr.e_shoff + i * ehdr.e_shentsize;
+        read_struct_Elf32_Shdr (&shdr, pos, file_endianess);
+
+        if (shdr.sh_type == SHT_SYMTAB) {
+            if (symtab_index) return NULL;
+            symtab_index = i;
+        } else if ((shdr.sh_type == SHT_RELA || shdr.sh_type == SHT_REL)
+                   && shdr.sh_size) {
+            if ((shdr.sh_type == SHT_RELA
+                 && shdr.sh_entsize != SIZEOF_struct_Elf32_Rela_file)
+                || (shdr.sh_type == SHT_REL
+                    && shdr.sh_entsize != SIZEOF_struct_Elf32_Rel_file)) return NULL;
+            if (STAGE_CHECK_READ (file + shdr.sh_offset, shdr.sh_size)) return NULL;
+        }
+    }
+
+    staged = xcalloc (1, sizeof (*staged));
+    staged->num_sections = ehdr.e_shnum;
+    staged->rels = xcalloc (ehdr.e_shnum, sizeof (*staged->rels));
+    staged->relas = xcalloc (ehdr.e_shnum, sizeof (*staged->relas));
+
+    if (symtab_index) {
+        struct Elf32_Shdr_internal strtabhdr;
+        const char *sym_strtab;
+        Elf32_Word j;
+
+        pos = file + ehdr.e_shoff + symtab_index * ehdr.e_shentsize;
+        read_struct_Elf32_Shdr (&shdr, pos, file_endianess);
+
+        if (shdr.sh_link == 0 || shdr.sh_link >= ehdr.e_shnum
+            || shdr.sh_entsize < SIZEOF_struct_Elf32_Sym_file
+            || STAGE_CHECK_READ (file + shdr.sh_offset, shdr.sh_size)) {
+            elf_staged_object_free (staged);
+            return NULL;
+        }
+
+        pos = file + ehdr.e_shoff + shdr.sh_link * ehdr.e_shentsize;
+        read_struct_Elf32_Shdr (&strtabhdr, pos, file_endianess);
+
+        if (strtabhdr.sh_type != SHT_STRTAB
+            || STAGE_CHECK_READ (file + strtabhdr.sh_offset, strtabhdr.sh_size)) {
+            elf_staged_object_free (staged);
+            return NULL;
+        }
+        sym_strtab = (const char *)file + strtabhdr.sh_offset;
+
+        staged->num_symbols = shdr.sh_size / shdr.sh_entsize;
+        staged->symbols = xmalloc (sizeof (*staged->symbols) * (staged->num_symbols + 1));
+        staged->symbol_names = xcalloc (staged->num_symbols + 1, sizeof (*staged->symbol_names));
+        read_struct_Elf32_Sym_entries (staged->symbols, file + shdr.sh_offset,
+                                       staged->num_symbols, shdr.sh_entsize, file_endianess);
+
+        for (j = 1; j < staged->num_symbols; j++) {
+            if (staged->symbols[j].st_name >= strtabhdr.sh_size) {
+                elf_staged_object_free (staged);
+                return NULL;
+            }
+
+            if (sym_strtab[staged->symbols[j].st_name] == '\0') {
+                staged->symbol_names[j] = xstrdup (UNNAMED_SYMBOL_NAME);
+            } else {
+                staged->symbol_names[j] = xstrdup (sym_strtab + staged->symbols[j].st_name);
+            }
+        }
+    }
+
+    for (i = 1; i < ehdr.e_shnum; i++) {
+        size_t count;
+
+        pos = file + ehdr.e_shoff + i * ehdr.e_shentsize;
+        read_struct_Elf32_Shdr (&shdr, pos, file_endianess);
+
+        if ((shdr.sh_type != SHT_RELA
+             && shdr.sh_type != SHT_REL)
+            || shdr.sh_size == 0) continue;
+
+        count = shdr.sh_size / shdr.sh_entsize;
+        pos = file + shdr.sh_offset;
+
+        if (shdr.sh_type == SHT_RELA) {
+            staged->relas[i] = xmalloc (sizeof (*staged->relas[i]) * count);
+            read_struct_Elf32_Rela_entries (staged->relas[i], pos, count, file_endianess);
+        } else {
+            staged->rels[i] = xmalloc (sizeof (*staged->rels[i]) * count);
+            read_struct_Elf32_Rel_entries (staged->rels[i], pos, count, file_endianess);
+        }
+    }
+
+    return staged;
+}
+
+void elf_staged_object_free (struct elf_staged_object *staged)
+{
+    Elf32_Word j;
+    Elf32_Half i;
+
+    for (j = 0; j < staged->num_symbols; j++) {
+        free (staged->symbol_names[j]);
+    }
+    for (i = 0; i < staged->num_sections; i++) {
+        free (staged->rels[i]);
+        free (staged->relas[i]);
+    }
+
+    free (staged->symbols);
+    free (staged->symbol_names);
+    free (staged->rels);
+    free (staged->relas);
+    free (staged);
+}
+
 static int read_elf64_object (unsigned char *file, size_t file_size, const char *filename);
 
-static int read_elf_object (unsigned char *file, size_t file_size, const char *filename)
+static int read_elf_object (unsigned char *file, size_t file_size, const char *filename, struct elf_staged_object *staged)
 {
     struct Elf32_Ehdr_internal ehdr;
     struct Elf32_Shdr_internal shdr;
@@ -1177,10 +1323,9 @@ static int read_elf_object (unsigned char *file, size_t file_size, const char *f
                 part->content_size = shdr.sh_size;
                 if (shdr.sh_type != SHT_NOBITS) {
                     pos = file + shdr.sh_offset;
-                    part->content = xmalloc (part->content_size);
-
                     CHECK_READ (pos, part->content_size);
-                    memcpy (part->content, pos, part->content_size);
+                    part->content = pos;
+                    part->content_is_view = 1;
                 }
 
                 if (section->is_bss) {
@@ -1199,6 +1344,7 @@ static int read_elf_object (unsigned char *file, size_t file_size, const char *f
         const char *sym_strtab;
         Elf32_Word sym_strtab_size;
         Elf32_Word j;
+        struct Elf32_Sym_internal *elf_symbols;
         
         pos = file + ehdr.e_shoff + i * ehdr.e_shentsize;
         read_struct_Elf32_Shdr (&shdr, pos, endianess);
@@ -1232,14 +1378,22 @@ static int read_elf_object (unsigned char *file, size_t file_size, const char *f
             ld_fatal_error ("symbol table sh_entsize is too small");
         }
 
+        if (staged) {
+            elf_symbols = staged->symbols;
+            staged->symbols = NULL;
+        } else {
+            elf_symbols = xmalloc (sizeof (*elf_symbols) * (shdr.sh_size / shdr.sh_entsize + 1));
+            read_struct_Elf32_Sym_entries (elf_symbols, pos, shdr.sh_size / shdr.sh_entsize, shdr.sh_entsize, endianess);
+        }
+
         for (j = 1; j < shdr.sh_size / shdr.sh_entsize; j++) {
-            struct Elf32_Sym_internal elf_symbol;
+            struct Elf32_Sym_internal elf_symbol = elf_symbols[j];
             struct symbol *symbol = of->symbol_array + j;
-            
-            pos = file + shdr.sh_offset + j * shdr.sh_entsize;
-            read_struct_Elf32_Sym (&elf_symbol, pos, endianess);
 
-            if (elf_symbol.st_name < sym_strtab_size) {
+            if (staged) {
+                symbol->name = staged->symbol_names[j];
+                staged->symbol_names[j] = NULL;
+            } else if (elf_symbol.st_name < sym_strtab_size) {
                 if (sym_strtab[elf_symbol.st_name] == '\0') {
                     symbol->name = xstrdup (UNNAMED_SYMBOL_NAME);
                 } else {
@@ -1333,6 +1487,8 @@ static int read_elf_object (unsigned char *file, size_t file_size, const char *f
                 symbol->flags |= SYMBOL_FLAG_SECTION_SYMBOL;
             }
         }
+
+        free (elf_symbols);
     }
 
     for (i = 1; i < ehdr.e_shnum; i++) {
@@ -1374,22 +1530,42 @@ static int read_elf_object (unsigned char *file, size_t file_size, const char *f
         part->relocation_array = xcalloc (part->relocation_count, sizeof *part->relocation_array);
 
         if (shdr.sh_type == SHT_RELA) {
+            struct Elf32_Rela_internal *relas;
+
+            if (staged) {
+                relas = staged->relas[i];
+                staged->relas[i] = NULL;
+            } else {
+                relas = xmalloc (sizeof (*relas) * part->relocation_count);
+                read_struct_Elf32_Rela_entries (relas, pos, part->relocation_count, endianess);
+            }
+            
             for (j = 0; j < part->relocation_count; j++) {
-                struct Elf32_Rela_internal rela;
                 struct Elf32_Rel_internal rel;
                 
-                read_struct_Elf32_Rela (&rela, pos + shdr.sh_entsize * j, endianess);
-                rel.r_offset = rela.r_offset;
-                rel.r_info = rela.r_info;
-                part->relocation_array[j].addend = rela.r_addend;
+                rel.r_offset = relas[j].r_offset;
+                rel.r_info = relas[j].r_info;
+                part->relocation_array[j].addend = relas[j].r_addend;
                 translate_relocation (part->relocation_array + j, &rel, part);
             }
+
+            free (relas);
         } else {
+            struct Elf32_Rel_internal *rels;
+
+            if (staged) {
+                rels = staged->rels[i];
+                staged->rels[i] = NULL;
+            } else {
+                rels = xmalloc (sizeof (*rels) * part->relocation_count);
+                read_struct_Elf32_Rel_entries (rels, pos, part->relocation_count, endianess);
+            }
+            
             for (j = 0; j < part->relocation_count; j++) {
-                struct Elf32_Rel_internal rel;
-                read_struct_Elf32_Rel (&rel, pos + shdr.sh_entsize * j, endianess);
-                translate_relocation (part->relocation_array + j, &rel, part);
+                translate_relocation (part->relocation_array + j, rels + j, part);
             }
+
+            free (rels);
         }
     }
 
@@ -1565,10 +1741,9 @@ static int read_elf64_object (unsigned char *file, size_t file_size, const char
                 part->content_size = shdr_p->sh_size;
                 if (shdr_p->sh_type != SHT_NOBITS) {
                     pos = file + shdr_p->sh_offset;
-                    part->content = xmalloc (part->content_size);
-
                     CHECK_READ (pos, part->content_size);
-                    memcpy (part->content, pos, part->content_size);
+                    part->content = pos;
+                    part->content_is_view = 1;
                 }
 
                 if (section->is_bss) {
@@ -1785,9 +1960,15 @@ int elf_read (unsigned char *file, size_t file_size, const char *filename)
         && file[EI_MAG1] == ELFMAG1
         && file[EI_MAG2] == ELFMAG2
         && file[EI_MAG3] == ELFMAG3) {
-        if (read_elf_object (file, file_size, filename)) return INPUT_FILE_ERROR;
+        if (read_elf_object (file, file_size, filename, NULL)) return INPUT_FILE_ERROR;
         return INPUT_FILE_FINISHED;
     }
 
     return INPUT_FILE_UNRECOGNIZED;
 }
+
+int elf_read_staged_object (struct elf_staged_object *staged, unsigned char *file, size_t file_size, const char *filename)
+{
+    if (read_elf_object (file, file_size, filename, staged)) return INPUT_FILE_ERROR;
+    return INPUT_FILE_FINISHED;
+}
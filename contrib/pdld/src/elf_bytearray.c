@@ -18,7 +18,7 @@
 #include "elf_bytearray.h"
 
 #define COPY(struct_name, field_name, bytes) \
- bytearray_read_##bytes##_bytes (&struct_name##_internal->field_name, struct_name##_file->field_name, endianess)
+ struct_name##_internal->field_name = BYTEARRAY_READ_##bytes (struct_name##_file->field_name, endianess)
 #define COPY_CHAR_ARRAY(struct_name, field_name) memcpy (struct_name##_internal->field_name, struct_name##_file->field_name, sizeof (struct_name##_file->field_name))
 
 void read_struct_Elf32_Ehdr (struct Elf32_Ehdr_internal *Elf32_Ehdr_internal, const void *memory, int endianess)
@@ -87,6 +87,90 @@ void read_struct_Elf32_Rela (struct Elf32_Rela_internal *Elf32_Rela_internal, co
     COPY(Elf32_Rela, r_addend, 4);
 }
 
+/* Tables are decoded with the endianness checked once per table
+ * instead of once per field. */
+void read_struct_Elf32_Sym_entries (struct Elf32_Sym_internal *Elf32_Sym_entries, const void *memory, size_t count, size_t entry_size, int endianess)
+{
+    const unsigned char *pos = memory;
+    size_t i;
+
+    if (endianess == LITTLE_ENDIAN) {
+        for (i = 0; i < count; i++, pos += entry_size) {
+            const struct Elf32_Sym_file *file = (const void *) pos;
+            struct Elf32_Sym_internal *entry = Elf32_Sym_entries + i;
+
+            entry->st_name = BYTEARRAY_READ_4_LE (file->st_name);
+            entry->st_value = BYTEARRAY_READ_4_LE (file->st_value);
+            entry->st_size = BYTEARRAY_READ_4_LE (file->st_size);
+            entry->st_info = file->st_info[0];
+            entry->st_other = file->st_other[0];
+            entry->st_shndx = BYTEARRAY_READ_2_LE (file->st_shndx);
+        }
+    } else {
+        for (i = 0; i < count; i++, pos += entry_size) {
+            const struct Elf32_Sym_file *file = (const void *) pos;
+            struct Elf32_Sym_internal *entry = Elf32_Sym_entries + i;
+
+            entry->st_name = BYTEARRAY_READ_4_BE (file->st_name);
+            entry->st_value = BYTEARRAY_READ_4_BE (file->st_value);
+            entry->st_size = BYTEARRAY_READ_4_BE (file->st_size);
+            entry->st_info = file->st_info[0];
+            entry->st_other = file->st_other[0];
+            entry->st_shndx = BYTEARRAY_READ_2_BE (file->st_shndx);
+        }
+    }
+}
+
+void read_struct_Elf32_Rel_entries (struct Elf32_Rel_internal *Elf32_Rel_entries, const void *memory, size_t count, int endianess)
+{
+    const unsigned char *pos = memory;
+    size_t i;
+
+    if (endianess == LITTLE_ENDIAN) {
+        for (i = 0; i < count; i++, pos += SIZEOF_struct_Elf32_Rel_file) {
+            const struct Elf32_Rel_file *file = (const void *) pos;
+            struct Elf32_Rel_internal *entry = Elf32_Rel_entries + i;
+
+            entry->r_offset = BYTEARRAY_READ_4_LE (file->r_offset);
+            entry->r_info = BYTEARRAY_READ_4_LE (file->r_info);
+        }
+    } else {
+        for (i = 0; i < count; i++, pos += SIZEOF_struct_Elf32_Rel_file) {
+            const struct Elf32_Rel_file *file = (const void *) pos;
+            struct Elf32_Rel_internal *entry = Elf32_Rel_entries + i;
+
+            entry->r_offset = BYTEARRAY_READ_4_BE (file->r_offset);
+            entry->r_info = BYTEARRAY_READ_4_BE (file->r_info);
+        }
+    }
+}
+
+void read_struct_Elf32_Rela_entries (struct Elf32_Rela_internal *Elf32_Rela_entries, const void *memory, size_t count, int endianess)
+{
+    const unsigned char *pos = memory;
+    size_t i;
+
+    if (endianess == LITTLE_ENDIAN) {
+        for (i = 0; i < count; i++, pos += SIZEOF_struct_Elf32_Rela_file) {
+            const struct Elf32_Rela_file *file = (const void *) pos;
+            struct Elf32_Rela_internal *entry = Elf32_Rela_entries + i;
+
+            entry->r_offset = BYTEARRAY_READ_4_LE (file->r_offset);
+            entry->r_info = BYTEARRAY_READ_4_LE (file->r_info);
+            entry->r_addend = BYTEARRAY_READ_4_LE (file->r_addend);
+        }
+    } else {
+        for (i = 0; i < count; i++, pos += SIZEOF_struct_Elf32_Rela_file) {
+            const struct Elf32_Rela_file *file = (const void *) pos;
+            struct Elf32_Rela_internal *entry = Elf32_Rela_entries + i;
+
+            entry->r_offset = BYTEARRAY_READ_4_BE (file->r_offset);
+            entry->r_info = BYTEARRAY_READ_4_BE (file->r_info);
+            entry->r_addend = BYTEARRAY_READ_4_BE (file->r_addend);
+        }
+    }
+}
+
 void read_struct_Elf32_Phdr (struct Elf32_Phdr_internal *Elf32_Phdr_internal, const void *memory, int endianess)
 {
     const struct Elf32_Phdr_file *Elf32_Phdr_file = memory;
@@ -105,7 +189,7 @@ void read_struct_Elf32_Phdr (struct Elf32_Phdr_internal *Elf32_Phdr_internal, co
 #undef COPY
 
 #define COPY(struct_name, field_name, bytes) \
- bytearray_write_##bytes##_bytes (struct_name##_file->field_name, struct_name##_internal->field_name, endianess)
+ BYTEARRAY_WRITE_##bytes (struct_name##_file->field_name, struct_name##_internal->field_name, endianess)
 #define COPY_CHAR_ARRAY(struct_name, field_name) memcpy (struct_name##_file->field_name, struct_name##_internal->field_name, sizeof (struct_name##_file->field_name))
 
 void write_struct_Elf32_Ehdr (void *memory, const struct Elf32_Ehdr_internal *Elf32_Ehdr_internal, int endianess)
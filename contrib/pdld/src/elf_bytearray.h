@@ -15,6 +15,10 @@ void read_struct_Elf32_Rel (struct Elf32_Rel_internal *Elf32_Rel_internal, const
 void read_struct_Elf32_Rela (struct Elf32_Rela_internal *Elf32_Rela_internal, const void *memory, int endianess);
 void read_struct_Elf32_Phdr (struct Elf32_Phdr_internal *Elf32_Phdr_internal, const void *memory, int endianess);
 
+void read_struct_Elf32_Sym_entries (struct Elf32_Sym_internal *Elf32_Sym_entries, const void *memory, size_t count, size_t entry_size, int endianess);
+void read_struct_Elf32_Rel_entries (struct Elf32_Rel_internal *Elf32_Rel_entries, const void *memory, size_t count, int endianess);
+void read_struct_Elf32_Rela_entries (struct Elf32_Rela_internal *Elf32_Rela_entries, const void *memory, size_t count, int endianess);
+
 void write_struct_Elf32_Ehdr (void *memory, const struct Elf32_Ehdr_internal *Elf32_Ehdr_internal, int endianess);
 void write_struct_Elf32_Shdr (void *memory, const struct Elf32_Shdr_internal *Elf32_Shdr_internal, int endianess);
 void write_struct_Elf32_Sym (void *memory, const struct Elf32_Sym_internal *Elf32_Sym_internal, int endianess);
@@ -339,9 +339,9 @@ static int read_hunk_object (unsigned char *file,
 
             part->content_size = size;
             if (type != HUNK_BSS) {
-                part->content = xmalloc (part->content_size);
                 CHECK_READ (pos, part->content_size);
-                memcpy (part->content, pos, part->content_size);
+                part->content = pos;
+                part->content_is_view = 1;
                 pos += size;
             }
 
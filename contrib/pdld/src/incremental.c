@@ -0,0 +1,659 @@
+/******************************************************************************
+ * @file            incremental.c
+ *
+ * Released to the public domain.
+ *
+ * Anyone and anything may copy, edit, publish, use, compile, sell and
+ * distribute this work and all its parts in any form for any purpose,
+ * commercial and non-commercial, without any restrictions, without
+ * complying with any conditions and by any means.
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ld.h"
+#include "xmalloc.h"
+
+/* Incremental linking keeps a state file next to the output file.
+ * It records hashes of the options and of all input files,
+ * the layout of all section parts and the relocated contents of the parts.
+ *
+ * When nothing changed since the last link, the output is left alone.
+ * Otherwise all inputs are read again, but if the parts still fit
+ * into the layout of the last link (code parts are given some padding
+ * to make that likely, other parts must keep their size), the parts
+ * of unchanged input files which only reference unchanged input files
+ * take their relocated contents from the state file
+ * and do not need to be relocated again. The output file is then
+ * patched in place, only the bytes which changed are written.
+ *
+ * The state file is text with the part contents appended:
+ *
+ *     pdld-incremental 1
+ *     options HASH1 HASH2
+ *     output SIZE HASH1 HASH2
+ *     input SIZE HASH1 HASH2 NAME_LENGTH NAME
+ *     part RVA CONTENT_SIZE PADDING CONTENT_OFFSET SECTION_NAME_LENGTH SECTION_NAME FILENAME_LENGTH FILENAME
+ *     contents SIZE
+ *     <SIZE bytes>
+ *
+ * CONTENT_OFFSET is 0 for parts without content, otherwise 1 + offset.
+ */
+#define STATE_FILE_SUFFIX ".incr"
+#define STATE_FILE_MAGIC "pdld-incremental 1\n"
+
+struct file_hash {
+    unsigned long size;
+    unsigned long hash1, hash2;
+};
+
+struct saved_input {
+    const char *name;
+    size_t name_len;
+    struct file_hash hash;
+};
+
+struct saved_part {
+    address_type rva;
+    address_type content_size;
+    address_type padding;
+    unsigned long content_offset;
+    const char *section_name;
+    size_t section_name_len;
+    const char *filename;
+    size_t filename_len;
+};
+
+struct current_input {
+    const char *name;
+    struct file_hash hash;
+    int exists;
+    int changed;
+};
+
+static char *state_filename;
+static char *new_state_filename;
+
+static struct file_hash options_hash;
+
+static struct current_input *current_inputs;
+static size_t num_current_inputs;
+
+static struct {
+    unsigned char *memory;
+    size_t size;
+    int mapped;
+
+    int valid;
+    struct file_hash options_hash;
+    struct file_hash output_hash;
+
+    struct saved_input *inputs;
+    size_t num_inputs;
+
+    struct saved_part *parts;
+    size_t num_parts;
+
+    const unsigned char *contents;
+    unsigned long contents_size;
+} saved;
+
+/* Saved parts matching the current parts (in link order)
+ * or NULL when the previous layout cannot be reused. */
+static struct saved_part **matched_parts;
+static int layout_reused;
+
+/* Current parts in link order, recorded after relocation. */
+static struct section_part **linked_parts;
+static size_t num_linked_parts;
+
+static void hash_memory (struct file_hash *hash, const unsigned char *memory, size_t size)
+{
+    unsigned long hash1 = hash->hash1;
+    unsigned long hash2 = hash->hash2;
+    size_t i;
+
+    /* FNV-1a and DJB2 together, so a collision needs both to collide. */
+    for (i = 0; i < size; i++) {
+        hash1 = ((hash1 ^ memory[i]) * 16777619LU) & 0xFFFFFFFFLU;
+        hash2 = ((hash2 << 5) + hash2 + memory[i]) & 0xFFFFFFFFLU;
+    }
+
+    hash->hash1 = hash1;
+    hash->hash2 = hash2;
+    hash->size += size;
+}
+
+static void hash_init (struct file_hash *hash)
+{
+    hash->size = 0;
+    hash->hash1 = 2166136261LU;
+    hash->hash2 = 5381;
+}
+
+static int hash_file (const char *filename, struct file_hash *hash)
+{
+    unsigned char *memory;
+    size_t size;
+    int mapped;
+
+    hash_init (hash);
+    if (map_file_into_memory (filename, &memory, &size, &mapped)) return 1;
+
+    hash_memory (hash, memory, size);
+    unmap_file_from_memory (memory, size, mapped);
+
+    return 0;
+}
+
+static int hashes_equal (const struct file_hash *hash1, const struct file_hash *hash2)
+{
+    return (hash1->size == hash2->size
+            && hash1->hash1 == hash2->hash1
+            && hash1->hash2 == hash2->hash2);
+}
+
+static int parse_number (const unsigned char **pos_p, const unsigned char *end, unsigned long *number_p)
+{
+    const unsigned char *pos = *pos_p;
+    unsigned long number = 0;
+
+    if (pos == end || *pos < '0' || *pos > '9') return 1;
+
+    while (pos != end && *pos >= '0' && *pos <= '9') {
+        number = number * 10 + (*pos - '0');
+        pos++;
+    }
+
+    if (pos != end && *pos == ' ') pos++;
+
+    *pos_p = pos;
+    *number_p = number;
+
+    return 0;
+}
+
+static int parse_hash (const unsigned char **pos_p, const unsigned char *end, struct file_hash *hash)
+{
+    return (parse_number (pos_p, end, &hash->size)
+            || parse_number (pos_p, end, &hash->hash1)
+            || parse_number (pos_p, end, &hash->hash2));
+}
+
+static int parse_name (const unsigned char **pos_p, const unsigned char *end, const char **name_p, size_t *name_len_p)
+{
+    unsigned long len;
+
+    if (parse_number (pos_p, end, &len)) return 1;
+    if ((unsigned long) (end - *pos_p) < len) return 1;
+
+    *name_p = (const char *) *pos_p;
+    *name_len_p = len;
+    *pos_p += len;
+
+    if (*pos_p != end && **pos_p == ' ') (*pos_p)++;
+
+    return 0;
+}
+
+static int parse_keyword (const unsigned char **pos_p, const unsigned char *end, const char *keyword)
+{
+    size_t len = strlen (keyword);
+
+    if ((size_t) (end - *pos_p) < len + 1
+        || memcmp (*pos_p, keyword, len)
+        || (*pos_p)[len] != ' ') return 1;
+
+    *pos_p += len + 1;
+
+    return 0;
+}
+
+static int parse_end_of_line (const unsigned char **pos_p, const unsigned char *end)
+{
+    if (*pos_p == end || **pos_p != '\n') return 1;
+    (*pos_p)++;
+
+    return 0;
+}
+
+static int parse_state (void)
+{
+    const unsigned char *pos = saved.memory;
+    const unsigned char *end = saved.memory + saved.size;
+    size_t max_inputs = 0, max_parts = 0;
+    struct file_hash options_size_hash;
+
+    if (saved.size < strlen (STATE_FILE_MAGIC)
+        || memcmp (pos, STATE_FILE_MAGIC, strlen (STATE_FILE_MAGIC))) return 1;
+    pos += strlen (STATE_FILE_MAGIC);
+
+    if (parse_keyword (&pos, end, "options")
+        || parse_hash (&pos, end, &options_size_hash)
+        || parse_end_of_line (&pos, end)) return 1;
+    saved.options_hash = options_size_hash;
+
+    if (parse_keyword (&pos, end, "output")
+        || parse_hash (&pos, end, &saved.output_hash)
+        || parse_end_of_line (&pos, end)) return 1;
+
+    while (parse_keyword (&pos, end, "input") == 0) {
+        struct saved_input *input;
+
+        if (saved.num_inputs == max_inputs) {
+            max_inputs = max_inputs ? max_inputs * 2 : 16;
+            saved.inputs = xrealloc (saved.inputs, sizeof (*saved.inputs) * max_inputs);
+        }
+        input = &saved.inputs[saved.num_inputs++];
+
+        if (parse_hash (&pos, end, &input->hash)
+            || parse_name (&pos, end, &input->name, &input->name_len)
+            || parse_end_of_line (&pos, end)) return 1;
+    }
+
+    while (parse_keyword (&pos, end, "part") == 0) {
+        struct saved_part *part;
+
+        if (saved.num_parts == max_parts) {
+            max_parts = max_parts ? max_parts * 2 : 64;
+            saved.parts = xrealloc (saved.parts, sizeof (*saved.parts) * max_parts);
+        }
+        part = &saved.parts[saved.num_parts++];
+
+        if (parse_number (&pos, end, &part->rva)
+            || parse_number (&pos, end, &part->content_size)
+            || parse_number (&pos, end, &part->padding)
+            || parse_number (&pos, end, &part->content_offset)
+            || parse_name (&pos, end, &part->section_name, &part->section_name_len)
+            || parse_name (&pos, end, &part->filename, &part->filename_len)
+            || parse_end_of_line (&pos, end)) return 1;
+    }
+
+    if (parse_keyword (&pos, end, "contents")
+        || parse_number (&pos, end, &saved.contents_size)
+        || parse_end_of_line (&pos, end)
+        || (unsigned long) (end - pos) != saved.contents_size) return 1;
+    saved.contents = pos;
+
+    {
+        size_t i;
+
+        for (i = 0; i < saved.num_parts; i++) {
+            if (saved.parts[i].content_offset
+                && (saved.parts[i].content_offset - 1 > saved.contents_size
+                    || saved.parts[i].content_size > saved.contents_size - (saved.parts[i].content_offset - 1))) return 1;
+        }
+    }
+
+    return 0;
+}
+
+void incremental_init (int argc, char **argv, char **input_filenames)
+{
+    int i;
+    size_t output_filename_len = strlen (ld_state->output_filename);
+
+    state_filename = xmalloc (output_filename_len + strlen (STATE_FILE_SUFFIX) + 1);
+    memcpy (state_filename, ld_state->output_filename, output_filename_len);
+    strcpy (state_filename + output_filename_len, STATE_FILE_SUFFIX);
+
+    new_state_filename = xmalloc (strlen (state_filename) + 2);
+    strcpy (new_state_filename, state_filename);
+    strcat (new_state_filename, "~");
+
+    hash_init (&options_hash);
+    for (i = 1; i < argc; i++) {
+        hash_memory (&options_hash, (const unsigned char *) argv[i], strlen (argv[i]) + 1);
+    }
+
+    current_inputs = xmalloc (sizeof (*current_inputs) * (argc ? argc : 1));
+    num_current_inputs = 0;
+    for (i = 0; i < argc; i++) {
+        struct current_input *input;
+
+        if (input_filenames[i] == NULL) continue;
+
+        input = &current_inputs[num_current_inputs++];
+        input->name = input_filenames[i];
+        input->exists = !hash_file (input->name, &input->hash);
+        input->changed = 1;
+    }
+
+    if (map_file_into_memory (state_filename, &saved.memory, &saved.size, &saved.mapped)) {
+        saved.memory = NULL;
+        return;
+    }
+
+    if (parse_state ()) {
+        ld_warn ("ignoring invalid incremental linking state file '%s'", state_filename);
+        return;
+    }
+
+    if (!hashes_equal (&options_hash, &saved.options_hash)) return;
+
+    saved.valid = 1;
+
+    {
+        size_t j, k;
+
+        for (j = 0; j < num_current_inputs; j++) {
+            struct current_input *input = &current_inputs[j];
+
+            if (!input->exists) continue;
+
+            for (k = 0; k < saved.num_inputs; k++) {
+                if (strlen (input->name) == saved.inputs[k].name_len
+                    && memcmp (input->name, saved.inputs[k].name, saved.inputs[k].name_len) == 0) {
+                    input->changed = !hashes_equal (&input->hash, &saved.inputs[k].hash);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+int incremental_output_is_up_to_date (void)
+{
+    struct file_hash output_hash;
+    size_t i;
+
+    if (!saved.valid) return 0;
+
+    /* Those files are not recorded in the state. */
+    if (ld_state->output_map_filename || ld_state->output_implib_filename) return 0;
+
+    if (num_current_inputs != saved.num_inputs) return 0;
+    for (i = 0; i < num_current_inputs; i++) {
+        if (current_inputs[i].changed) return 0;
+    }
+
+    if (hash_file (ld_state->output_filename, &output_hash)
+        || !hashes_equal (&output_hash, &saved.output_hash)) return 0;
+
+    return 1;
+}
+
+/* Archive members are named "archive(member)",
+ * so they changed if the archive changed. */
+static int object_file_input_changed (const struct object_file *of)
+{
+    size_t i;
+
+    /* Parts generated by the linker are always generated again
+     * and depend only on the unchanged layout. */
+    if (strcmp (of->filename, FAKE_LD_FILENAME) == 0) return 0;
+
+    for (i = 0; i < num_current_inputs; i++) {
+        size_t len = strlen (current_inputs[i].name);
+
+        if (strncmp (of->filename, current_inputs[i].name, len) == 0
+            && (of->filename[len] == '\0' || of->filename[len] == '(')) {
+            return current_inputs[i].changed;
+        }
+    }
+
+    return 1;
+}
+
+/* Only code is padded because other sections
+ * often rely on their parts being next to each other
+ * (import tables, constructor lists). */
+static int part_is_padded (const struct section_part *part)
+{
+    return ((part->section->flags & SECTION_FLAG_CODE)
+            && part->content != NULL
+            && strcmp (part->of->filename, FAKE_LD_FILENAME) != 0);
+}
+
+static address_type calculate_padding (const struct section_part *part)
+{
+    address_type reserved;
+
+    if (!part_is_padded (part)) return 0;
+
+    reserved = ALIGN (part->content_size + part->content_size / 4 + 16, 16);
+
+    return reserved - part->content_size;
+}
+
+void incremental_set_padding (void)
+{
+    struct object_file *of;
+    struct section *section;
+    struct section_part *part;
+    size_t num_parts = 0, i;
+
+    for (of = all_object_files; of; of = of->next) {
+        of->changed = object_file_input_changed (of);
+    }
+
+    for (section = all_sections; section; section = section->next) {
+        for (part = section->first_part; part; part = part->next) {
+            num_parts++;
+        }
+    }
+
+    layout_reused = saved.valid && num_parts == saved.num_parts;
+    matched_parts = xmalloc (sizeof (*matched_parts) * (num_parts ? num_parts : 1));
+
+    for (i = 0, section = all_sections; section; section = section->next) {
+        for (part = section->first_part; part; part = part->next, i++) {
+            struct saved_part *saved_part;
+
+            matched_parts[i] = NULL;
+            if (!layout_reused) continue;
+
+            saved_part = &saved.parts[i];
+            if (strlen (section->name) != saved_part->section_name_len
+                || memcmp (section->name, saved_part->section_name, saved_part->section_name_len)
+                || strlen (part->of->filename) != saved_part->filename_len
+                || memcmp (part->of->filename, saved_part->filename, saved_part->filename_len)
+                || part->content_size > saved_part->content_size + saved_part->padding
+                || (!part_is_padded (part) && part->content_size != saved_part->content_size)) {
+                layout_reused = 0;
+                continue;
+            }
+
+            matched_parts[i] = saved_part;
+        }
+    }
+
+    for (i = 0, section = all_sections; section; section = section->next) {
+        for (part = section->first_part; part; part = part->next, i++) {
+            if (layout_reused) {
+                part->padding = 0;
+                if (part_is_padded (part)) {
+                    part->padding = matched_parts[i]->content_size + matched_parts[i]->padding - part->content_size;
+                }
+            } else {
+                part->padding = calculate_padding (part);
+            }
+        }
+    }
+}
+
+static int part_can_use_saved_content (const struct section_part *part, const struct saved_part *saved_part)
+{
+    size_t i;
+
+    if (part->of->changed
+        || strcmp (part->of->filename, FAKE_LD_FILENAME) == 0
+        || part->content == NULL
+        || saved_part->content_offset == 0
+        || part->content_size != saved_part->content_size) return 0;
+
+    for (i = 0; i < part->relocation_count; i++) {
+        const struct symbol *symbol = part->relocation_array[i].symbol;
+
+        if (part->relocation_array[i].howto->size == 0) continue;
+
+        /* Value of the target symbol must not have changed. */
+        if (symbol == NULL
+            || symbol->part == NULL
+            || symbol->part->of->changed) return 0;
+    }
+
+    return 1;
+}
+
+void incremental_use_saved_contents (void)
+{
+    struct section *section;
+    struct section_part *part;
+    struct file_hash output_hash;
+    size_t i;
+
+    if (!layout_reused) return;
+
+    /* Parts with the same sizes in the same order
+     * normally end up at the same RVAs, but that needs to be checked. */
+    for (i = 0, section = all_sections; section; section = section->next) {
+        for (part = section->first_part; part; part = part->next, i++) {
+            if (part->rva != matched_parts[i]->rva) return;
+        }
+    }
+
+    /* Only the output of the last link can be patched. */
+    if (hash_file (ld_state->output_filename, &output_hash) == 0
+        && hashes_equal (&output_hash, &saved.output_hash)) {
+        ld_state->patch_output_in_place = 1;
+    }
+
+    for (i = 0, section = all_sections; section; section = section->next) {
+        for (part = section->first_part; part; part = part->next, i++) {
+            if (!part_can_use_saved_content (part, matched_parts[i])) continue;
+
+            if (!part->content_is_view) free (part->content);
+            part->content = (unsigned char *) saved.contents + matched_parts[i]->content_offset - 1;
+            part->content_is_view = 1;
+            part->already_relocated = 1;
+        }
+    }
+}
+
+void incremental_record_parts (void)
+{
+    struct section *section;
+    struct section_part *part;
+    size_t i;
+
+    num_linked_parts = 0;
+    for (section = all_sections; section; section = section->next) {
+        for (part = section->first_part; part; part = part->next) {
+            num_linked_parts++;
+        }
+    }
+
+    linked_parts = xmalloc (sizeof (*linked_parts) * (num_linked_parts ? num_linked_parts : 1));
+    for (i = 0, section = all_sections; section; section = section->next) {
+        for (part = section->first_part; part; part = part->next) {
+            linked_parts[i++] = part;
+        }
+    }
+}
+
+static void write_name (FILE *outfile, const char *name)
+{
+    fprintf (outfile, "%lu %s", (unsigned long) strlen (name), name);
+}
+
+static void write_hash (FILE *outfile, const struct file_hash *hash)
+{
+    fprintf (outfile, "%lu %lu %lu", hash->size, hash->hash1, hash->hash2);
+}
+
+void incremental_save_state (void)
+{
+    FILE *outfile;
+    struct file_hash output_hash;
+    unsigned long contents_size = 0;
+    size_t i;
+    int failed;
+
+    if (linked_parts == NULL) return;
+
+    if (hash_file (ld_state->output_filename, &output_hash)) {
+        ld_error ("failed to read '%s' for incremental linking", ld_state->output_filename);
+        return;
+    }
+
+    if ((outfile = fopen (new_state_filename, "wb")) == NULL) {
+        ld_error ("failed to open '%s' for writing", new_state_filename);
+        return;
+    }
+
+    fputs (STATE_FILE_MAGIC, outfile);
+
+    fputs ("options ", outfile);
+    write_hash (outfile, &options_hash);
+    fputs ("\noutput ", outfile);
+    write_hash (outfile, &output_hash);
+    fputs ("\n", outfile);
+
+    for (i = 0; i < num_current_inputs; i++) {
+        if (!current_inputs[i].exists) continue;
+
+        fputs ("input ", outfile);
+        write_hash (outfile, &current_inputs[i].hash);
+        fputs (" ", outfile);
+        write_name (outfile, current_inputs[i].name);
+        fputs ("\n", outfile);
+    }
+
+    for (i = 0; i < num_linked_parts; i++) {
+        const struct section_part *part = linked_parts[i];
+
+        fprintf (outfile, "part %lu %lu %lu %lu ",
+                 part->rva,
+                 part->content_size,
+                 part->padding,
+                 part->content ? contents_size + 1 : 0);
+        write_name (outfile, part->section->name);
+        fputs (" ", outfile);
+        write_name (outfile, part->of->filename);
+        fputs ("\n", outfile);
+
+        if (part->content) contents_size += part->content_size;
+    }
+
+    fprintf (outfile, "contents %lu\n", contents_size);
+    for (i = 0; i < num_linked_parts; i++) {
+        const struct section_part *part = linked_parts[i];
+
+        if (part->content && part->content_size) {
+            fwrite (part->content, part->content_size, 1, outfile);
+        }
+    }
+
+    failed = ferror (outfile);
+    if (fclose (outfile) || failed) {
+        ld_error ("failed to write '%s'", new_state_filename);
+        remove (new_state_filename);
+        return;
+    }
+
+    /* The old state might be still mapped and in use until now. */
+    if (saved.memory) {
+        unmap_file_from_memory (saved.memory, saved.size, saved.mapped);
+        saved.memory = NULL;
+    }
+
+    remove (state_filename);
+    if (rename (new_state_filename, state_filename)) {
+        ld_error ("failed to rename '%s' to '%s'", new_state_filename, state_filename);
+    }
+}
+
+void incremental_destroy (void)
+{
+    if (saved.memory) unmap_file_from_memory (saved.memory, saved.size, saved.mapped);
+
+    free (saved.inputs);
+    free (saved.parts);
+    free (matched_parts);
+    free (linked_parts);
+    free (current_inputs);
+    free (state_filename);
+    free (new_state_filename);
+}
@@ -38,11 +38,23 @@ int main (int argc, char **argv)
         ld_fatal_error ("no input files");
     }
         
+    if (ld_state->incremental) {
+        incremental_init (argc, argv, input_filenames);
+        if (incremental_output_is_up_to_date ()) {
+            incremental_destroy ();
+            free (input_filenames);
+            return EXIT_SUCCESS;
+        }
+    }
+        
     symbols_init ();
+    sections_init ();
 
     if (ld_state->oformat == LD_OFORMAT_AOUT) aout_init ();
     else if (ld_state->oformat == LD_OFORMAT_ATARI) atari_init ();
 
+    input_files_preload (input_filenames, argc);
+
     for (i = 0; i < argc; i++) {
         if (input_filenames[i]) read_input_file (input_filenames[i]);
     }
@@ -78,9 +90,15 @@ int main (int argc, char **argv)
     }
     
     if (ld_state->output_map_filename) map_write (ld_state->output_map_filename);
+
+    if (ld_state->incremental) {
+        if (ld_get_error_count () == 0) incremental_save_state ();
+        incremental_destroy ();
+    }
     
     sections_destroy ();
     symbols_destroy ();
+    input_files_destroy ();
 
     free (input_filenames);
 
@@ -66,6 +66,14 @@ struct ld_state {
     int use_custom_base_address;
 
     int bits;
+
+    int threads;
+    int incremental;
+    int gc_sections;
+
+    /* Set by incremental linking when the output file is to be patched
+     * instead of written again, see output_stream_open (). */
+    int patch_output_in_place;
 };
 
 extern struct ld_state *ld_state;
@@ -160,6 +168,9 @@ struct object_file {
     struct symbol *symbol_array;
     size_t symbol_count;
 
+    /* Set by incremental linking when the input file changed. */
+    int changed;
+
 };
 
 struct section_part {
@@ -172,11 +183,19 @@ struct section_part {
     unsigned char *content;
     address_type content_size;
     address_type alignment;
+    /* Content points into an input file kept in memory and must not be freed. */
+    int content_is_view;
 
     struct reloc_entry *relocation_array;
     size_t relocation_count;
 
     address_type rva;
+    /* Zero bytes written after the content, see incremental.c. */
+    address_type padding;
+    int already_relocated;
+
+    /* Reachable from the roots, see --gc-sections. */
+    int marked;
 
 };
 
@@ -185,6 +204,7 @@ struct subsection {
     struct subsection *next;
 
     char *name;
+    struct section *section;
 
     struct section_part *first_part;
     struct section_part **last_part_p;
@@ -245,6 +265,18 @@ int ld_get_error_count (void);
 /* libld.c */
 char **ld_parse_args (int argc, char **argv, int start_index);
 int read_file_into_memory (const char *filename, unsigned char **memory_p, size_t *size_p);
+int map_file_into_memory (const char *filename, unsigned char **memory_p, size_t *size_p, int *mapped_p);
+void unmap_file_from_memory (unsigned char *memory, size_t size, int mapped);
+
+struct output_stream;
+struct output_stream *output_stream_open (const char *filename);
+void output_stream_write (struct output_stream *stream, const void *data, size_t size);
+void output_stream_write_view (struct output_stream *stream, const void *data, size_t size);
+void output_stream_write_zeros (struct output_stream *stream, size_t size);
+void output_stream_pad_to (struct output_stream *stream, size_t offset);
+size_t output_stream_offset (const struct output_stream *stream);
+void output_stream_patch (struct output_stream *stream, size_t offset, const void *data, size_t size);
+int output_stream_close (struct output_stream *stream);
 
 /* link.c */
 void link (void);
@@ -253,6 +285,7 @@ void link (void);
 void aout_init ();
 address_type aout_get_base_address (void);
 void aout_write (const char *filename);
+int aout_is_object (const unsigned char *file, size_t file_size);
 int aout_read (unsigned char *file, size_t file_size, const char *filename);
 
 /* atari.c */
@@ -276,6 +309,11 @@ void coff_after_link (void);
 void coff_write (const char *filename);
 int coff_read (unsigned char *file, size_t file_size, const char *filename);
 
+struct coff_staged_object;
+struct coff_staged_object *coff_stage_object (const unsigned char *file, size_t file_size);
+void coff_staged_object_free (struct coff_staged_object *staged);
+int coff_read_staged_object (struct coff_staged_object *staged, unsigned char *file, size_t file_size, const char *filename);
+
 void coff_archive_end (void);
 
 void coff_print_help (void);
@@ -288,9 +326,23 @@ address_type elf_get_base_address (void);
 void elf_write (const char *filename);
 int elf_read (unsigned char *file, size_t file_size, const char *filename);
 
+struct elf_staged_object;
+struct elf_staged_object *elf_stage_object (const unsigned char *file, size_t file_size);
+void elf_staged_object_free (struct elf_staged_object *staged);
+int elf_read_staged_object (struct elf_staged_object *staged, unsigned char *file, size_t file_size, const char *filename);
+
 /* hunk.c */
 int hunk_read (unsigned char *file, size_t file_size, const char *filename);
 
+/* incremental.c */
+void incremental_init (int argc, char **argv, char **input_filenames);
+int incremental_output_is_up_to_date (void);
+void incremental_set_padding (void);
+void incremental_use_saved_contents (void);
+void incremental_record_parts (void);
+void incremental_save_state (void);
+void incremental_destroy (void);
+
 /* lx.c */
 void lx_import_generate_import_with_dll_name (const char *import_name,
                                               short OrdinalHint,
@@ -327,16 +379,21 @@ void map_write (const char *filename);
 #define INPUT_FILE_FINISHED        1
 #define INPUT_FILE_ERROR           2
 #define INPUT_FILE_UNRECOGNIZED    3
+void input_files_preload (char **filenames, int count);
 void read_input_file (const char *filename);
+void input_files_destroy (void);
 
 /* sections.c */
+void sections_init (void);
 struct section *section_find (const char *name);
 struct section *section_find_or_make (const char *name);
 void section_write (struct section *section, unsigned char *memory);
+void section_write_to_stream (struct section *section, struct output_stream *stream);
 int section_count (void);
 
 struct subsection *subsection_find (struct section *section, const char *name);
 struct subsection *subsection_find_or_make (struct section *section, const char *name);
+void section_sort_subsections (struct section *section);
 
 struct section_part *section_part_new (struct section *section, struct object_file *of);
 void section_append_section_part (struct section *section, struct section_part *part);
@@ -346,6 +403,8 @@ struct object_file *object_file_make (size_t symbol_count, const char *filename)
 
 void sections_destroy (void);
 void sections_destroy_empty_before_collapse (void);
+void section_discard (struct section *section);
+void sections_discard_unmarked_parts (void);
 
 /* symbols.c */
 void symbols_init (void);
@@ -353,6 +412,7 @@ void symbols_destroy (void);
 struct symbol *symbol_find (const char *name);
 void symbol_add_to_hashtab (struct symbol *symbol);
 void symbol_remove_from_hashtab (struct symbol *symbol);
+void symbols_set_undefined_symbol_callback (void (*callback) (const struct symbol *));
 void symbol_record_external_symbol (struct symbol *symbol);
 int symbol_is_undefined (const struct symbol *symbol);
 address_type symbol_get_value_with_base (const struct symbol *symbol);
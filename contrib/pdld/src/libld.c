@@ -8,10 +8,25 @@
  * commercial and non-commercial, without any restrictions, without
  * complying with any conditions and by any means.
  *****************************************************************************/
+/* LD_USE_MMAP is defined by the Unix makefiles. */
+#ifdef  LD_USE_MMAP
+# ifndef    _POSIX_C_SOURCE
+#  define   _POSIX_C_SOURCE             200112L
+# endif
+# define    READ_FILE_USE_MMAP
+# define    WRITE_FILE_USE_WRITEV
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef  LD_USE_MMAP
+# include   <sys/mman.h>
+# include   <sys/stat.h>
+# include   <sys/uio.h>
+#endif
+
 #include "ld.h"
 #include "xmalloc.h"
 #include "options.h"
@@ -21,13 +36,17 @@ enum option_index {
     LD_OPTION_IGNORED = 0,
     LD_OPTION_EMIT_RELOCS,
     LD_OPTION_ENTRY,
+    LD_OPTION_GC_SECTIONS,
     LD_OPTION_HELP,
+    LD_OPTION_INCREMENTAL,
     LD_OPTION_MAP,
     LD_OPTION_MAP_FILE,
+    LD_OPTION_NO_GC_SECTIONS,
     LD_OPTION_OUTPUT,
     LD_OPTION_OFORMAT,
     LD_OPTION_OUT_IMPLIB,
     LD_OPTION_SHARED_LIBRARY,
+    LD_OPTION_THREADS,
     LD_OPTION_VERSION,
     LD_OPTION_VERSION_LONG
 
@@ -51,9 +70,12 @@ static const struct long_option long_options[] = {
     
     { STR_AND_LEN("Bshareable"), LD_OPTION_SHARED_LIBRARY, OPTION_NO_ARG},
     { STR_AND_LEN("entry"), LD_OPTION_ENTRY, OPTION_HAS_ARG},
+    { STR_AND_LEN("gc-sections"), LD_OPTION_GC_SECTIONS, OPTION_NO_ARG},
     { STR_AND_LEN("help"), LD_OPTION_HELP, OPTION_NO_ARG},
+    { STR_AND_LEN("incremental"), LD_OPTION_INCREMENTAL, OPTION_NO_ARG},
     { STR_AND_LEN("print-map"), LD_OPTION_MAP, OPTION_NO_ARG},
     { STR_AND_LEN("Map"), LD_OPTION_MAP_FILE, OPTION_HAS_ARG},
+    { STR_AND_LEN("no-gc-sections"), LD_OPTION_NO_GC_SECTIONS, OPTION_NO_ARG},
     { STR_AND_LEN("omagic"), LD_OPTION_IGNORED, OPTION_NO_ARG},
     { STR_AND_LEN("nostdlib"), LD_OPTION_IGNORED, OPTION_NO_ARG},
     { STR_AND_LEN("output"), LD_OPTION_OUTPUT, OPTION_HAS_ARG},
@@ -62,6 +84,7 @@ static const struct long_option long_options[] = {
     { STR_AND_LEN("emit-relocs"), LD_OPTION_EMIT_RELOCS, OPTION_NO_ARG},
     { STR_AND_LEN("shared"), LD_OPTION_SHARED_LIBRARY, OPTION_NO_ARG},
     { STR_AND_LEN("strip-all"), LD_OPTION_IGNORED, OPTION_NO_ARG},
+    { STR_AND_LEN("threads"), LD_OPTION_THREADS, OPTION_HAS_ARG},
     { STR_AND_LEN("version"), LD_OPTION_VERSION_LONG, OPTION_NO_ARG},
     { NULL, 0, 0}
 
@@ -73,9 +96,12 @@ static void print_help (void)
     printf ("Usage: %s [options] file...\n", program_name ? program_name : "pdld");
     printf ("Options:\n");
     printf ("  -e ADDRESS, --entry ADDRESS Set start address\n");
+    printf ("  --gc-sections               Remove unused section parts\n");
     printf ("  --help                      Print option help\n");
+    printf ("  --incremental               Reuse the previous link of the same output when possible\n");
     printf ("  -M, --print-map             Print map file on standard output\n");
     printf ("  -Map FILE                   Write a linker map to FILE\n");
+    printf ("  --no-gc-sections            Keep all section parts (default)\n");
     printf ("  -N, --omagic                Ignored\n");
     printf ("  -nostdlib                   Ignored\n");
     printf ("  -o FILE, --output FILE      Set output file name\n");
@@ -86,6 +112,7 @@ static void print_help (void)
     printf ("  -q, --emit-relocs           Generate relocations in final output\n");
     printf ("  -shared, -Bshareable        Create a shared library\n");
     printf ("  -s, --strip-all             Ignored\n");
+    printf ("  --threads N                 Use N threads for loading input files and relocating\n");
     printf ("  -v, --version               Print version information\n");
     
     coff_print_help ();
@@ -120,10 +147,18 @@ static void use_option (int option_index, char *arg)
             }
             break;
 
+        case LD_OPTION_GC_SECTIONS:
+            ld_state->gc_sections = 1;
+            break;
+
         case LD_OPTION_HELP:
             print_help ();
             break;
 
+        case LD_OPTION_INCREMENTAL:
+            ld_state->incremental = 1;
+            break;
+
         case LD_OPTION_MAP:
             ld_state->output_map_filename = "";
             break;
@@ -132,6 +167,10 @@ static void use_option (int option_index, char *arg)
             ld_state->output_map_filename = arg;
             break;
 
+        case LD_OPTION_NO_GC_SECTIONS:
+            ld_state->gc_sections = 0;
+            break;
+
         case LD_OPTION_OUTPUT:
             ld_state->output_filename = arg;
             break;
@@ -169,6 +208,20 @@ static void use_option (int option_index, char *arg)
             ld_state->create_shared_library = 1;
             break;
 
+        case LD_OPTION_THREADS:
+            {
+                char *endptr;
+                long threads = strtol (arg, &endptr, 10);
+
+                if (*arg == '\0' || *endptr != '\0' || threads < 1) {
+                    ld_error ("invalid number of threads '%s'", arg);
+                    break;
+                }
+
+                ld_state->threads = threads;
+            }
+            break;
+
         case LD_OPTION_VERSION:
             printf ("pdld %i.%i\n", LD_MAJOR_VERSION, LD_MINOR_VERSION);
             ld_state->no_input_files_is_fine = 1;
@@ -324,7 +377,8 @@ int read_file_into_memory (const char *filename, unsigned char **memory_p, size_
 
         read_bytes += change;
         if (read_bytes == mem_size) {
-            mem_size += READ_MEM_INCREMENT;
+            /* Growing geometrically so large archives are not copied over and over. */
+            mem_size *= 2;
             memory = xrealloc (memory, mem_size + 2);
         }
 
@@ -340,3 +394,346 @@ int read_file_into_memory (const char *filename, unsigned char **memory_p, size_
 
     return 0;
 }
+
+#define MMAP_MIN_PAGE_SIZE 4096
+
+/* Maps the file privately if possible, so it can be parsed in place
+ * and only the pages which are written to (archive member headers,
+ * relocated section contents) get copied.
+ * Otherwise the file is read using read_file_into_memory (). */
+int map_file_into_memory (const char *filename, unsigned char **memory_p, size_t *size_p, int *mapped_p)
+{
+    *mapped_p = 0;
+    
+#ifdef READ_FILE_USE_MMAP
+    {
+        FILE *infile;
+        struct stat st;
+
+        if ((infile = fopen (filename, "rb")) == NULL) return 1;
+
+        /* The 2 zero bytes read_file_into_memory () appends
+         * are provided by the rest of the last page
+         * only if the file does not end too close to the page end.
+         * (Checked against the smallest page size in use,
+         *  which all larger page sizes are multiples of.) */
+        if (fstat (fileno (infile), &st) == 0
+            && S_ISREG (st.st_mode)
+            && st.st_size % MMAP_MIN_PAGE_SIZE != 0
+            && st.st_size % MMAP_MIN_PAGE_SIZE <= MMAP_MIN_PAGE_SIZE - 2) {
+            void *p = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno (infile), 0);
+
+            if (p != MAP_FAILED) {
+                fclose (infile);
+                *memory_p = p;
+                *size_p = st.st_size;
+                *mapped_p = 1;
+                return 0;
+            }
+        }
+
+        fclose (infile);
+    }
+#endif
+
+    return read_file_into_memory (filename, memory_p, size_p);
+}
+
+void unmap_file_from_memory (unsigned char *memory, size_t size, int mapped)
+{
+#ifdef READ_FILE_USE_MMAP
+    if (mapped) {
+        munmap (memory, size);
+        return;
+    }
+#endif
+
+    free (memory);
+}
+
+/* Output files are written sequentially without building the whole image
+ * in memory first. Section contents are written directly
+ * from where they are, other data is copied into a small buffer.
+ * Both are collected into batches written by a single writev () call. */
+#define OUTPUT_STREAM_BUFFER_SIZE 65536
+#define OUTPUT_STREAM_MAX_IOVECS 64
+#define OUTPUT_STREAM_ZEROS_SIZE 4096
+
+static const unsigned char output_stream_zeros[OUTPUT_STREAM_ZEROS_SIZE] = {0};
+
+struct output_stream {
+    FILE *file;
+    const char *filename;
+    size_t offset;
+    int failed;
+
+    /* Previous contents of the file when it is patched in place
+     * (see ld_state->patch_output_in_place), NULL otherwise. */
+    unsigned char *old_memory;
+    size_t old_size;
+    int old_mapped;
+
+#ifdef WRITE_FILE_USE_WRITEV
+    unsigned char *buffer;
+    size_t buffer_used;
+
+    struct iovec iovecs[OUTPUT_STREAM_MAX_IOVECS];
+    int iovec_count;
+#endif
+};
+
+static void output_stream_failed (struct output_stream *stream)
+{
+    if (!stream->failed) ld_error ("writing '%s' file failed", stream->filename);
+    stream->failed = 1;
+}
+
+struct output_stream *output_stream_open (const char *filename)
+{
+    struct output_stream *stream;
+    FILE *file = NULL;
+    unsigned char *old_memory = NULL;
+    size_t old_size = 0;
+    int old_mapped = 0;
+
+    if (ld_state->patch_output_in_place
+        && strcmp (filename, ld_state->output_filename) == 0
+        && map_file_into_memory (filename, &old_memory, &old_size, &old_mapped) == 0) {
+        if (!(file = fopen (filename, "r+b"))) {
+            unmap_file_from_memory (old_memory, old_size, old_mapped);
+            old_memory = NULL;
+        }
+    }
+
+    if (!file && !(file = fopen (filename, "wb"))) {
+        ld_error ("cannot open '%s' for writing", filename);
+        return NULL;
+    }
+
+    stream = xmalloc (sizeof (*stream));
+    stream->file = file;
+    stream->filename = filename;
+    stream->offset = 0;
+    stream->failed = 0;
+
+    stream->old_memory = old_memory;
+    stream->old_size = old_size;
+    stream->old_mapped = old_mapped;
+
+#ifdef WRITE_FILE_USE_WRITEV
+    stream->buffer = xmalloc (OUTPUT_STREAM_BUFFER_SIZE);
+    stream->buffer_used = 0;
+    stream->iovec_count = 0;
+#endif
+
+    return stream;
+}
+
+static void output_stream_flush (struct output_stream *stream)
+{
+#ifdef WRITE_FILE_USE_WRITEV
+    struct iovec *iov = stream->iovecs;
+    int count = stream->iovec_count;
+
+    while (count && !stream->failed) {
+        long written = writev (fileno (stream->file), iov, count);
+
+        if (written < 0) {
+            output_stream_failed (stream);
+            break;
+        }
+
+        /* Skips what was written and retries the rest. */
+        while (count && (size_t) written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    stream->iovec_count = 0;
+    stream->buffer_used = 0;
+#endif
+}
+
+#ifdef WRITE_FILE_USE_WRITEV
+static void output_stream_queue (struct output_stream *stream, const void *data, size_t size)
+{
+    if (stream->iovec_count) {
+        struct iovec *last = &stream->iovecs[stream->iovec_count - 1];
+
+        if ((const char *) last->iov_base + last->iov_len == data) {
+            last->iov_len += size;
+            return;
+        }
+    }
+    
+    if (stream->iovec_count == OUTPUT_STREAM_MAX_IOVECS) output_stream_flush (stream);
+
+    stream->iovecs[stream->iovec_count].iov_base = (void *) data;
+    stream->iovecs[stream->iovec_count].iov_len = size;
+    stream->iovec_count++;
+}
+#endif
+
+/* Writes only the range of the data which differs from the previous contents,
+ * so unchanged parts of the file are left alone. */
+static void output_stream_write_in_place (struct output_stream *stream, const void *data, size_t size)
+{
+    const unsigned char *new_data = data;
+    const unsigned char *old_data = stream->old_memory + stream->offset;
+    size_t old_left = stream->offset < stream->old_size ? stream->old_size - stream->offset : 0;
+    size_t start = 0, end = size;
+
+    while (start < end && start < old_left && new_data[start] == old_data[start]) start++;
+
+    if (end <= old_left) {
+        while (end > start && new_data[end - 1] == old_data[end - 1]) end--;
+    }
+
+    if (start < end && !stream->failed) {
+        if (fseek (stream->file, stream->offset + start, SEEK_SET)
+            || fwrite (new_data + start, end - start, 1, stream->file) != 1) {
+            output_stream_failed (stream);
+        }
+    }
+
+    stream->offset += size;
+}
+
+/* The file patched in place is longer than the new contents
+ * and C90 cannot truncate files, so the new contents are read back
+ * and the file is written again. */
+static void output_stream_rewrite_shorter (struct output_stream *stream)
+{
+    unsigned char *memory = xmalloc (stream->offset + 1);
+    int failed;
+
+    failed = (fflush (stream->file)
+              || fseek (stream->file, 0, SEEK_SET)
+              || (stream->offset && fread (memory, stream->offset, 1, stream->file) != 1));
+    if (fclose (stream->file)) failed = 1;
+
+    stream->file = NULL;
+
+    if (!failed
+        && (stream->file = fopen (stream->filename, "wb"))
+        && stream->offset
+        && fwrite (memory, stream->offset, 1, stream->file) != 1) failed = 1;
+
+    if (failed || !stream->file) output_stream_failed (stream);
+
+    free (memory);
+}
+
+/* Data is copied, so it does not need to be kept. */
+void output_stream_write (struct output_stream *stream, const void *data, size_t size)
+{
+    if (stream->old_memory) {
+        output_stream_write_in_place (stream, data, size);
+        return;
+    }
+
+    stream->offset += size;
+
+#ifdef WRITE_FILE_USE_WRITEV
+    if (size > OUTPUT_STREAM_BUFFER_SIZE / 4) {
+        output_stream_queue (stream, data, size);
+        output_stream_flush (stream);
+        return;
+    }
+
+    if (stream->buffer_used + size > OUTPUT_STREAM_BUFFER_SIZE
+        || stream->iovec_count == OUTPUT_STREAM_MAX_IOVECS) {
+        output_stream_flush (stream);
+    }
+
+    memcpy (stream->buffer + stream->buffer_used, data, size);
+    output_stream_queue (stream, stream->buffer + stream->buffer_used, size);
+    stream->buffer_used += size;
+#else
+    if (size && fwrite (data, size, 1, stream->file) != 1) output_stream_failed (stream);
+#endif
+}
+
+/* Data is not copied, so it must be kept unchanged
+ * until the stream is closed. */
+void output_stream_write_view (struct output_stream *stream, const void *data, size_t size)
+{
+#ifdef WRITE_FILE_USE_WRITEV
+    if (stream->old_memory) {
+        output_stream_write_in_place (stream, data, size);
+        return;
+    }
+
+    stream->offset += size;
+    if (size) output_stream_queue (stream, data, size);
+#else
+    output_stream_write (stream, data, size);
+#endif
+}
+
+void output_stream_write_zeros (struct output_stream *stream, size_t size)
+{
+    while (size) {
+        size_t to_write = size < OUTPUT_STREAM_ZEROS_SIZE ? size : OUTPUT_STREAM_ZEROS_SIZE;
+
+        output_stream_write_view (stream, output_stream_zeros, to_write);
+        size -= to_write;
+    }
+}
+
+void output_stream_pad_to (struct output_stream *stream, size_t offset)
+{
+    if (offset > stream->offset) output_stream_write_zeros (stream, offset - stream->offset);
+}
+
+size_t output_stream_offset (const struct output_stream *stream)
+{
+    return stream->offset;
+}
+
+/* Overwrites already written data, for example headers
+ * which could not be finished before the rest of the file was written. */
+void output_stream_patch (struct output_stream *stream, size_t offset, const void *data, size_t size)
+{
+    output_stream_flush (stream);
+
+    if (stream->failed) return;
+
+    if (fseek (stream->file, offset, SEEK_SET)
+        || fwrite (data, size, 1, stream->file) != 1
+        || fseek (stream->file, stream->offset, SEEK_SET)) {
+        output_stream_failed (stream);
+    }
+}
+
+int output_stream_close (struct output_stream *stream)
+{
+    int failed;
+
+    output_stream_flush (stream);
+
+    if (stream->old_memory) {
+        /* The mapping must not outlive the file being shortened. */
+        unmap_file_from_memory (stream->old_memory, stream->old_size, stream->old_mapped);
+
+        if (stream->offset < stream->old_size && !stream->failed) output_stream_rewrite_shorter (stream);
+    }
+
+    if (stream->file && fclose (stream->file)) output_stream_failed (stream);
+
+    failed = stream->failed;
+
+#ifdef WRITE_FILE_USE_WRITEV
+    free (stream->buffer);
+#endif
+    free (stream);
+
+    return failed;
+}
@@ -12,9 +12,16 @@
 #include <string.h>
 #include <limits.h>
 
+/* LD_USE_PTHREADS is defined by the Unix makefiles, which also link with -pthread. */
+#ifdef  LD_USE_PTHREADS
+# define    LINK_USE_PTHREADS
+# include   <pthread.h>
+#endif
+
 #include "ld.h"
 #include "xmalloc.h"
 #include "bytearray.h"
+#include "hashtab.h"
 
 static void reloc_arm_26_pcrel (struct section_part *part,
                                 struct reloc_entry *rel,
@@ -418,10 +425,61 @@ static void reloc_generic (struct section_part *part,
     }
 }
 
-static void relocate_part (struct section_part *part)
+struct undefined_reference {
+    const struct section_part *part;
+    address_type offset;
+    const char *name;
+};
+
+/* Undefined references are collected and reported after relocating,
+ * so the order of the errors does not depend on how the parts
+ * were distributed between threads. */
+struct undefined_references {
+    struct undefined_reference *array;
+    size_t count;
+    size_t max;
+};
+
+static void undefined_references_add (struct undefined_references *undefined,
+                                      const struct section_part *part,
+                                      address_type offset,
+                                      const char *name)
+{
+    if (undefined->count == undefined->max) {
+        undefined->max = undefined->max ? undefined->max * 2 : 16;
+        undefined->array = xrealloc (undefined->array, sizeof (*undefined->array) * undefined->max);
+    }
+
+    undefined->array[undefined->count].part = part;
+    undefined->array[undefined->count].offset = offset;
+    undefined->array[undefined->count].name = name;
+    undefined->count++;
+}
+
+static void undefined_references_report (struct undefined_references *undefined)
+{
+    size_t i;
+
+    for (i = 0; i < undefined->count; i++) {
+        ld_error ("%s:(%s+0x%lx): undefined reference to '%s'",
+                  undefined->array[i].part->of->filename,
+                  undefined->array[i].part->section->name,
+                  undefined->array[i].offset,
+                  undefined->array[i].name);
+    }
+
+    free (undefined->array);
+    undefined->array = NULL;
+    undefined->count = undefined->max = 0;
+}
+
+static void relocate_part (struct section_part *part, struct undefined_references *undefined)
 {
     struct reloc_entry *relocs;
     size_t i;
+
+    /* Contents were relocated by previous incremental link. */
+    if (part->already_relocated) return;
     
     relocs = part->relocation_array;
     for (i = 0; i < part->relocation_count; i++) {
@@ -429,31 +487,12 @@ static void relocate_part (struct section_part *part)
 
         if (relocs[i].howto->size == 0) continue;
 
+        /* External symbols were already replaced by their definitions
+         * by resolve_relocation_symbols (). */
         symbol = relocs[i].symbol;
         if (symbol_is_undefined (symbol)) {
-            if ((symbol = symbol_find (symbol->name)) == NULL) {
-                symbol = relocs[i].symbol;
-                ld_internal_error_at_source (__FILE__, __LINE__,
-                                             "external symbol '%s' not found in hashtab",
-                                             symbol->name);
-            }
-            if ((ld_state->oformat == LD_OFORMAT_CMS
-                 || ld_state->oformat == LD_OFORMAT_MVS
-                 || ld_state->oformat == LD_OFORMAT_VSE)
-                && symbol_is_undefined (symbol)) {
-                /* Mainframe-only output formats need less strict matching. */
-                symbol = mainframe_symbol_find (symbol->name);
-            }
-            if (symbol_is_undefined (symbol)) {
-                
-                
-                ld_error ("%s:(%s+0x%lx): undefined reference to '%s'",
-                          part->of->filename,
-                          part->section->name,
-                          relocs[i].offset,
-                          symbol->name);
-                continue;
-            }
+            undefined_references_add (undefined, part, relocs[i].offset, symbol->name);
+            continue;
         }
         
         if (relocs[i].howto->special_function) {
@@ -465,6 +504,107 @@ static void relocate_part (struct section_part *part)
     }
 }
 
+struct resolved_symbol {
+    const struct symbol *symbol;
+    struct symbol *definition;
+};
+
+static hash_value_t hash_resolved_symbol (const void *p)
+{
+    const struct resolved_symbol *resolved = (const struct resolved_symbol *) p;
+    const unsigned char *bytes = (const unsigned char *) &resolved->symbol;
+    hash_value_t hash = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof (resolved->symbol); i++) {
+        hash = hash * 31 + bytes[i];
+    }
+    
+    return hash;
+}
+
+static int equal_resolved_symbol (const void *p1, const void *p2)
+{
+    const struct resolved_symbol *resolved1 = (const struct resolved_symbol *) p1;
+    const struct resolved_symbol *resolved2 = (const struct resolved_symbol *) p2;
+    
+    return resolved1->symbol == resolved2->symbol;
+}
+
+static void free_resolved_symbol (void *p)
+{
+    free (p);
+}
+
+static struct symbol *find_definition (const struct symbol *undefined_symbol)
+{
+    struct symbol *symbol;
+    
+    if ((symbol = symbol_find (undefined_symbol->name)) == NULL) {
+        ld_internal_error_at_source (__FILE__, __LINE__,
+                                     "external symbol '%s' not found in hashtab",
+                                     undefined_symbol->name);
+    }
+    if ((ld_state->oformat == LD_OFORMAT_CMS
+         || ld_state->oformat == LD_OFORMAT_MVS
+         || ld_state->oformat == LD_OFORMAT_VSE)
+        && symbol_is_undefined (symbol)) {
+        /* Mainframe-only output formats need less strict matching. */
+        symbol = mainframe_symbol_find (symbol->name);
+    }
+
+    return symbol;
+}
+
+/* Replaces undefined symbols referenced by relocations
+ * with the symbols from the global hashtab (defined ones if possible),
+ * so each undefined symbol of each object is looked up by name only once
+ * and the relocation loop needs no lookups.
+ * Symbols which remain undefined are reported when relocating. */
+static void resolve_relocation_symbols (void)
+{
+    struct hashtab *resolved_hashtab;
+    struct section *section;
+
+    resolved_hashtab = hashtab_create_hashtab (0,
+                                               hash_resolved_symbol,
+                                               equal_resolved_symbol,
+                                               &xmalloc,
+                                               &free);
+
+    for (section = all_sections; section; section = section->next) {
+        struct section_part *part;
+        
+        for (part = section->first_part; part; part = part->next) {
+            struct reloc_entry *relocs = part->relocation_array;
+            size_t i;
+
+            for (i = 0; i < part->relocation_count; i++) {
+                struct resolved_symbol fake, *resolved;
+
+                if (relocs[i].howto->size == 0) continue;
+                if (!symbol_is_undefined (relocs[i].symbol)) continue;
+
+                fake.symbol = relocs[i].symbol;
+                if ((resolved = (struct resolved_symbol *) hashtab_find (resolved_hashtab, &fake)) == NULL) {
+                    resolved = xmalloc (sizeof (*resolved));
+                    resolved->symbol = relocs[i].symbol;
+                    resolved->definition = find_definition (relocs[i].symbol);
+                    
+                    if (hashtab_insert (resolved_hashtab, resolved)) {
+                        ld_internal_error_at_source (__FILE__, __LINE__, "failed to insert resolved symbol into hashtab");
+                    }
+                }
+
+                relocs[i].symbol = resolved->definition;
+            }
+        }
+    }
+
+    hashtab_for_each_element (resolved_hashtab, &free_resolved_symbol);
+    hashtab_destroy_hashtab (resolved_hashtab);
+}
+
 static void collapse_subsections (void)
 {
     struct section *section;
@@ -472,6 +612,8 @@ static void collapse_subsections (void)
     for (section = all_sections; section; section = section->next) {
         struct subsection *subsection;
 
+        section_sort_subsections (section);
+
         for (subsection = section->all_subsections; subsection; subsection = subsection->next) {
             if (subsection->first_part) {
                 *section->last_part_p = subsection->first_part;
@@ -482,6 +624,154 @@ static void collapse_subsections (void)
     }
 }
 
+/* Parts in these sections are never referenced by relocations
+ * but are still needed (constructor tables, imports, exports, resources...),
+ * so they are always kept and everything they reference too. */
+static const char *const gc_kept_section_prefixes[] = {
+    ".ctors", ".dtors", ".init", ".fini", ".CRT", ".tls",
+    ".idata", ".edata", ".rsrc", ".reloc", ".pdata", ".xdata",
+    NULL
+};
+
+struct gc_worklist {
+    struct section_part **parts;
+    size_t count;
+    size_t max;
+};
+
+static struct gc_worklist gc_worklist = {NULL, 0, 0};
+
+static void gc_mark_part (struct section_part *part)
+{
+    if (part == NULL || part->marked) return;
+
+    part->marked = 1;
+    
+    if (gc_worklist.count == gc_worklist.max) {
+        gc_worklist.max = gc_worklist.max ? gc_worklist.max * 2 : 64;
+        gc_worklist.parts = xrealloc (gc_worklist.parts, sizeof (*gc_worklist.parts) * gc_worklist.max);
+    }
+
+    gc_worklist.parts[gc_worklist.count++] = part;
+}
+
+static void gc_mark_symbol (struct symbol *symbol)
+{
+    if (symbol && !symbol_is_undefined (symbol)) gc_mark_part (symbol->part);
+}
+
+static int gc_section_is_kept (const struct section *section)
+{
+    size_t i;
+
+    for (i = 0; gc_kept_section_prefixes[i]; i++) {
+        if (strncmp (section->name,
+                     gc_kept_section_prefixes[i],
+                     strlen (gc_kept_section_prefixes[i])) == 0) return 1;
+    }
+
+    return 0;
+}
+
+/* Debugging information references almost everything
+ * but must not keep anything alive, so it is kept without being followed.
+ * For ELF output non-allocated sections (.comment, .note...) are treated the same,
+ * but only ELF inputs use SECTION_FLAG_ALLOC for everything occupying memory,
+ * COFF inputs set it only for uninitialized data and use CODE/DATA for the rest. */
+static int gc_section_is_debugging (const struct section *section)
+{
+    if (section->flags & (SECTION_FLAG_DEBUGGING | SECTION_FLAG_EXCLUDE)) return 1;
+
+    if (ld_state->oformat == LD_OFORMAT_ELF
+        && !(section->flags & (SECTION_FLAG_ALLOC
+                               | SECTION_FLAG_LOAD
+                               | SECTION_FLAG_CODE
+                               | SECTION_FLAG_DATA))) return 1;
+
+    return (strncmp (section->name, ".debug", 6) == 0
+            || strncmp (section->name, ".stab", 5) == 0);
+}
+
+static void gc_mark_entry (void)
+{
+    struct symbol *symbol = NULL;
+    struct section *section;
+
+    if (ld_state->entry_symbol_name == NULL) {
+        symbol = symbol_find ("_mainCRTStartup");
+    } else if (ld_state->entry_symbol_name[0] != '\0') {
+        symbol = symbol_find (ld_state->entry_symbol_name);
+        if ((ld_state->oformat == LD_OFORMAT_CMS
+             || ld_state->oformat == LD_OFORMAT_MVS
+             || ld_state->oformat == LD_OFORMAT_VSE)
+            && !symbol) {
+            symbol = mainframe_symbol_find (ld_state->entry_symbol_name);
+        }
+    }
+
+    if (symbol && !symbol_is_undefined (symbol)) {
+        gc_mark_part (symbol->part);
+        return;
+    }
+
+    /* calculate_entry_point () falls back to the start of .text. */
+    section = section_find (".text");
+    if (section) gc_mark_part (section->first_part);
+}
+
+/* Keeps only the parts reachable through relocations from the entry point,
+ * exported symbols and the always kept sections.
+ * Must be done after resolve_relocation_symbols (),
+ * so relocations already point to the definitions. */
+static void gc_sections (void)
+{
+    struct section *section;
+    struct section_part *part;
+
+    /* Debugging parts are marked without being added to the worklist. */
+    for (section = all_sections; section; section = section->next) {
+        if (!gc_section_is_debugging (section)) continue;
+        
+        for (part = section->first_part; part; part = part->next) {
+            part->marked = 1;
+        }
+    }
+
+    gc_mark_entry ();
+
+    /* Exported symbols are referenced by .edata,
+     * only shared libraries not using it need all global symbols. */
+    if (ld_state->create_shared_library && ld_state->oformat != LD_OFORMAT_COFF) {
+        symbols_for_each_global (&gc_mark_symbol);
+    }
+
+    for (section = all_sections; section; section = section->next) {
+        int kept = gc_section_is_kept (section);
+
+        for (part = section->first_part; part; part = part->next) {
+            if (kept || strcmp (part->of->filename, FAKE_LD_FILENAME) == 0) {
+                gc_mark_part (part);
+            }
+        }
+    }
+
+    while (gc_worklist.count) {
+        size_t i;
+
+        part = gc_worklist.parts[--gc_worklist.count];
+        
+        for (i = 0; i < part->relocation_count; i++) {
+            gc_mark_symbol (part->relocation_array[i].symbol);
+        }
+    }
+
+    free (gc_worklist.parts);
+    gc_worklist.parts = NULL;
+    gc_worklist.max = 0;
+
+    sections_discard_unmarked_parts ();
+}
+
 static void calculate_section_sizes_and_rvas (void)
 {
     struct section *section;
@@ -517,23 +807,127 @@ static void calculate_section_sizes_and_rvas (void)
             }
 #endif       
             part->rva = rva;
-            section->total_size += part->content_size;
-            rva += part->content_size;
+            section->total_size += part->content_size + part->padding;
+            rva += part->content_size + part->padding;
+        }
+    }
+}
+
+#ifdef LINK_USE_PTHREADS
+
+struct relocation_task {
+    struct section_part **parts;
+    size_t part_count;
+    struct undefined_references undefined;
+    pthread_t thread;
+};
+
+static void *relocation_task_run (void *arg)
+{
+    struct relocation_task *task = arg;
+    size_t i;
+
+    for (i = 0; i < task->part_count; i++) {
+        relocate_part (task->parts[i], &task->undefined);
+    }
+
+    return NULL;
+}
+
+/* Parts write only into their own content
+ * and symbols do not change anymore, so the parts can be relocated
+ * in any order. Each thread gets a contiguous run of parts
+ * with about the same number of relocations. */
+static int relocate_sections_parallel (void)
+{
+    struct section *section;
+    struct section_part *part, **parts;
+    struct relocation_task *tasks;
+    size_t part_count = 0, total_relocs = 0;
+    size_t num_tasks, started, i, start;
+
+    for (section = all_sections; section; section = section->next) {
+        for (part = section->first_part; part; part = part->next) {
+            part_count++;
+            total_relocs += part->relocation_count;
         }
     }
+
+    num_tasks = ld_state->threads;
+    if (num_tasks > part_count) num_tasks = part_count;
+    if (num_tasks < 2) return 1;
+
+    parts = xmalloc (sizeof (*parts) * part_count);
+    i = 0;
+    for (section = all_sections; section; section = section->next) {
+        for (part = section->first_part; part; part = part->next) {
+            parts[i++] = part;
+        }
+    }
+
+    tasks = xcalloc (num_tasks, sizeof (*tasks));
+    for (i = 0, start = 0; i < num_tasks; i++) {
+        size_t end = start, relocs = 0;
+        size_t target = total_relocs / num_tasks + 1;
+
+        /* Each task gets at least one part and leaves at least one for every later task. */
+        do {
+            relocs += parts[end++]->relocation_count;
+        } while (end < part_count - (num_tasks - i - 1)
+                 && (i + 1 == num_tasks || relocs < target));
+        
+        tasks[i].parts = parts + start;
+        tasks[i].part_count = end - start;
+        start = end;
+    }
+
+    for (started = 0; started < num_tasks; started++) {
+        if (pthread_create (&tasks[started].thread, NULL, &relocation_task_run, &tasks[started])) break;
+    }
+
+    /* If not all threads could be started, the rest is relocated by this thread. */
+    for (i = started; i < num_tasks; i++) {
+        relocation_task_run (&tasks[i]);
+    }
+    
+    for (i = 0; i < started; i++) {
+        pthread_join (tasks[i].thread, NULL);
+    }
+
+    for (i = 0; i < num_tasks; i++) {
+        undefined_references_report (&tasks[i].undefined);
+    }
+
+    free (tasks);
+    free (parts);
+
+    return 0;
 }
 
+#endif /* LINK_USE_PTHREADS */
+
 static void relocate_sections (void)
 {
     struct section *section;
+    struct undefined_references undefined = {NULL, 0, 0};
+
+#ifdef LINK_USE_PTHREADS
+    if (ld_state->threads > 1 && relocate_sections_parallel () == 0) return;
+#else
+    if (ld_state->threads > 1) {
+        ld_warn ("--threads is not supported on this host, relocating using one thread");
+    }
+#endif
 
     for (section = all_sections; section; section = section->next) {
         struct section_part *part;
         
         for (part = section->first_part; part; part = part->next) {
-            relocate_part (part);
+            relocate_part (part, &undefined);
         }
     }
+
+    undefined_references_report (&undefined);
 }
 
 static void calculate_entry_point (void)
@@ -580,6 +974,12 @@ void link (void)
 {
     collapse_subsections ();
 
+    resolve_relocation_symbols ();
+
+    if (ld_state->gc_sections) gc_sections ();
+
+    if (ld_state->incremental) incremental_set_padding ();
+
     calculate_section_sizes_and_rvas ();
 
     if (!ld_state->use_custom_base_address) {
@@ -622,8 +1022,12 @@ void link (void)
         }
     }
 
+    if (ld_state->incremental) incremental_use_saved_contents ();
+
     relocate_sections ();
 
     calculate_entry_point ();
+
+    if (ld_state->incremental) incremental_record_parts ();
     
 }
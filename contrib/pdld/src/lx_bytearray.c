@@ -18,7 +18,7 @@
 #include "lx_bytearray.h"
 
 #define COPY(struct_name, field_name, bytes) \
- bytearray_read_##bytes##_bytes (&struct_name##_internal->field_name, struct_name##_file->field_name, LITTLE_ENDIAN)
+ struct_name##_internal->field_name = BYTEARRAY_READ_##bytes (struct_name##_file->field_name, LITTLE_ENDIAN)
 #define COPY_CHAR_ARRAY(struct_name, field_name) memcpy (struct_name##_internal->field_name, struct_name##_file->field_name, sizeof (struct_name##_file->field_name))
 
 void read_struct_LX_HEADER (struct LX_HEADER_internal *LX_HEADER_internal, const void *memory)
@@ -102,7 +102,7 @@ void read_struct_object_page_table_entry (struct object_page_table_entry_interna
 #undef COPY
 
 #define COPY(struct_name, field_name, bytes) \
- bytearray_write_##bytes##_bytes (struct_name##_file->field_name, struct_name##_internal->field_name, LITTLE_ENDIAN)
+ BYTEARRAY_WRITE_##bytes (struct_name##_file->field_name, struct_name##_internal->field_name, LITTLE_ENDIAN)
 #define COPY_CHAR_ARRAY(struct_name, field_name) memcpy (struct_name##_file->field_name, struct_name##_internal->field_name, sizeof (struct_name##_file->field_name))
 
 void write_struct_LX_HEADER (void *memory, const struct LX_HEADER_internal *LX_HEADER_internal)
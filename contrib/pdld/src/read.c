@@ -13,8 +13,14 @@
 #include <string.h>
 #include <ctype.h>
 
+#ifdef  LD_USE_PTHREADS
+# define    READ_USE_PTHREADS
+# include   <pthread.h>
+#endif
+
 #include "ld.h"
 #include "xmalloc.h"
+#include "hashtab.h"
 
 /* For archive reading. */
 #include "coff.h"
@@ -51,6 +57,18 @@ struct archive_longnames {
     unsigned long size;
 };
 
+/* Optional member written by xar after the first linker member:
+ * big-endian number of symbols and number of slots (a power of two),
+ * followed by the slots, each holding the index of a linker member symbol plus one
+ * (zero for empty slots), placed by FNV-1a of the name with linear probing.
+ * Other readers skip it like any other member. */
+#define ARCHIVE_SYMBOL_HASH_MEMBER_Name "/<SYMHASH>/"
+
+struct archive_symbol_hash {
+    const unsigned char *slots;
+    unsigned long slot_count;
+};
+
 static int read_archive_member_header (const unsigned char *pos,
                                        struct archive_member_header *hdr,
                                        const struct archive_longnames *longnames)
@@ -185,6 +203,330 @@ static int read_archive_member (unsigned char *file,
     return ret;
 }    
 
+struct archive_symbol_entry {
+    const char *name;
+    unsigned long index;
+    struct archive_symbol_entry *next_with_same_name;
+};
+
+struct archive_index_heap {
+    unsigned long *indices;
+    size_t count;
+    size_t max;
+};
+
+/* Archive symbol table indexed by name together with worklists of entries
+ * which should be checked during the current and the next pass.
+ * Resolvers of nested archives are chained, so undefined symbols
+ * introduced by a member of a nested archive are seen by all of them. */
+struct archive_resolver {
+    struct hashtab *entry_hashtab;
+    struct archive_symbol_entry *entries;
+    unsigned long NumberOfSymbols;
+
+    /* When the archive has a hashed symbol index,
+     * it is probed instead of building entry_hashtab. */
+    const struct lm_offset_name_entry *offset_name_table;
+    const struct archive_symbol_hash *symbol_hash;
+
+    struct archive_index_heap current_pass;
+    struct archive_index_heap next_pass;
+    unsigned long *queued_for_pass;
+    unsigned long pass;
+    unsigned long position;
+
+    struct archive_resolver *previous;
+};
+
+static struct archive_resolver *active_resolvers;
+
+static hash_value_t hash_archive_symbol_entry (const void *p)
+{
+    const struct archive_symbol_entry *entry = (const struct archive_symbol_entry *) p;
+    return hashtab_help_default_hash_string (entry->name);
+}
+
+static int equal_archive_symbol_entry (const void *p1, const void *p2)
+{
+    const struct archive_symbol_entry *entry1 = (const struct archive_symbol_entry *) p1;
+    const struct archive_symbol_entry *entry2 = (const struct archive_symbol_entry *) p2;
+    
+    return strcmp (entry1->name, entry2->name) == 0;
+}
+
+static void archive_index_heap_push (struct archive_index_heap *heap, unsigned long index)
+{
+    size_t i;
+    
+    if (heap->count == heap->max) {
+        heap->max = heap->max ? heap->max * 2 : 16;
+        heap->indices = xrealloc (heap->indices, sizeof (*heap->indices) * heap->max);
+    }
+
+    for (i = heap->count++; i && heap->indices[(i - 1) / 2] > index; i = (i - 1) / 2) {
+        heap->indices[i] = heap->indices[(i - 1) / 2];
+    }
+
+    heap->indices[i] = index;
+}
+
+static unsigned long archive_index_heap_pop (struct archive_index_heap *heap)
+{
+    unsigned long index = heap->indices[0];
+    unsigned long last = heap->indices[--heap->count];
+    size_t i, child;
+
+    for (i = 0; (child = i * 2 + 1) < heap->count; i = child) {
+        if (child + 1 < heap->count && heap->indices[child + 1] < heap->indices[child]) child++;
+        if (heap->indices[child] >= last) break;
+        heap->indices[i] = heap->indices[child];
+    }
+
+    if (heap->count) heap->indices[i] = last;
+
+    return index;
+}
+
+static unsigned long archive_symbol_hash_name (const char *name)
+{
+    unsigned long hash = 2166136261UL;
+
+    while (*name) {
+        hash ^= (unsigned char) *name++;
+        hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+    }
+
+    return hash;
+}
+
+static void archive_resolver_queue_index (struct archive_resolver *resolver, unsigned long index)
+{
+    /* Entries after the current position are still checked during the current pass,
+     * entries before it only during the next pass, same as when scanning linearly. */
+    if (index > resolver->position || resolver->position == (unsigned long)-1) {
+        if (resolver->queued_for_pass[index] >= resolver->pass) return;
+        resolver->queued_for_pass[index] = resolver->pass;
+        archive_index_heap_push (&resolver->current_pass, index);
+    } else {
+        if (resolver->queued_for_pass[index] > resolver->pass) return;
+        resolver->queued_for_pass[index] = resolver->pass + 1;
+        archive_index_heap_push (&resolver->next_pass, index);
+    }
+}
+
+static void archive_resolver_queue_symbol (struct archive_resolver *resolver, const char *name)
+{
+    struct archive_symbol_entry fake = { NULL };
+    const struct archive_symbol_entry *entry;
+
+    if (resolver->symbol_hash) {
+        const struct archive_symbol_hash *symbol_hash = resolver->symbol_hash;
+        unsigned long mask = symbol_hash->slot_count - 1;
+        unsigned long slot, index;
+
+        /* read_archive () accepts the table only if it has an empty slot,
+         * so the probing always stops. */
+        for (slot = archive_symbol_hash_name (name) & mask; ; slot = (slot + 1) & mask) {
+            index = BYTEARRAY_READ_4_BE (symbol_hash->slots + slot * 4);
+            if (index == 0) break;
+            if (index > resolver->NumberOfSymbols) continue;
+            if (strcmp (resolver->offset_name_table[index - 1].name, name)) continue;
+
+            archive_resolver_queue_index (resolver, index - 1);
+        }
+        
+        return;
+    }
+
+    fake.name = name;
+    for (entry = hashtab_find (resolver->entry_hashtab, &fake); entry; entry = entry->next_with_same_name) {
+        archive_resolver_queue_index (resolver, entry->index);
+    }
+}
+
+static void archive_resolvers_undefined_symbol (const struct symbol *symbol)
+{
+    struct archive_resolver *resolver;
+
+    for (resolver = active_resolvers; resolver; resolver = resolver->previous) {
+        archive_resolver_queue_symbol (resolver, symbol->name);
+    }
+}
+
+static void archive_resolver_init (struct archive_resolver *resolver,
+                                   const struct lm_offset_name_entry *offset_name_table,
+                                   unsigned long NumberOfSymbols,
+                                   const struct archive_symbol_hash *symbol_hash)
+{
+    unsigned long i;
+
+    memset (resolver, 0, sizeof (*resolver));
+    resolver->NumberOfSymbols = NumberOfSymbols;
+    resolver->offset_name_table = offset_name_table;
+    resolver->symbol_hash = symbol_hash;
+    resolver->queued_for_pass = xcalloc (NumberOfSymbols ? NumberOfSymbols : 1, sizeof (*resolver->queued_for_pass));
+
+    resolver->previous = active_resolvers;
+    active_resolvers = resolver;
+    symbols_set_undefined_symbol_callback (&archive_resolvers_undefined_symbol);
+
+    if (symbol_hash) return;
+
+    resolver->entries = xmalloc (sizeof (*resolver->entries) * (NumberOfSymbols ? NumberOfSymbols : 1));
+    resolver->entry_hashtab = hashtab_create_hashtab (0,
+                                                      hash_archive_symbol_entry,
+                                                      equal_archive_symbol_entry,
+                                                      &xmalloc,
+                                                      &free);
+
+    for (i = 0; i < NumberOfSymbols; i++) {
+        struct archive_symbol_entry *entry = &resolver->entries[i];
+        struct archive_symbol_entry *first;
+
+        entry->name = offset_name_table[i].name;
+        entry->index = i;
+        entry->next_with_same_name = NULL;
+
+        if ((first = (struct archive_symbol_entry *) hashtab_find (resolver->entry_hashtab, entry))) {
+            entry->next_with_same_name = first->next_with_same_name;
+            first->next_with_same_name = entry;
+        } else if (hashtab_insert (resolver->entry_hashtab, entry)) {
+            ld_internal_error_at_source (__FILE__, __LINE__, "failed to insert archive symbol '%s' into hashtab", entry->name);
+        }
+    }
+}
+
+static void archive_resolver_destroy (struct archive_resolver *resolver)
+{
+    active_resolvers = resolver->previous;
+    if (active_resolvers == NULL) symbols_set_undefined_symbol_callback (NULL);
+    
+    if (resolver->entry_hashtab) hashtab_destroy_hashtab (resolver->entry_hashtab);
+    free (resolver->current_pass.indices);
+    free (resolver->next_pass.indices);
+    free (resolver->queued_for_pass);
+    free (resolver->entries);
+}
+
+static void archive_resolver_queue_undefined_symbol (struct symbol *symbol)
+{
+    if (symbol_is_undefined (symbol)) archive_resolver_queue_symbol (active_resolvers, symbol->name);
+}
+
+/* Members are loaded in the same order as when repeatedly scanning
+ * the whole archive symbol table until no new member is loaded,
+ * but the table is only scanned once and later only the entries
+ * for symbols which became undefined are checked. */
+static int resolve_archive_symbols (unsigned char *file,
+                                    size_t file_size,
+                                    const char *archive_name,
+                                    const struct archive_longnames *longnames,
+                                    const struct lm_offset_name_entry *offset_name_table,
+                                    unsigned long NumberOfSymbols,
+                                    unsigned long start_header_object_offset,
+                                    unsigned long end_header_object_offset,
+                                    const struct archive_symbol_hash *symbol_hash)
+{
+    struct archive_resolver resolver;
+    unsigned long i;
+    int ret = INPUT_FILE_FINISHED;
+
+    archive_resolver_init (&resolver, offset_name_table, NumberOfSymbols, symbol_hash);
+
+    resolver.pass = 1;
+    resolver.position = (unsigned long)-1;
+    /* With the hashed symbol index the already undefined symbols are looked up
+     * instead of looking up every archive symbol. */
+    if (symbol_hash) {
+        symbols_for_each_global (&archive_resolver_queue_undefined_symbol);
+    } else {
+        for (i = 0; i < NumberOfSymbols; i++) {
+            const struct symbol *symbol = symbol_find (offset_name_table[i].name);
+
+            if (symbol == NULL) continue;
+            if (!symbol_is_undefined (symbol)) continue;
+
+            resolver.queued_for_pass[i] = resolver.pass;
+            archive_index_heap_push (&resolver.current_pass, i);
+        }
+    }
+
+    while (1) {
+        int change = 0;
+        struct archive_index_heap tmp;
+
+        while (resolver.current_pass.count) {
+            const struct symbol *symbol;
+
+            i = resolver.position = archive_index_heap_pop (&resolver.current_pass);
+
+            symbol = symbol_find (offset_name_table[i].name);
+            if (symbol == NULL) continue;
+            if (!symbol_is_undefined (symbol)) continue;
+
+            if (offset_name_table[i].offset == start_header_object_offset
+                || offset_name_table[i].offset == end_header_object_offset) continue;
+
+            ret = read_archive_member (file, file_size, file + offset_name_table[i].offset, archive_name, longnames);
+            if (ret == INPUT_FILE_ERROR) goto out;
+            /* If the archive member is a real object (not short import entry),
+             * it might require more symbols. */
+            if (ret == 1) change = 1;
+        }
+
+        if (change == 0 || resolver.next_pass.count == 0) break;
+
+        tmp = resolver.current_pass;
+        resolver.current_pass = resolver.next_pass;
+        resolver.next_pass = tmp;
+        resolver.pass++;
+        resolver.position = (unsigned long)-1;
+    }
+
+    ret = INPUT_FILE_FINISHED;
+
+out:
+    archive_resolver_destroy (&resolver);
+    
+    return ret;
+}
+
+static int resolve_archive_symbols_by_scanning (unsigned char *file,
+                                                size_t file_size,
+                                                const char *archive_name,
+                                                const struct archive_longnames *longnames,
+                                                const struct lm_offset_name_entry *offset_name_table,
+                                                unsigned long NumberOfSymbols,
+                                                unsigned long start_header_object_offset,
+                                                unsigned long end_header_object_offset)
+{
+    unsigned long i;
+    
+    while (1) {
+        int change = 0;
+
+        for (i = 0; i < NumberOfSymbols; i++) {
+            int ret;
+
+            /* Mainframe-only output formats need less strict matching. */
+            if (!mainframe_symbol_check_undefined (offset_name_table[i].name)) continue;
+
+            if (offset_name_table[i].offset == start_header_object_offset
+                || offset_name_table[i].offset == end_header_object_offset) continue;
+            
+            ret = read_archive_member (file, file_size, file + offset_name_table[i].offset, archive_name, longnames);
+            if (ret == INPUT_FILE_ERROR) return ret;
+            /* If the archive member is a real object (not short import entry),
+             * it might require more symbols. */
+            if (ret == 1) change = 1;
+        }
+
+        if (change == 0) break;
+    }
+
+    return INPUT_FILE_FINISHED;
+}
+
 static void read_archive (unsigned char *file, size_t file_size, const char *archive_name)
 {
     struct archive_member_header hdr;
@@ -192,10 +534,12 @@ static void read_archive (unsigned char *file, size_t file_size, const char *arc
     struct lm_offset_name_entry *offset_name_table;
     unsigned long NumberOfSymbols;
     unsigned long i;
+    int ret;
     
     unsigned char *pos;
 
     struct archive_longnames longnames = {NULL, 0};
+    struct archive_symbol_hash symbol_hash = {NULL, 0};
 
     unsigned long start_header_object_offset = 0;
     unsigned long end_header_object_offset = 0;
@@ -240,6 +584,39 @@ repeat:
          */
         free (hdr.name);
         goto repeat;
+    } else if (strcmp (hdr.name, ARCHIVE_SYMBOL_HASH_MEMBER_Name) == 0) {
+        unsigned long count, slot_count;
+
+        /* The hashed index is only an optimization,
+         * so it is ignored unless it matches the linker member. */
+        if (hdr.size >= 8) {
+            CHECK_READ (pos, 8);
+            count = BYTEARRAY_READ_4_BE (pos);
+            slot_count = BYTEARRAY_READ_4_BE (pos + 4);
+
+            if (count == NumberOfSymbols
+                && slot_count > count
+                && (slot_count & (slot_count - 1)) == 0
+                && (hdr.size - 8) / 4 >= slot_count) {
+                unsigned long slot;
+
+                CHECK_READ (pos + 8, slot_count * 4);
+
+                /* Probing stops only at an empty slot,
+                 * so a table without one would never terminate. */
+                for (slot = 0; slot < slot_count; slot++) {
+                    if (BYTEARRAY_READ_4_BE (pos + 8 + slot * 4) == 0) break;
+                }
+
+                if (slot < slot_count) {
+                    symbol_hash.slots = pos + 8;
+                    symbol_hash.slot_count = slot_count;
+                }
+            }
+        }
+        
+        free (hdr.name);
+        goto repeat;
     } else if (strcmp (hdr.name, IMAGE_ARCHIVE_LONGNAMES_MEMBER_Name) == 0) {
         longnames.names = (char *)pos;
         if (hdr.size > 0) {
@@ -276,36 +653,22 @@ repeat:
     if (start_header_object_offset)
         read_archive_member (file, file_size, file + start_header_object_offset, archive_name, &longnames);
 
-    while (1) {
-        int change = 0;
-
-        for (i = 0; i < NumberOfSymbols; i++) {
-            int ret;
-
-            if (ld_state->oformat == LD_OFORMAT_CMS
-                || ld_state->oformat == LD_OFORMAT_MVS
-                || ld_state->oformat == LD_OFORMAT_VSE) {
-                /* Mainframe-only output formats need less strict matching. */
-                if (!mainframe_symbol_check_undefined (offset_name_table[i].name)) continue;
-            } else {
-                const struct symbol *symbol = symbol_find (offset_name_table[i].name);
-
-                if (symbol == NULL) continue;
-                if (!symbol_is_undefined (symbol)) continue;
-            }
-
-            if (offset_name_table[i].offset == start_header_object_offset
-                || offset_name_table[i].offset == end_header_object_offset) continue;
-            
-            pos = file + offset_name_table[i].offset;
-            ret = read_archive_member (file, file_size, pos, archive_name, &longnames);
-            if (ret == INPUT_FILE_ERROR) return;
-            /* If the archive member is a real object (not short import entry),
-             * it might require more symbols. */
-            if (ret == 1) change = 1;
-        }
+    if (ld_state->oformat == LD_OFORMAT_CMS
+        || ld_state->oformat == LD_OFORMAT_MVS
+        || ld_state->oformat == LD_OFORMAT_VSE) {
+        ret = resolve_archive_symbols_by_scanning (file, file_size, archive_name, &longnames,
+                                                   offset_name_table, NumberOfSymbols,
+                                                   start_header_object_offset, end_header_object_offset);
+    } else {
+        ret = resolve_archive_symbols (file, file_size, archive_name, &longnames,
+                                       offset_name_table, NumberOfSymbols,
+                                       start_header_object_offset, end_header_object_offset,
+                                       symbol_hash.slots ? &symbol_hash : NULL);
+    }
 
-        if (change == 0) break;
+    if (ret == INPUT_FILE_ERROR) {
+        free (offset_name_table);
+        return;
     }
 
     if (end_header_object_offset)
@@ -336,19 +699,205 @@ static int read_file (unsigned char *file, size_t file_size, const char *filenam
     return INPUT_FILE_UNRECOGNIZED;
 }
  
+/* Input files are kept in memory until the output is written
+ * because section contents point directly into them. */
+struct input_file {
+    struct input_file *next;
+    const char *filename;
+    unsigned char *memory;
+    size_t size;
+    int mapped;
+    int failed;
+
+    /* Plain COFF or ELF32 object partially read in advance,
+     * see coff_stage_object () and elf_stage_object (). */
+    struct coff_staged_object *coff_staged;
+    struct elf_staged_object *elf_staged;
+};
+
+static struct input_file *input_files = NULL;
+
+/* Files loaded by input_files_preload () in command-line order,
+ * waiting for read_input_file (). */
+static struct input_file *preloaded_files = NULL;
+
+static void input_file_load (struct input_file *input_file)
+{
+    input_file->failed = map_file_into_memory (input_file->filename,
+                                               &input_file->memory,
+                                               &input_file->size,
+                                               &input_file->mapped);
+}
+
+#ifdef READ_USE_PTHREADS
+
+struct preload_queue {
+    struct input_file **files;
+    size_t count;
+    size_t next;
+    pthread_mutex_t mutex;
+};
+
+static void *preload_thread_run (void *arg)
+{
+    struct preload_queue *queue = arg;
+
+    while (1) {
+        struct input_file *input_file;
+        size_t i;
+
+        pthread_mutex_lock (&queue->mutex);
+        i = queue->next++;
+        pthread_mutex_unlock (&queue->mutex);
+
+        if (i >= queue->count) break;
+        input_file = queue->files[i];
+
+        input_file_load (input_file);
+        if (!input_file->failed) {
+            /* Touching every page now makes the page faults and disk reads
+             * happen in parallel instead of during the serial parsing. */
+            volatile unsigned char sum = 0;
+            size_t offset;
+
+            for (offset = 0; offset < input_file->size; offset += 4096) {
+                sum ^= input_file->memory[offset];
+            }
+
+            /* Only files read_file () would pass to coff_read () or elf_read () as objects. */
+            if (input_file->size >= strlen (IMAGE_ARCHIVE_START)
+                && memcmp (input_file->memory, IMAGE_ARCHIVE_START, strlen (IMAGE_ARCHIVE_START))
+                && !aout_is_object (input_file->memory, input_file->size)) {
+                input_file->coff_staged = coff_stage_object (input_file->memory, input_file->size);
+                if (!input_file->coff_staged) {
+                    input_file->elf_staged = elf_stage_object (input_file->memory, input_file->size);
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+#endif /* READ_USE_PTHREADS */
+
+/* Loads all input files using multiple threads before they are parsed.
+ * Plain COFF and ELF32 objects are also staged on those threads
+ * (see coff_stage_object () and elf_stage_object ()),
+ * the rest of parsing stays serial and in command-line order
+ * because the readers add sections and symbols directly to the global tables
+ * and archive member selection and COMDAT handling depend on that order. */
+void input_files_preload (char **filenames, int count)
+{
+#ifdef READ_USE_PTHREADS
+    struct preload_queue queue;
+    struct input_file **last_p = &preloaded_files;
+    pthread_t *threads;
+    size_t num_threads, started, i;
+    int j;
+
+    if (ld_state->threads < 2) return;
+
+    queue.files = xmalloc (sizeof (*queue.files) * (count ? count : 1));
+    queue.count = 0;
+    queue.next = 0;
+
+    for (j = 0; j < count; j++) {
+        struct input_file *input_file;
+
+        if (filenames[j] == NULL) continue;
+
+        input_file = xcalloc (1, sizeof (*input_file));
+        input_file->filename = filenames[j];
+
+        *last_p = input_file;
+        last_p = &input_file->next;
+        queue.files[queue.count++] = input_file;
+    }
+
+    num_threads = ld_state->threads;
+    if (num_threads > queue.count) num_threads = queue.count;
+
+    if (num_threads > 1 && pthread_mutex_init (&queue.mutex, NULL) == 0) {
+        threads = xmalloc (sizeof (*threads) * num_threads);
+        
+        for (started = 0; started < num_threads; started++) {
+            if (pthread_create (&threads[started], NULL, &preload_thread_run, &queue)) break;
+        }
+
+        /* Whatever is left is loaded by read_input_file (). */
+        for (i = 0; i < started; i++) {
+            pthread_join (threads[i], NULL);
+        }
+
+        free (threads);
+        pthread_mutex_destroy (&queue.mutex);
+    }
+
+    free (queue.files);
+#endif
+}
+
 void read_input_file (const char *filename)
 {
-    unsigned char *file;
-    size_t file_size;
+    struct input_file *input_file;
+
+    if (preloaded_files && strcmp (preloaded_files->filename, filename) == 0) {
+        input_file = preloaded_files;
+        preloaded_files = input_file->next;
+        
+        /* Not loaded if the preloading threads could not be started. */
+        if (input_file->memory == NULL && !input_file->failed) input_file_load (input_file);
+    } else {
+        input_file = xcalloc (1, sizeof (*input_file));
+        input_file->filename = filename;
+        input_file_load (input_file);
+    }
 
-    if (read_file_into_memory (filename, &file, &file_size)) {
+    if (input_file->failed) {
+        free (input_file);
         ld_error ("failed to read file '%s' into memory", filename);
         return;
     }
 
-    if (read_file (file, file_size, filename) == INPUT_FILE_UNRECOGNIZED) {
+    input_file->next = input_files;
+    input_files = input_file;
+
+    if (input_file->coff_staged) {
+        coff_read_staged_object (input_file->coff_staged, input_file->memory, input_file->size, filename);
+        coff_staged_object_free (input_file->coff_staged);
+        input_file->coff_staged = NULL;
+        return;
+    }
+    if (input_file->elf_staged) {
+        elf_read_staged_object (input_file->elf_staged, input_file->memory, input_file->size, filename);
+        elf_staged_object_free (input_file->elf_staged);
+        input_file->elf_staged = NULL;
+        return;
+    }
+
+    if (read_file (input_file->memory, input_file->size, filename) == INPUT_FILE_UNRECOGNIZED) {
         ld_error ("unrecognized file format");
     }
+}
+
+void input_files_destroy (void)
+{
+    struct input_file *input_file;
 
-    free (file);
+    while ((input_file = input_files)) {
+        input_files = input_file->next;
+        unmap_file_from_memory (input_file->memory, input_file->size, input_file->mapped);
+        free (input_file);
+    }
+
+    while ((input_file = preloaded_files)) {
+        preloaded_files = input_file->next;
+        if (input_file->coff_staged) coff_staged_object_free (input_file->coff_staged);
+        if (input_file->elf_staged) elf_staged_object_free (input_file->elf_staged);
+        if (input_file->memory) {
+            unmap_file_from_memory (input_file->memory, input_file->size, input_file->mapped);
+        }
+        free (input_file);
+    }
 }
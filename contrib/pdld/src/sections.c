@@ -13,6 +13,7 @@
 
 #include "ld.h"
 #include "xmalloc.h"
+#include "hashtab.h"
 
 struct section *all_sections = NULL;
 static struct section **last_section_p = &all_sections;
@@ -21,16 +22,54 @@ struct object_file *all_object_files = NULL;
 static struct object_file **last_object_file_p = &all_object_files;
 
 static struct section *discarded_sections = NULL;
+static struct section_part *discarded_parts = NULL;
 
-struct section *section_find (const char *name)
+static struct hashtab *section_hashtab;
+static struct hashtab *subsection_hashtab;
+
+static hash_value_t hash_section (const void *p)
 {
-    struct section *section;
+    const struct section *section = (const struct section *) p;
+    return hashtab_help_default_hash_string (section->name);
+}
 
-    for (section = all_sections; section; section = section->next) {
-        if (strcmp (name, section->name) == 0) break;
-    }
+static int equal_section (const void *p1, const void *p2)
+{
+    const struct section *section1 = (const struct section *) p1;
+    const struct section *section2 = (const struct section *) p2;
+    
+    return strcmp (section1->name, section2->name) == 0;
+}
 
-    return section;
+/* Subsections of all sections share one hashtab,
+ * the owning section is part of the key. */
+static hash_value_t hash_subsection (const void *p)
+{
+    const struct subsection *subsection = (const struct subsection *) p;
+    return hashtab_help_default_hash_string (subsection->name);
+}
+
+static int equal_subsection (const void *p1, const void *p2)
+{
+    const struct subsection *subsection1 = (const struct subsection *) p1;
+    const struct subsection *subsection2 = (const struct subsection *) p2;
+    
+    return (subsection1->section == subsection2->section
+            && strcmp (subsection1->name, subsection2->name) == 0);
+}
+
+void sections_init (void)
+{
+    section_hashtab = hashtab_create_hashtab (0, hash_section, equal_section, &xmalloc, &free);
+    subsection_hashtab = hashtab_create_hashtab (0, hash_subsection, equal_subsection, &xmalloc, &free);
+}
+
+struct section *section_find (const char *name)
+{
+    struct section fake = { NULL };
+    fake.name = (char *)name;
+
+    return (struct section *) hashtab_find (section_hashtab, &fake);
 }
 
 struct section *section_find_or_make (const char *name)
@@ -48,6 +87,10 @@ struct section *section_find_or_make (const char *name)
     *last_section_p = section;
     last_section_p = &section->next;
 
+    if (hashtab_insert (section_hashtab, section)) {
+        ld_internal_error_at_source (__FILE__, __LINE__, "failed to insert section '%s' into hashtab", section->name);
+    }
+
     return section;
 }
 
@@ -57,7 +100,20 @@ void section_write (struct section *section, unsigned char *memory)
 
     for (part = section->first_part; part; part = part->next) {
         memcpy (memory, part->content, part->content_size);
-        memory += part->content_size;
+        memset (memory + part->content_size, 0, part->padding);
+        memory += part->content_size + part->padding;
+    }
+}
+
+/* Part contents are written without copying,
+ * so they must not change until the stream is closed. */
+void section_write_to_stream (struct section *section, struct output_stream *stream)
+{
+    struct section_part *part;
+
+    for (part = section->first_part; part; part = part->next) {
+        output_stream_write_view (stream, part->content, part->content_size);
+        output_stream_write_zeros (stream, part->padding);
     }
 }
 
@@ -73,39 +129,69 @@ int section_count (void)
 
 struct subsection *subsection_find (struct section *section, const char *name)
 {
-    struct subsection *subsection;
+    struct subsection fake = { NULL };
+    fake.name = (char *)name;
+    fake.section = section;
 
-    for (subsection = section->all_subsections; subsection; subsection = subsection->next) {
-        if (strcmp (name, subsection->name) == 0) break;
+    return (struct subsection *) hashtab_find (subsection_hashtab, &fake);
+}
+
+struct subsection *subsection_find_or_make (struct section *section, const char *name)
+{
+    struct subsection *subsection = subsection_find (section, name);
+
+    if (subsection) return subsection;
+
+    subsection = xmalloc (sizeof (*subsection));
+    subsection->name = xstrdup (name);
+    subsection->section = section;
+    subsection->first_part = NULL;
+    subsection->last_part_p = &subsection->first_part;
+
+    /* Subsections are kept unsorted until section_sort_subsections () is called. */
+    subsection->next = section->all_subsections;
+    section->all_subsections = subsection;
+
+    if (hashtab_insert (subsection_hashtab, subsection)) {
+        ld_internal_error_at_source (__FILE__, __LINE__, "failed to insert subsection '%s' into hashtab", subsection->name);
     }
 
     return subsection;
 }
 
-struct subsection *subsection_find_or_make (struct section *section, const char *name)
+static int subsection_compare (const void *a, const void *b)
 {
-    struct subsection *subsection, **next_p;
+    const struct subsection *subsection1 = *(const struct subsection *const *) a;
+    const struct subsection *subsection2 = *(const struct subsection *const *) b;
 
-    for (subsection = *(next_p = &section->all_subsections);
-         subsection;
-         subsection = *(next_p = &subsection->next)) {
+    return strcmp (subsection1->name, subsection2->name);
+}
 
-        if (strcmp (name, subsection->name) <= 0) break;
+void section_sort_subsections (struct section *section)
+{
+    struct subsection *subsection, **subsection_array;
+    size_t count, i;
 
+    for (count = 0, subsection = section->all_subsections; subsection; subsection = subsection->next) {
+        count++;
     }
 
-    if (!subsection || strcmp (name, subsection->name) != 0) {
+    if (count < 2) return;
 
-        subsection = xmalloc (sizeof (*subsection));
-        subsection->name = xstrdup (name);
-        subsection->first_part = NULL;
-        subsection->last_part_p = &subsection->first_part;
+    subsection_array = xmalloc (sizeof (*subsection_array) * count);
+    for (i = 0, subsection = section->all_subsections; subsection; subsection = subsection->next) {
+        subsection_array[i++] = subsection;
+    }
+
+    qsort (subsection_array, count, sizeof (*subsection_array), &subsection_compare);
 
-        subsection->next = *next_p;
-        *next_p = subsection;
+    for (i = 0; i + 1 < count; i++) {
+        subsection_array[i]->next = subsection_array[i + 1];
     }
+    subsection_array[count - 1]->next = NULL;
+    section->all_subsections = subsection_array[0];
 
-    return subsection;
+    free (subsection_array);
 }
 
 struct section_part *section_part_new (struct section *section, struct object_file *of)
@@ -118,10 +204,14 @@ struct section_part *section_part_new (struct section *section, struct object_fi
     part->content = NULL;
     part->content_size = 0;
     part->alignment = 1;
+    part->content_is_view = 0;
 
     part->relocation_array = NULL;
     part->relocation_count = 0;
     part->rva = 0;
+    part->padding = 0;
+    part->already_relocated = 0;
+    part->marked = 0;
 
     part->next = NULL;
 
@@ -165,7 +255,7 @@ static void free_discarded_section (struct section *section)
     for (subsection = section->all_subsections; subsection; subsection = section->all_subsections) {
         for (part = subsection->first_part; part; part = next_part) {
             next_part = part->next;
-            free (part->content);
+            if (!part->content_is_view) free (part->content);
             free (part->relocation_array);
             free (part);
         }
@@ -177,7 +267,7 @@ static void free_discarded_section (struct section *section)
 
     for (part = section->first_part; part; part = next_part) {
         next_part = part->next;
-        free (part->content);
+        if (!part->content_is_view) free (part->content);
         free (part->relocation_array);
         free (part);
     }
@@ -205,7 +295,7 @@ void sections_destroy (void)
 
             for (part = section->first_part; part; part = next_part) {
                 next_part = part->next;
-                free (part->content);
+                if (!part->content_is_view) free (part->content);
                 free (part->relocation_array);
                 free (part);
             }
@@ -218,6 +308,20 @@ void sections_destroy (void)
             discarded_sections = section->next;
             free_discarded_section (section);
         }
+
+        {
+            struct section_part *part;
+
+            for (part = discarded_parts; part; part = discarded_parts) {
+                discarded_parts = part->next;
+                if (!part->content_is_view) free (part->content);
+                free (part->relocation_array);
+                free (part);
+            }
+        }
+
+        hashtab_destroy_hashtab (subsection_hashtab);
+        hashtab_destroy_hashtab (section_hashtab);
     }
 
     {
@@ -270,6 +374,7 @@ void sections_destroy_empty_before_collapse (void)
     done_section:
         if (empty) {
             *next_p = section->next;
+            hashtab_delete (section_hashtab, section);
             /* There still remain symbols referencing the discarded sections
              * and delaying the freeing is easier and faster
              * than searching for the affected symbols and changing them.
@@ -283,3 +388,61 @@ void sections_destroy_empty_before_collapse (void)
 
     last_section_p = next_p;
 }
+
+/* Removes a section after its subsections were collapsed,
+ * so the subsections no longer own any parts.
+ * Symbols might still reference the section, so it is freed only by sections_destroy (). */
+void section_discard (struct section *section)
+{
+    struct section **next_p;
+    struct subsection *subsection;
+
+    for (next_p = &all_sections; *next_p != section; next_p = &(*next_p)->next) {
+        if (*next_p == NULL) {
+            ld_internal_error_at_source (__FILE__, __LINE__, "section '%s' not found in section list", section->name);
+        }
+    }
+
+    *next_p = section->next;
+    if (last_section_p == &section->next) last_section_p = next_p;
+
+    hashtab_delete (section_hashtab, section);
+
+    for (subsection = section->all_subsections; subsection; subsection = subsection->next) {
+        subsection->first_part = NULL;
+        subsection->last_part_p = &subsection->first_part;
+    }
+
+    section->next = discarded_sections;
+    discarded_sections = section;
+}
+
+/* Unmarked parts are moved to a separate list instead of being freed
+ * because symbols defined in them are still present in the symbol tables.
+ * Sections left without any parts are discarded. */
+void sections_discard_unmarked_parts (void)
+{
+    struct section *section, *next_section;
+
+    for (section = all_sections; section; section = next_section) {
+        struct section_part *part, **next_p;
+        int had_parts = section->first_part != NULL;
+
+        next_section = section->next;
+
+        for (next_p = &section->first_part; (part = *next_p); ) {
+            if (part->marked) {
+                next_p = &part->next;
+                continue;
+            }
+
+            *next_p = part->next;
+            part->next = discarded_parts;
+            discarded_parts = part;
+        }
+
+        section->last_part_p = next_p;
+
+        if (had_parts && section->first_part == NULL) section_discard (section);
+    }
+}
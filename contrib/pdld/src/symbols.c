@@ -17,6 +17,7 @@
 #include "hashtab.h"
 
 static struct hashtab *symbol_hashtab;
+static void (*undefined_symbol_callback) (const struct symbol *);
 
 static hash_value_t hash_symbol (const void *p)
 {
@@ -60,6 +61,18 @@ void symbol_add_to_hashtab (struct symbol *symbol)
     if (hashtab_insert (symbol_hashtab, symbol)) {
         ld_internal_error_at_source (__FILE__, __LINE__, "failed to insert symbol '%s' into hashtab", symbol->name);
     }
+
+    if (undefined_symbol_callback && symbol_is_undefined (symbol)) {
+        undefined_symbol_callback (symbol);
+    }
+}
+
+/* The callback is called for every undefined symbol added to the hashtab,
+ * so archive reading can find out which members became needed
+ * without rescanning the whole archive symbol table. */
+void symbols_set_undefined_symbol_callback (void (*callback) (const struct symbol *))
+{
+    undefined_symbol_callback = callback;
 }
 
 void symbol_remove_from_hashtab (struct symbol *symbol)
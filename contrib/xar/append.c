@@ -1,15 +1,60 @@
 /******************************************************************************
  * @file            append.c
  *****************************************************************************/
+#ifdef  XAR_USE_STAT
+# ifndef    _POSIX_C_SOURCE
+#  define   _POSIX_C_SOURCE             200112L
+# endif
+#endif
+
 #include    <stdio.h>
 #include    <stdlib.h>
 #include    <string.h>
+#include    <time.h>
+
+#ifdef      XAR_USE_STAT
+# include   <sys/types.h>
+# include   <sys/stat.h>
+#endif
 
 #include    "ar.h"
 #include    "lib.h"
 #include    "report.h"
 
-void append (FILE *ofp, char *fname) {
+/**
+ * ranlib keys its symbol cache on the member header,
+ * so the mtime field has to change whenever a member is replaced.
+ * Without stat () the time the member is added is used instead.
+ */
+static void put_mtime (char *mtime, const char *fname) {
+
+    char temp[24];
+    long len;
+    
+    unsigned long value = (unsigned long) time (NULL);
+    
+#ifdef      XAR_USE_STAT
+    struct stat st;
+    
+    if (stat (fname, &st) == 0) {
+        value = (unsigned long) st.st_mtime;
+    }
+#else
+    (void) fname;
+#endif
+    
+    len = sprintf (temp, "%lu", value);
+    
+    if (len > 12) {
+        len = sprintf (temp, "0");
+    }
+    
+    memset (mtime, 0x20, 12);
+    memcpy (mtime, temp, len);
+
+}
+
+int append (FILE *ofp, char *fname) {
 
     unsigned char aout_magic[2];
     FILE *tfp;
@@ -26,7 +71,7 @@ void append (FILE *ofp, char *fname) {
     if ((tfp = fopen (fname, "r+b")) == NULL) {
     
         report_at (program_name, 0, REPORT_ERROR, "failed to open %s", fname);
-        return;
+        return 1;
     
     }
     
@@ -35,18 +80,18 @@ void append (FILE *ofp, char *fname) {
         fclose (tfp);
         
         report_at (program_name, 0, REPORT_ERROR, "failed whilst reading %s", fname);
-        return;
+        return 1;
     
     }
     
-    valid = ((aout_magic[0] == 0x07 && aout_magic[1] == 0x01) || (aout_magic[0] == 0x4C && aout_magic[1] == 0x01) || (aout_magic[0] == 0x64 && aout_magic[1] == 0x86));
+    valid = ((aout_magic[0] == 0x07 && aout_magic[1] == 0x01) || (aout_magic[0] == 0x4C && aout_magic[1] == 0x01) || (aout_magic[0] == 0x64 && aout_magic[1] == 0x86) || (aout_magic[0] == 0x7F && aout_magic[1] == 0x45));
     
     if (!valid) {
     
         fclose (tfp);
         
-        report_at (program_name, 0, REPORT_ERROR, "%s is not a valid a.out or coff object", fname);
-        return;
+        report_at (program_name, 0, REPORT_ERROR, "%s is not a valid a.out, coff or elf object", fname);
+        return 1;
     
     }
     
@@ -69,7 +114,7 @@ void append (FILE *ofp, char *fname) {
         header.name[len++] = 0x20;
     }
     
-    memcpy (header.mtime, temp, 12);
+    put_mtime (header.mtime, fname);
     memcpy (header.owner, temp, 6);
     memcpy (header.group, temp, 6);
     memcpy (header.mode, temp, 8);
@@ -92,7 +137,7 @@ void append (FILE *ofp, char *fname) {
         fclose (tfp);
         
         report_at (program_name, 0, REPORT_ERROR, "failed whilst writing header");
-        return;
+        return 1;
     
     }
     
@@ -115,7 +160,7 @@ void append (FILE *ofp, char *fname) {
             fclose (tfp);
             
             report_at (program_name, 0, REPORT_ERROR, "failed whilst reading %s", fname);
-            return;
+            return 1;
         
         }
         
@@ -127,7 +172,7 @@ void append (FILE *ofp, char *fname) {
             fclose (tfp);
             
             report_at (program_name, 0, REPORT_ERROR, "failed whilst writing %s to archive", fname);
-            return;
+            return 1;
         
         }
     
@@ -149,5 +194,6 @@ void append (FILE *ofp, char *fname) {
     }
     
     fclose (tfp);
+    return 0;
 
 }
@@ -53,6 +53,8 @@ int main (int argc, char **argv) {
                 return EXIT_FAILURE;
             
             }
+            
+            ranlib_remove_cache ();
         
         }
         
@@ -92,23 +94,43 @@ int main (int argc, char **argv) {
             fseek (arfp, 0, SEEK_END);
             append (arfp, state->files[i]);
         
-        } else if (state->replace) {
-        
-            fseek (arfp, 8, SEEK_SET);
-            replace (state->files[i]);
+        }
+    
+    }
+    
+    if (state->append) {
+    
+        read_members ();
+        ranlib_prune_cache ();
+        free_members ();
+    
+    }
+    
+    if (state->replace || state->del) {
+    
+        /* All files are handled in memory first,
+         * so the archive is rewritten only once. */
+        read_members ();
         
-        } else if (state->del) {
+        for (i = 0; i < state->nb_files; ++i) {
         
-            fseek (arfp, 8, SEEK_SET);
-            delete (state->files[i]);
+            if (state->replace) {
+                replace (state->files[i]);
+            } else {
+                delete (state->files[i]);
+            }
         
-        } else if (state->extract) {
+        }
         
-            fseek (arfp, 8, SEEK_SET);
-            extract (state->files[0]);
+        ranlib_prune_cache ();
         
-        }
+        write_members (0, 0);
+        free_members ();
+    
+    }
     
+    if (state->extract) {
+        extract ();
     }
     
     if (state->display) {
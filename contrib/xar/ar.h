@@ -14,6 +14,7 @@ struct ar_state {
     int del, move, print;
     int append, replace, ranlib;
     int display, extract;
+    int parallel, hash;
 
 };
 
@@ -36,14 +37,41 @@ struct ar_header {
 
 #include    "stdint.h"
 
+struct member {
+
+    struct ar_header hdr;
+    char name[17];
+    
+    long offset;
+    long size;
+    
+    char *fname;
+
+};
+
 extern FILE *arfp;
 uint32_t conv_dec (char *str, int32_t max);
 
-void append  (FILE *ofp, char *fname);
+extern struct member **members;
+extern long nb_members;
+
+long member_name (char *temp, const char *fname);
+int member_matches (const struct member *member, const char *temp);
+
+#define     COPY_BUFFER_SIZE            65536
+int copy_contents (FILE *ifp, FILE *ofp, const struct member *member, char *contents);
+
+void read_members (void);
+void write_members (const void *index, long index_size);
+void free_members (void);
+
+int  append  (FILE *ofp, char *fname);
 void delete  (char *fname);
 void display (void);
-void extract (char *fname);
+void extract (void);
 void ranlib  (void);
+void ranlib_prune_cache (void);
+void ranlib_remove_cache (void);
 void replace (char *fname);
 
 #endif      /* _AR_H */
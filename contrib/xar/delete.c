@@ -11,172 +11,24 @@
 
 void delete (char *fname) {
 
-    FILE *tfp = tmpfile ();
+    char temp[17];
+    long i, j;
     
-    char temp[17], *name, *p, *contents;
-    long bytes, len, read;
+    member_name (temp, fname);
     
-    if (fwrite ("!<arch>\x0A", 8, 1, tfp) != 1) {
+    for (i = 0, j = 0; i < nb_members; i++) {
     
-        fclose (tfp);
+        if (member_matches (members[i], temp)) {
         
-        report_at (program_name, 0, REPORT_ERROR, "failed whist writing ar header");
-        return;
-    
-    }
-    
-    name = fname;
-    
-    if ((p = strrchr (fname, '/'))) {
-        name = (p + 1);
-    }
-    
-    len = strlen (name);
-    
-    if (len > 16) {
-        len = 16;
-    }
-    
-    memcpy (temp, name, len);
-    temp[len] = '\0';
-    
-    for (;;) {
-    
-        struct ar_header hdr;
-        
-        if (fread (&hdr, sizeof (hdr), 1, arfp) != 1) {
-        
-            if (feof (arfp)) {
-                break;
-            }
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whilst reading '%s'", state->outfile);
-            return;
-        
-        }
-        
-        bytes = conv_dec (hdr.size, 10);
-        
-        if (bytes % 2) {
-            bytes++;
-        }
-        
-        if (memcmp (hdr.name, "/", 1) == 0) {
-        
-            fseek (arfp, bytes, SEEK_CUR);
-            continue;
-        
-        }
-        
-        if (memcmp (hdr.name, temp, len) == 0) {
-        
-            fseek (arfp, bytes, SEEK_CUR);
+            free (members[i]);
             continue;
         
         }
         
-        if (fwrite (&hdr, sizeof (hdr), 1, tfp) != 1) {
-        
-            fclose (tfp);
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whilst writing header");
-            exit (EXIT_FAILURE);
-        
-        }
-        
-        contents = xmalloc (512);
-        
-        for (;;) {
-        
-            if (bytes == 0 || feof (arfp)) {
-                break;
-            } else if (bytes >= 512) {
-                read = 512;
-            } else {
-                read = bytes;
-            }
-            
-            if (fread (contents, read, 1, arfp) != 1) {
-            
-                free (contents);
-                fclose (tfp);
-                
-                report_at (NULL, 0, REPORT_ERROR, "failed to read %ld bytes from %s", bytes, state->outfile);
-                exit (EXIT_FAILURE);
-            
-            }
-            
-            bytes -= read;
-            
-            if (fwrite (contents, read, 1, tfp) != 1) {
-            
-                free (contents);
-                fclose (tfp);
-                
-                report_at (NULL, 0, REPORT_ERROR, "failed to write temp file");
-                exit (EXIT_FAILURE);
-            
-            }
-        
-        }
-        
-        free (contents);
-    
-    }
-    
-    fclose (arfp);
-    remove (state->outfile);
-    
-    if ((arfp = fopen (state->outfile, "w+b")) == NULL) {
-    
-        fclose (tfp);
-        
-        report_at (program_name, 0, REPORT_ERROR, "failed to open %s for writing", state->outfile);
-        exit (EXIT_FAILURE);
-    
-    }
-    
-    contents = xmalloc (512);
-    bytes = ftell (tfp);
-    
-    fseek (arfp, 0, SEEK_SET);
-    fseek (tfp, 0, SEEK_SET);
-    
-    for (;;) {
-    
-        if (bytes == 0 || feof (tfp)) {
-            break;
-        } else if (bytes >= 512) {
-            read = 512;
-        } else {
-            read = bytes;
-        }
-        
-        if (fread (contents, read, 1, tfp) != 1) {
-            
-            free (contents);
-            fclose (tfp);
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whilst reading temp file");
-            return;
-        
-        }
-        
-        bytes -= read;
-        
-        if (fwrite (contents, read, 1, arfp) != 1) {
-        
-            free (contents);
-            fclose (tfp);
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whist writing %s", state->outfile);
-            exit (EXIT_FAILURE);
-        
-        }
+        members[j++] = members[i];
     
     }
     
-    free (contents);
-    fclose (tfp);
+    nb_members = j;
 
 }
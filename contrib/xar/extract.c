@@ -1,120 +1,260 @@
 /******************************************************************************
  * @file            extract.c
  *****************************************************************************/
+/* XAR_USE_FORK is defined by the Unix makefiles. */
+#ifdef  XAR_USE_FORK
+# ifndef    _POSIX_C_SOURCE
+#  define   _POSIX_C_SOURCE             200112L
+# endif
+# define    EXTRACT_USE_FORK
+#endif
+
 #include    <stdio.h>
 #include    <stdlib.h>
 #include    <string.h>
 
+#ifdef      EXTRACT_USE_FORK
+# include   <sys/types.h>
+# include   <sys/wait.h>
+# include   <unistd.h>
+#endif
+
 #include    "ar.h"
 #include    "lib.h"
 #include    "report.h"
 
-void extract (char *fname) {
+static int member_compare (const void *a, const void *b) {
+
+    const struct member *member1 = *(const struct member *const *) a;
+    const struct member *member2 = *(const struct member *const *) b;
+    
+    int ret;
+    
+    if ((ret = strcmp (member1->name, member2->name))) {
+        return ret;
+    }
+    
+    if (member1->offset < member2->offset) {
+        return -1;
+    }
+    
+    return (member1->offset > member2->offset);
+
+}
+
+static int member_key_compare (const void *a, const void *b) {
+
+    const char *temp = a;
+    const struct member *member = *(const struct member *const *) b;
+    
+    return strcmp (temp, member->name);
+
+}
+
+static int extract_member (FILE *ifp, const struct member *member, char *contents) {
 
     FILE *ofp;
     
-    char temp[17], *name, *p, *contents;
-    long bytes, len, read;
+    if ((ofp = fopen (member->name, "w+b")) == NULL) {
     
-    name = fname;
+        report_at (program_name, 0, REPORT_ERROR, "failed to open %s for writing", member->name);
+        return 1;
     
-    if ((p = strrchr (fname, '/'))) {
-        name = (p + 1);
     }
     
-    len = strlen (name);
+    if (copy_contents (ifp, ofp, member, contents) || fclose (ofp)) {
+    
+        report_at (NULL, 0, REPORT_ERROR, "failed to write %s file", member->name);
+        return 1;
     
-    if (len > 16) {
-        len = 16;
     }
     
-    memcpy (temp, name, len);
-    temp[len] = '\0';
+    return 0;
+
+}
+
+static int extract_members (struct member **todo, long nb_todo, long first, long step) {
+
+    FILE *ifp;
+    char *contents;
     
-    for (;;) {
+    long i;
+    int ret = 0;
     
-        struct ar_header hdr;
-        
-        if (fread (&hdr, sizeof (hdr), 1, arfp) != 1) {
-        
-            if (feof (arfp)) {
-                break;
-            }
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whilst reading '%s'", state->outfile);
-            return;
-        
+    if ((ifp = fopen (state->outfile, "rb")) == NULL) {
+    
+        report_at (program_name, 0, REPORT_ERROR, "failed to open %s", state->outfile);
+        return 1;
+    
+    }
+    
+    contents = xmalloc (COPY_BUFFER_SIZE);
+    
+    for (i = first; i < nb_todo; i += step) {
+    
+        if (extract_member (ifp, todo[i], contents)) {
+            ret = 1;
         }
+    
+    }
+    
+    free (contents);
+    fclose (ifp);
+    
+    return ret;
+
+}
+
+#ifdef      EXTRACT_USE_FORK
+
+/**
+ * Each child extracts every jobs-th member using its own handle
+ * of the archive, so the children do not share a file position.
+ */
+static int extract_parallel (struct member **todo, long nb_todo) {
+
+    long jobs = 1, i, started;
+    int ret = 0;
+    
+#ifdef      _SC_NPROCESSORS_ONLN
+    jobs = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+    
+    if (jobs > nb_todo) {
+        jobs = nb_todo;
+    }
+    
+    if (jobs <= 1) {
+        return extract_members (todo, nb_todo, 0, 1);
+    }
+    
+    fflush (NULL);
+    
+    for (started = 0; started < jobs; started++) {
+    
+        pid_t pid;
         
-        bytes = conv_dec (hdr.size, 10);
+        if ((pid = fork ()) == -1) {
+            break;
+        }
         
-        if (memcmp (hdr.name, "/", 1) == 0) {
+        if (pid == 0) {
+            exit (extract_members (todo, nb_todo, started, jobs) ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+    
+    }
+    
+    /* Members of the children which could not be started are extracted here. */
+    for (i = started; i < jobs; i++) {
+    
+        if (extract_members (todo, nb_todo, i, jobs)) {
+            ret = 1;
+        }
+    
+    }
+    
+    for (i = 0; i < started; i++) {
+    
+        int status;
         
-            if (bytes % 2) {
-                bytes++;
-            }
-            
-            fseek (arfp, bytes, SEEK_CUR);
-            continue;
+        if (wait (&status) == -1) {
+            break;
+        }
         
+        if (!WIFEXITED (status) || WEXITSTATUS (status) != EXIT_SUCCESS) {
+            ret = 1;
+        }
+    
+    }
+    
+    return ret;
+
+}
+
+#endif
+
+/**
+ * The member directory is read once and sorted by name,
+ * so each requested file is found by binary search
+ * instead of rescanning the archive.
+ * When a name occurs more than once, the last member wins
+ * like when the members are extracted in archive order.
+ */
+void extract (void) {
+
+    struct member **sorted, **todo, **found;
+    long nb_todo = 0, i;
+    
+    char temp[17], *selected;
+    int ret, not_found = 0;
+    
+    read_members ();
+    
+    if (nb_members == 0) {
+        return;
+    }
+    
+    sorted = xmalloc (sizeof (*sorted) * nb_members);
+    memcpy (sorted, members, sizeof (*sorted) * nb_members);
+    
+    qsort (sorted, nb_members, sizeof (*sorted), &member_compare);
+    
+    todo = xmalloc (sizeof (*todo) * nb_members);
+    selected = xmalloc (nb_members);
+    
+    for (i = 0; i < nb_members; i++) {
+    
+        /* Without file names all members are extracted. */
+        if (state->nb_files == 0 && (i + 1 == nb_members || strcmp (sorted[i]->name, sorted[i + 1]->name))) {
+            todo[nb_todo++] = sorted[i];
         }
+    
+    }
+    
+    for (i = 0; i < state->nb_files; i++) {
+    
+        member_name (temp, state->files[i]);
         
-        if (memcmp (hdr.name, temp, len) != 0) {
+        if ((found = bsearch (temp, sorted, nb_members, sizeof (*sorted), &member_key_compare)) == NULL) {
         
-            if (bytes % 2) {
-                bytes++;
-            }
+            report_at (program_name, 0, REPORT_ERROR, "%s not found in %s", temp, state->outfile);
             
-            fseek (arfp, bytes, SEEK_CUR);
+            not_found = 1;
             continue;
         
         }
         
-        if ((ofp = fopen (temp, "w+b")) == NULL) {
-        
-            report_at (program_name, 0, REPORT_ERROR, "failed to open %s for writing", temp);
-            exit (EXIT_FAILURE);
-        
+        while (found + 1 < sorted + nb_members && member_matches (found[1], temp)) {
+            found++;
         }
         
-        contents = xmalloc (512);
+        /* Each member needs to be written only once. */
+        if (!selected[found - sorted]) {
         
-        for (;;) {
-        
-            if (bytes == 0 || feof (arfp)) {
-                break;
-            } else if (bytes >= 512) {
-                read = 512;
-            } else {
-                read = bytes;
-            }
-            
-            if (fread (contents, read, 1, arfp) != 1) {
-            
-                free (contents);
-                fclose (ofp);
-                
-                report_at (NULL, 0, REPORT_ERROR, "failed to read %ld bytes from %s", bytes, state->outfile);
-                exit (EXIT_FAILURE);
-            
-            }
-            
-            bytes -= read;
-            
-            if (fwrite (contents, read, 1, ofp) != 1) {
-            
-                free (contents);
-                fclose (ofp);
-                
-                report_at (NULL, 0, REPORT_ERROR, "failed to write %s file", temp);
-                exit (EXIT_FAILURE);
-            
-            }
+            selected[found - sorted] = 1;
+            todo[nb_todo++] = *found;
         
         }
-        
-        free (contents);
     
     }
 
+#ifdef      EXTRACT_USE_FORK
+    if (state->parallel && nb_todo > 1) {
+        ret = extract_parallel (todo, nb_todo);
+    } else {
+        ret = extract_members (todo, nb_todo, 0, 1);
+    }
+#else
+    ret = extract_members (todo, nb_todo, 0, 1);
+#endif
+    
+    free (selected);
+    free (todo);
+    free (sorted);
+    free_members ();
+    
+    if (ret || not_found) {
+        exit (EXIT_FAILURE);
+    }
+
 }
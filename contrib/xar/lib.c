@@ -25,8 +25,10 @@ static void print_help (void) {
     fprintf (stderr, "    q             quick append file(s) to the archive\n");
     fprintf (stderr, "    r             replace existing or insert new file(s) into the archive\n");
     fprintf (stderr, "    s             act as ranlib\n");
+    fprintf (stderr, "    sh            act as ranlib and add a hashed symbol index\n");
     fprintf (stderr, "    t             display contents of the archive\n");
     fprintf (stderr, "    x             extract file(s) from the archive\n");
+    fprintf (stderr, "    xj            extract file(s) using all processors\n");
     
     fprintf (stderr, "\n");
     
@@ -132,6 +134,20 @@ check_options:
         
         }
         
+        if (ch == 'h') {
+        
+            state->hash++;
+            continue;
+        
+        }
+        
+        if (ch == 'j') {
+        
+            state->parallel++;
+            continue;
+        
+        }
+        
         if (ch == 'm') {
         
             state->move++;
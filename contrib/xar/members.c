@@ -0,0 +1,275 @@
+/******************************************************************************
+ * @file            members.c
+ *****************************************************************************/
+#include    <stdio.h>
+#include    <stdlib.h>
+#include    <string.h>
+
+#include    "ar.h"
+#include    "lib.h"
+#include    "report.h"
+
+struct member **members = 0;
+long nb_members = 0;
+
+long member_name (char *temp, const char *fname) {
+
+    const char *name = fname, *p;
+    long len;
+    
+    if ((p = strrchr (fname, '/'))) {
+        name = (p + 1);
+    }
+    
+    len = strlen (name);
+    
+    if (len > 16) {
+        len = 16;
+    }
+    
+    memcpy (temp, name, len);
+    temp[len] = '\0';
+    
+    return len;
+
+}
+
+int member_matches (const struct member *member, const char *temp) {
+    return (strcmp (member->name, temp) == 0);
+}
+
+/**
+ * Reads all member headers of the archive in one pass.
+ * Members with names starting with '/' (symbol index) are skipped
+ * because they are invalidated by any change of the archive.
+ */
+void read_members (void) {
+
+    fseek (arfp, 8, SEEK_SET);
+    
+    for (;;) {
+    
+        struct ar_header hdr;
+        struct member *member;
+        
+        long bytes;
+        
+        if (fread (&hdr, sizeof (hdr), 1, arfp) != 1) {
+        
+            if (feof (arfp)) {
+                break;
+            }
+            
+            report_at (program_name, 0, REPORT_ERROR, "failed whilst reading '%s'", state->outfile);
+            exit (EXIT_FAILURE);
+        
+        }
+        
+        bytes = conv_dec (hdr.size, 10);
+        
+        if (memcmp (hdr.name, "/", 1) != 0) {
+        
+            member = xmalloc (sizeof (*member));
+            
+            member->hdr = hdr;
+            
+            memcpy (member->name, hdr.name, 16);
+            member->name[strcspn (member->name, " /")] = '\0';
+            
+            member->offset = ftell (arfp);
+            member->size = bytes;
+            
+            dynarray_add (&members, &nb_members, member);
+        
+        }
+        
+        if (bytes % 2) {
+            bytes++;
+        }
+        
+        fseek (arfp, bytes, SEEK_CUR);
+    
+    }
+
+}
+
+int copy_contents (FILE *ifp, FILE *ofp, const struct member *member, char *contents) {
+
+    long bytes = member->size, read;
+    
+    fseek (ifp, member->offset, SEEK_SET);
+    
+    while (bytes > 0) {
+    
+        read = (bytes >= COPY_BUFFER_SIZE) ? COPY_BUFFER_SIZE : bytes;
+        
+        if (fread (contents, read, 1, ifp) != 1) {
+        
+            report_at (NULL, 0, REPORT_ERROR, "failed to read %ld bytes from %s", bytes, state->outfile);
+            exit (EXIT_FAILURE);
+        
+        }
+        
+        if (fwrite (contents, read, 1, ofp) != 1) {
+            return 1;
+        }
+        
+        bytes -= read;
+    
+    }
+    
+    return 0;
+
+}
+
+static int copy_member (FILE *ofp, struct member *member, char *contents) {
+
+    if (fwrite (&member->hdr, sizeof (member->hdr), 1, ofp) != 1) {
+        return 1;
+    }
+    
+    if (copy_contents (arfp, ofp, member, contents)) {
+        return 1;
+    }
+    
+    if (member->size % 2) {
+    
+        if (fwrite ("\x0A", 1, 1, ofp) != 1) {
+            return 1;
+        }
+    
+    }
+    
+    return 0;
+
+}
+
+/**
+ * Writes the new archive next to the old one in a single pass
+ * and renames it over the old one, so the archive is never left
+ * half written. The symbol index (if any) is written before the members.
+ */
+void write_members (const void *index, long index_size) {
+
+    FILE *tfp;
+    char *tname, *contents;
+    long i;
+    
+    tname = xmalloc (strlen (state->outfile) + 5);
+    sprintf (tname, "%s.tmp", state->outfile);
+    
+    if ((tfp = fopen (tname, "wb")) == NULL) {
+    
+        report_at (program_name, 0, REPORT_ERROR, "failed to open %s for writing", tname);
+        exit (EXIT_FAILURE);
+    
+    }
+    
+    if (fwrite ("!<arch>\x0A", 8, 1, tfp) != 1) {
+        goto write_error;
+    }
+    
+    if (index_size && fwrite (index, index_size, 1, tfp) != 1) {
+        goto write_error;
+    }
+    
+    contents = xmalloc (COPY_BUFFER_SIZE);
+    
+    for (i = 0; i < nb_members; i++) {
+    
+        struct member *member = members[i];
+        
+        if (member->fname) {
+        
+            long pos = ftell (tfp);
+            
+            if (append (tfp, member->fname) == 0) {
+                continue;
+            }
+            
+            if (ftell (tfp) != pos) {
+            
+                free (contents);
+                goto write_error;
+            
+            }
+            
+            /* Keep the old contents if the new file cannot be added. */
+            if (member->offset < 0) {
+                continue;
+            }
+        
+        }
+        
+        if (copy_member (tfp, member, contents)) {
+        
+            free (contents);
+            goto write_error;
+        
+        }
+    
+    }
+    
+    free (contents);
+    
+    if (fclose (tfp)) {
+    
+        tfp = NULL;
+        goto write_error;
+    
+    }
+    
+    fclose (arfp);
+    
+    if (rename (tname, state->outfile)) {
+    
+        /* Some hosts cannot rename over an existing file. */
+        remove (state->outfile);
+        
+        if (rename (tname, state->outfile)) {
+        
+            report_at (program_name, 0, REPORT_ERROR, "failed to rename %s to %s", tname, state->outfile);
+            exit (EXIT_FAILURE);
+        
+        }
+    
+    }
+    
+    free (tname);
+    
+    if ((arfp = fopen (state->outfile, "rb")) == NULL) {
+    
+        report_at (program_name, 0, REPORT_ERROR, "failed to open %s", state->outfile);
+        exit (EXIT_FAILURE);
+    
+    }
+    
+    return;
+
+write_error:
+
+    if (tfp) {
+        fclose (tfp);
+    }
+    
+    remove (tname);
+    
+    report_at (program_name, 0, REPORT_ERROR, "failed whilst writing %s", tname);
+    exit (EXIT_FAILURE);
+
+}
+
+void free_members (void) {
+
+    long i;
+    
+    for (i = 0; i < nb_members; i++) {
+        free (members[i]);
+    }
+    
+    free (members);
+    
+    members = 0;
+    nb_members = 0;
+
+}
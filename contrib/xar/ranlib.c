@@ -16,6 +16,14 @@
 #define     GET_UINT16(arr)             ((uint32_t) arr[0] | (((uint32_t) arr[1]) << 8))
 #define     GET_UINT32(arr)             ((uint32_t) arr[0] | (((uint32_t) arr[1]) << 8) | (((uint32_t) arr[2]) << 16) | (((uint32_t) arr[3]) << 24))
 
+/**
+ * Optional member following the symbol index ('h' modifier):
+ * big-endian number of symbols and number of slots (a power of two),
+ * then the slots holding the index of a symbol in the symbol index plus one
+ * (zero for empty slots), placed by FNV-1a of the name with linear probing.
+ */
+#define     HASH_MEMBER_NAME            "/<SYMHASH>/"
+
 struct aout_exec {
 
     unsigned char a_info[4];
@@ -68,6 +76,28 @@ struct coff_symbol {
 
 };
 
+/**
+ * Symbols of each member are cached next to the archive
+ * keyed by the name, mtime and size fields of the member header
+ * (and the number of earlier members with the same key),
+ * so only new or changed members need to be parsed again.
+ */
+#define     CACHE_KEY_SIZE              38
+#define     CACHE_MAGIC                 "xar symbol cache 4\n"
+
+struct cache_entry {
+
+    char key[CACHE_KEY_SIZE];
+    long occurrence;
+    
+    char **names;
+    long nb_names;
+
+};
+
+static struct cache_entry **cache_entries = 0;
+static long nb_cache_entries = 0;
+
 struct strtab {
 
     const char *name;
@@ -115,7 +145,18 @@ static int add_strtab (struct gstrtab *gstrtab, struct strtab *strtab) {
 
 }
 
-static void aout_get_symbols (void *object, long offset) {
+static void add_name (struct cache_entry *entry, const char *name, long length) {
+
+    char *temp = xmalloc (length + 1);
+    
+    memcpy (temp, name, length);
+    temp[length] = '\0';
+    
+    dynarray_add (&entry->names, &entry->nb_names, temp);
+
+}
+
+static void aout_get_symbols (void *object, struct cache_entry *entry) {
 
     struct aout_exec *hdr = (struct aout_exec *) object;
     
@@ -129,16 +170,8 @@ static void aout_get_symbols (void *object, long offset) {
         
         if (nlist.n_type == 5 || nlist.n_type == 7 || nlist.n_type == 9) {
         
-            struct strtab *strtab;
             char *symname = (char *) object + strtab_start + GET_INT32 (nlist.n_strx);
-            
-            strtab = xmalloc (sizeof (*strtab));
-            strtab->length = strlen (symname);
-            
-            strtab->name = xstrdup (symname);
-            strtab->offset = offset;
-            
-            add_strtab (&gstrtab, strtab);
+            add_name (entry, symname, strlen (symname));
         
         }
         
@@ -148,7 +181,7 @@ static void aout_get_symbols (void *object, long offset) {
 
 }
 
-static void coff_get_symbols (void *object, long offset) {
+static void coff_get_symbols (void *object, struct cache_entry *entry) {
 
     struct coff_exec *hdr = (struct coff_exec *) object;
     
@@ -163,8 +196,6 @@ static void coff_get_symbols (void *object, long offset) {
         
         if (sym.StorageClass[0] == 2 && GET_UINT16 (sym.SectionNumber) != 0) {
         
-            struct strtab *strtab;
-            
             if (sym.Name[0] != 0) {
             
                 int i, len;
@@ -179,13 +210,7 @@ static void coff_get_symbols (void *object, long offset) {
                 
                 }
                 
-                strtab = xmalloc (sizeof (*strtab));
-                strtab->length = len;
-                
-                strtab->name = xstrdup (sym.Name);
-                strtab->offset = offset;
-                
-                add_strtab (&gstrtab, strtab);
+                add_name (entry, sym.Name, len);
             
             } else {
             
@@ -197,13 +222,7 @@ static void coff_get_symbols (void *object, long offset) {
                 long final_offset = ((uint32_t) offset1 | (((uint32_t) offset2) << 8) | (((uint32_t) offset3) << 16) | (((uint32_t) offset4) << 24));
                 final_offset += string_table_start;
                 
-                strtab = xmalloc (sizeof (*strtab));
-                strtab->length = strlen ((char *) object + final_offset);
-                
-                strtab->name = xstrdup ((char *) object + final_offset);
-                strtab->offset = offset;
-                
-                add_strtab (&gstrtab, strtab);
+                add_name (entry, (char *) object + final_offset, strlen ((char *) object + final_offset));
             
             }
         
@@ -215,327 +234,844 @@ static void coff_get_symbols (void *object, long offset) {
 
 }
 
-void ranlib (void) {
+static unsigned long elf_read (const unsigned char *p, int size, int msb) {
 
-    FILE *tfp = tmpfile ();
-    long offset = 0;
+    unsigned long value = 0;
+    int i;
     
-    struct ar_header header;
-    long bytes, i, j, len, read, val;
+    /* Values which do not fit in 32 bits are never valid within a member. */
+    if (size == 8) {
     
-    unsigned char *object;
-    void *contents;
+        if (elf_read (p + (msb ? 0 : 4), 4, msb)) {
+            return ULONG_MAX;
+        }
+        
+        return elf_read (p + (msb ? 4 : 0), 4, msb);
     
-    char temp[16];
-    int valid = 0;
+    }
     
-    for (;;) {
+    for (i = 0; i < size; i++) {
+        value = (value << 8) | p[msb ? i : (size - 1 - i)];
+    }
+    
+    return value;
+
+}
+
+/**
+ * Both ELF classes and byte orders are handled,
+ * global and weak symbols defined in the object are indexed.
+ */
+static void elf_get_symbols (unsigned char *object, unsigned long size, struct cache_entry *entry) {
+
+    int is64 = (object[4] == 2), msb = (object[5] == 2);
+    unsigned long shoff, shentsize, shnum, i, j;
+    
+    if (size < (is64 ? 64UL : 52UL)) {
+        return;
+    }
+    
+    shoff = elf_read (object + (is64 ? 40 : 32), is64 ? 8 : 4, msb);
+    shentsize = elf_read (object + (is64 ? 58 : 46), 2, msb);
+    shnum = elf_read (object + (is64 ? 60 : 48), 2, msb);
     
-        struct ar_header hdr;
-        long bytes;
+    if (shoff >= size || shentsize < (is64 ? 64UL : 40UL) || shnum > (size - shoff) / shentsize) {
+        return;
+    }
+    
+    for (i = 0; i < shnum; i++) {
+    
+        unsigned char *sh = object + shoff + i * shentsize, *strsh;
+        unsigned long symoff, symsize, symentsize, stroff, strsize, link;
         
-        if (fread (&hdr, sizeof (hdr), 1, arfp) != 1) {
+        /* SHT_SYMTAB */
+        if (elf_read (sh + 4, 4, msb) != 2) {
+            continue;
+        }
         
-            if (feof (arfp)) {
-                break;
-            }
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whilst reading '%s'", state->outfile);
-            return;
+        symoff = elf_read (sh + (is64 ? 24 : 16), is64 ? 8 : 4, msb);
+        symsize = elf_read (sh + (is64 ? 32 : 20), is64 ? 8 : 4, msb);
+        link = elf_read (sh + (is64 ? 40 : 24), 4, msb);
+        symentsize = elf_read (sh + (is64 ? 56 : 36), is64 ? 8 : 4, msb);
         
+        if (link >= shnum || symentsize < (is64 ? 24UL : 16UL) || symoff > size || symsize > size - symoff) {
+            continue;
         }
         
-        bytes = conv_dec (hdr.size, 10);
+        strsh = object + shoff + link * shentsize;
         
-        if (bytes % 2) {
-            bytes++;
+        stroff = elf_read (strsh + (is64 ? 24 : 16), is64 ? 8 : 4, msb);
+        strsize = elf_read (strsh + (is64 ? 32 : 20), is64 ? 8 : 4, msb);
+        
+        if (stroff > size || strsize > size - stroff) {
+            continue;
         }
         
-        if (memcmp (hdr.name, "/", 1) == 0) {
+        for (j = 1; j < symsize / symentsize; j++) {
         
-            fseek (arfp, bytes, SEEK_CUR);
-            continue;
+            unsigned char *sym = object + symoff + j * symentsize;
+            unsigned long name, shndx;
+            
+            char *symname, *end;
+            int bind;
+            
+            name = elf_read (sym, 4, msb);
+            bind = sym[is64 ? 4 : 12] >> 4;
+            shndx = elf_read (sym + (is64 ? 6 : 14), 2, msb);
+            
+            /* STB_GLOBAL and STB_WEAK, not SHN_UNDEF or SHN_COMMON. */
+            if ((bind != 1 && bind != 2) || shndx == 0 || shndx == 0xFFF2 || name >= strsize) {
+                continue;
+            }
+            
+            symname = (char *) object + stroff + name;
+            
+            if ((end = memchr (symname, '\0', strsize - name)) == NULL) {
+                continue;
+            }
+            
+            add_name (entry, symname, end - symname);
         
         }
+    
+    }
+
+}
+
+static void member_key (const struct member *member, char *key) {
+
+    memcpy (key, member->hdr.name, 16);
+    memcpy (key + 16, member->hdr.mtime, 12);
+    memcpy (key + 28, member->hdr.size, 10);
+
+}
+
+static int entry_compare (const void *a, const void *b) {
+
+    const struct cache_entry *entry1 = *(const struct cache_entry *const *) a;
+    const struct cache_entry *entry2 = *(const struct cache_entry *const *) b;
+    
+    int ret;
+    
+    if ((ret = memcmp (entry1->key, entry2->key, CACHE_KEY_SIZE))) {
+        return ret;
+    }
+    
+    if (entry1->occurrence < entry2->occurrence) {
+        return -1;
+    }
+    
+    return (entry1->occurrence > entry2->occurrence);
+
+}
+
+static char *cache_name (void) {
+
+    char *name = xmalloc (strlen (state->outfile) + 10);
+    sprintf (name, "%s.symcache", state->outfile);
+    
+    return name;
+
+}
+
+static char *read_line (FILE *fp) {
+
+    char *line = 0;
+    long len = 0, max = 0;
+    
+    int ch;
+    
+    while ((ch = getc (fp)) != EOF && ch != '\n') {
+    
+        if (len + 1 >= max) {
+        
+            max = max ? (max * 2) : 64;
+            line = xrealloc (line, max);
+        
+        }
+        
+        line[len++] = ch;
+    
+    }
+    
+    if (ch == EOF) {
+    
+        free (line);
+        return 0;
+    
+    }
+    
+    if (!line) {
+        line = xmalloc (1);
+    }
+    
+    line[len] = '\0';
+    return line;
+
+}
+
+static void free_entry (struct cache_entry *entry) {
+
+    long i;
+    
+    for (i = 0; i < entry->nb_names; i++) {
+        free (entry->names[i]);
+    }
+    
+    free (entry->names);
+    free (entry);
+
+}
+
+static void free_cache (void) {
+
+    long i;
+    
+    for (i = 0; i < nb_cache_entries; i++) {
+        free_entry (cache_entries[i]);
+    }
+    
+    free (cache_entries);
+    
+    cache_entries = 0;
+    nb_cache_entries = 0;
+
+}
+
+/**
+ * A damaged or foreign cache is ignored as a whole,
+ * which only means all members are parsed again.
+ */
+static int load_cache (void) {
+
+    char *name = cache_name (), *line;
+    char magic[sizeof (CACHE_MAGIC) - 1];
+    
+    FILE *cfp;
+    
+    if ((cfp = fopen (name, "rb")) == NULL) {
+    
+        free (name);
+        return 1;
+    
+    }
+    
+    free (name);
+    
+    if (fread (magic, sizeof (magic), 1, cfp) != 1 || memcmp (magic, CACHE_MAGIC, sizeof (magic))) {
+    
+        fclose (cfp);
+        return 1;
+    
+    }
+    
+    for (;;) {
+    
+        struct cache_entry *entry;
+        long count;
         
-        object = xmalloc (bytes);
+        entry = xmalloc (sizeof (*entry));
         
-        if (fread (object, bytes, 1, arfp) != 1) {
+        if (fread (entry->key, CACHE_KEY_SIZE, 1, cfp) != 1) {
         
-            free (object);
+            free (entry);
             
-            report_at (program_name, 0, REPORT_ERROR, "failed to read %ld bytes from %s", bytes, state->outfile);
-            exit (EXIT_FAILURE);
+            if (feof (cfp)) {
+                break;
+            }
             
+            goto damaged;
         
         }
         
-        valid = ((object[0] == 0x07 && object[1] == 0x01) || (object[0] == 0x4C && object[1] == 0x01) || (object[0] == 0x64 && object[1] == 0x86));
+        entry->names = 0;
+        entry->nb_names = 0;
         
-        if (!valid) {
+        if ((line = read_line (cfp)) == NULL || sscanf (line, " %ld %ld", &entry->occurrence, &count) != 2 || count < 0) {
         
-            free (object);
-            
-            offset += sizeof (hdr);
-            offset += bytes;
+            free (line);
+            free (entry);
             
-            fseek (arfp, bytes, SEEK_CUR);
-            continue;
+            goto damaged;
         
         }
         
-        if (object[0] == 0x07 && object[1] == 0x01) {
-            aout_get_symbols (object, offset + 8);
-        } else {
-            coff_get_symbols (object, offset + 8);
-        }
+        free (line);
+        dynarray_add (&cache_entries, &nb_cache_entries, entry);
         
-        free (object);
+        while (count--) {
+        
+            if ((line = read_line (cfp)) == NULL) {
+                goto damaged;
+            }
+            
+            dynarray_add (&entry->names, &entry->nb_names, line);
         
-        offset += sizeof (hdr);
-        offset += bytes;
+        }
     
     }
     
-    fseek (arfp, 8, SEEK_SET);
-    bytes = 0;
+    fclose (cfp);
     
-    for (i = 0; i < gstrtab.count; ++i) {
-        bytes += gstrtab.strtabs[i].length + 5;
+    if (nb_cache_entries) {
+        qsort (cache_entries, nb_cache_entries, sizeof (*cache_entries), &entry_compare);
     }
     
-    for (i = 0; i < gstrtab.count; ++i) {
+    return 0;
+
+damaged:
+
+    fclose (cfp);
+    free_cache ();
     
-        gstrtab.strtabs[i].offset += bytes;
-        
-        if (bytes % 2) {
-            gstrtab.strtabs[i].offset++;
-        }
+    return 1;
+
+}
+
+/**
+ * The cache is only an optimization,
+ * so failing to write it is not an error.
+ */
+static void save_cache (struct cache_entry **entries, long nb_entries) {
+
+    char *name = cache_name (), *tname;
+    FILE *cfp;
     
-    }
+    long i, j;
+    int ret = 0;
     
-    if (fwrite ("!<arch>\x0A", 8, 1, tfp) != 1) {
+    tname = xmalloc (strlen (name) + 5);
+    sprintf (tname, "%s.tmp", name);
     
-        fclose (tfp);
+    if ((cfp = fopen (tname, "wb")) == NULL) {
+    
+        free (tname);
+        free (name);
         
-        report_at (program_name, 0, REPORT_ERROR, "failed whist writing ar header");
         return;
     
     }
     
-    memset (temp, 0x20, 16);
-    temp[0] = '0';
+    if (fwrite (CACHE_MAGIC, sizeof (CACHE_MAGIC) - 1, 1, cfp) != 1) {
+        ret = 1;
+    }
     
-    len = 1;
-    memcpy (header.name, "/", len);
+    for (i = 0; i < nb_entries && !ret; i++) {
+    
+        struct cache_entry *entry = entries[i];
+        
+        if (fwrite (entry->key, CACHE_KEY_SIZE, 1, cfp) != 1 || fprintf (cfp, " %ld %ld\n", entry->occurrence, entry->nb_names) < 0) {
+            ret = 1;
+        }
+        
+        for (j = 0; j < entry->nb_names && !ret; j++) {
+        
+            if (fprintf (cfp, "%s\n", entry->names[j]) < 0) {
+                ret = 1;
+            }
+        
+        }
     
-    while (len < 16) {
-        header.name[len++] = 0x20;
     }
     
-    memcpy (header.mtime, temp, 12);
-    memcpy (header.owner, temp, 6);
-    memcpy (header.group, temp, 6);
-    memcpy (header.mode, temp, 8);
+    if (fclose (cfp) || ret) {
+        remove (tname);
+    } else {
     
-    len = sprintf (temp, "%ld", bytes + 4);
-    temp[len] = 0x20;
+        remove (name);
+        
+        if (rename (tname, name)) {
+            remove (tname);
+        }
     
-    memcpy (header.size, temp, 10);
+    }
     
-    header.endsig[0] = 0x60;
-    header.endsig[1] = 0x0A;
+    free (tname);
+    free (name);
+
+}
+
+static char *member_keys = 0;
+
+static int member_index_compare (const void *a, const void *b) {
+
+    long index1 = *(const long *) a;
+    long index2 = *(const long *) b;
     
-    if (fwrite (&header, sizeof (header), 1, tfp) != 1) {
+    int ret;
     
-        fclose (tfp);
-        
-        report_at (program_name, 0, REPORT_ERROR, "failed whilst writing header");
-        return;
+    if ((ret = memcmp (member_keys + index1 * CACHE_KEY_SIZE, member_keys + index2 * CACHE_KEY_SIZE, CACHE_KEY_SIZE))) {
+        return ret;
+    }
     
+    if (index1 < index2) {
+        return -1;
     }
     
-    val = gstrtab.count;
+    return (index1 > index2);
+
+}
+
+/**
+ * Finds the cache entry of each member (NULL when there is none).
+ * Members with the same key are told apart by their number in archive order.
+ * Members with mtime 0 (added by other tools in deterministic mode)
+ * could change without their header changing, so they are always parsed.
+ * The keys are left in member_keys for the caller to free.
+ */
+static struct cache_entry **lookup_members (long *occurrences) {
+
+    struct cache_entry **found, key, *keyp = &key, **entry;
+    long *order, i;
+    
+    found = xmalloc (sizeof (*found) * (nb_members + 1));
+    order = xmalloc (sizeof (*order) * (nb_members + 1));
     
-    for (i = 0; i < 4; ++i) {
-        temp[4 - 1 - i] = (val >> (CHAR_BIT * i)) & UCHAR_MAX;
-    }
+    member_keys = xmalloc (CACHE_KEY_SIZE * (nb_members + 1));
+    
+    for (i = 0; i < nb_members; i++) {
+    
+        member_key (members[i], member_keys + i * CACHE_KEY_SIZE);
+        order[i] = i;
     
-    if (fwrite (temp, 4, 1, tfp) != 1) {
-        exit (EXIT_FAILURE);
     }
     
-    for (i = 0; i < gstrtab.count; ++i) {
+    qsort (order, nb_members, sizeof (*order), &member_index_compare);
     
-        val = gstrtab.strtabs[i].offset + 4 + sizeof (header);
-        
-        for (j = 0; j < 4; ++j) {
-            temp[4 - 1 - j] = (val >> (CHAR_BIT * j)) & UCHAR_MAX;
-        }
+    for (i = 0; i < nb_members; i++) {
+    
+        occurrences[order[i]] = 0;
         
-        if (fwrite (temp, 4, 1, tfp) != 1) {
-            exit (EXIT_FAILURE);
+        if (i > 0 && memcmp (member_keys + order[i - 1] * CACHE_KEY_SIZE, member_keys + order[i] * CACHE_KEY_SIZE, CACHE_KEY_SIZE) == 0) {
+            occurrences[order[i]] = occurrences[order[i - 1]] + 1;
         }
     
     }
     
-    for (i = 0; i < gstrtab.count; ++i) {
+    for (i = 0; i < nb_members; i++) {
     
-        const char *name = gstrtab.strtabs[i].name;
-        long length = gstrtab.strtabs[i].length;
+        memcpy (key.key, member_keys + i * CACHE_KEY_SIZE, CACHE_KEY_SIZE);
+        key.occurrence = occurrences[i];
         
-        if (fwrite (name, length, 1, tfp) != 1) {
-            exit (EXIT_FAILURE);
-        }
+        found[i] = 0;
         
-        temp[0] = '\0';
+        if (conv_dec (members[i]->hdr.mtime, 12) == 0) {
+            continue;
+        }
         
-        if (fwrite (temp, 1, 1, tfp) != 1) {
-            exit (EXIT_FAILURE);
+        if (nb_cache_entries && (entry = bsearch (&keyp, cache_entries, nb_cache_entries, sizeof (*cache_entries), &entry_compare))) {
+            found[i] = *entry;
         }
     
     }
     
-    if (bytes % 2) {
+    free (order);
+    return found;
+
+}
+
+static int key_compare (const void *a, const void *b) {
+    return memcmp (a, b, CACHE_KEY_SIZE);
+}
+
+/**
+ * Called after 'q' and before the members are written by 'r' and 'd',
+ * drops the cache entries whose key matches no member kept unchanged,
+ * so the cache does not grow with every replaced member.
+ */
+void ranlib_prune_cache (void) {
+
+    struct cache_entry **kept;
+    char *keys;
     
-        temp[0] = '\0';
-        
-        if (fwrite (temp, 1, 1, tfp) != 1) {
-            exit (EXIT_FAILURE);
+    long nb_keys = 0, nb_kept = 0, i;
+    
+    if (load_cache ()) {
+        return;
+    }
+    
+    keys = xmalloc (CACHE_KEY_SIZE * (nb_members + 1));
+    
+    for (i = 0; i < nb_members; i++) {
+    
+        if (!members[i]->fname) {
+            member_key (members[i], keys + CACHE_KEY_SIZE * nb_keys++);
         }
     
     }
     
-    for (;;) {
+    qsort (keys, nb_keys, CACHE_KEY_SIZE, &key_compare);
+    kept = xmalloc (sizeof (*kept) * (nb_cache_entries + 1));
     
-        struct ar_header hdr;
-        
-        if (fread (&hdr, sizeof (hdr), 1, arfp) != 1) {
-        
-            if (feof (arfp)) {
-                break;
-            }
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whilst reading '%s'", state->outfile);
-            return;
-        
+    for (i = 0; i < nb_cache_entries; i++) {
+    
+        if (nb_keys && bsearch (cache_entries[i]->key, keys, nb_keys, CACHE_KEY_SIZE, &key_compare)) {
+            kept[nb_kept++] = cache_entries[i];
         }
+    
+    }
+    
+    if (nb_kept < nb_cache_entries) {
+        save_cache (kept, nb_kept);
+    }
+    
+    free (kept);
+    free (keys);
+    
+    free_cache ();
+
+}
+
+/**
+ * Called when the archive is created, a symbol cache left over
+ * from an earlier archive with the same name is of no use.
+ */
+void ranlib_remove_cache (void) {
+
+    char *name = cache_name ();
+    
+    remove (name);
+    free (name);
+
+}
+
+static struct cache_entry *parse_member (const struct member *member, const char *key, long occurrence) {
+
+    struct cache_entry *entry = xmalloc (sizeof (*entry));
+    unsigned char *object;
+    
+    memcpy (entry->key, key, CACHE_KEY_SIZE);
+    entry->occurrence = occurrence;
+    
+    entry->names = 0;
+    entry->nb_names = 0;
+    
+    if (member->size < 2) {
+        return entry;
+    }
+    
+    object = xmalloc (member->size);
+    fseek (arfp, member->offset, SEEK_SET);
+    
+    if (fread (object, member->size, 1, arfp) != 1) {
+    
+        free (object);
         
+        report_at (program_name, 0, REPORT_ERROR, "failed to read %ld bytes from %s", member->size, state->outfile);
+        exit (EXIT_FAILURE);
+    
+    }
+    
+    if (object[0] == 0x07 && object[1] == 0x01) {
+        aout_get_symbols (object, entry);
+    } else if ((object[0] == 0x4C && object[1] == 0x01) || (object[0] == 0x64 && object[1] == 0x86)) {
+        coff_get_symbols (object, entry);
+    } else if (member->size >= 6 && memcmp (object, "\x7F" "ELF", 4) == 0) {
+        elf_get_symbols (object, member->size, entry);
+    }
+    
+    free (object);
+    return entry;
+
+}
+
+/**
+ * Returns the size of the index members ('/' names) at the start of the archive
+ * when the other members follow them directly and nothing else is in the archive,
+ * so the index can be overwritten in place if its size does not change.
+ */
+static long old_index_size (void) {
+
+    struct ar_header hdr;
+    long bytes, end = 8, i;
+    
+    fseek (arfp, 8, SEEK_SET);
+    
+    while (fread (&hdr, sizeof (hdr), 1, arfp) == 1 && hdr.name[0] == '/') {
+    
         bytes = conv_dec (hdr.size, 10);
         
         if (bytes % 2) {
             bytes++;
         }
         
-        if (memcmp (hdr.name, "/", 1) == 0) {
-        
-            fseek (arfp, bytes, SEEK_CUR);
-            continue;
-        
+        end += sizeof (hdr) + bytes;
+        fseek (arfp, end, SEEK_SET);
+    
+    }
+    
+    if (end == 8) {
+        return -1;
+    }
+    
+    bytes = end - 8;
+    
+    for (i = 0; i < nb_members; i++) {
+    
+        if (members[i]->offset != end + (long) sizeof (hdr)) {
+            return -1;
         }
         
-        if (fwrite (&hdr, sizeof (hdr), 1, tfp) != 1) {
+        end = members[i]->offset + members[i]->size + (members[i]->size % 2);
+    
+    }
+    
+    fseek (arfp, 0, SEEK_END);
+    
+    if (ftell (arfp) != end) {
+        return -1;
+    }
+    
+    return bytes;
+
+}
+
+static void write_index (const unsigned char *index, long index_size) {
+
+    unsigned char *old;
+    
+    old = xmalloc (index_size);
+    fseek (arfp, 8, SEEK_SET);
+    
+    /* Nothing needs to be written when the index did not change. */
+    if (fread (old, index_size, 1, arfp) == 1 && memcmp (old, index, index_size) == 0) {
+    
+        free (old);
+        return;
+    
+    }
+    
+    free (old);
+    fclose (arfp);
+    
+    if ((arfp = fopen (state->outfile, "r+b")) == NULL) {
+    
+        report_at (program_name, 0, REPORT_ERROR, "failed to open %s", state->outfile);
+        exit (EXIT_FAILURE);
+    
+    }
+    
+    fseek (arfp, 8, SEEK_SET);
+    
+    if (fwrite (index, index_size, 1, arfp) != 1 || fflush (arfp)) {
+    
+        report_at (program_name, 0, REPORT_ERROR, "failed whist writing %s", state->outfile);
+        exit (EXIT_FAILURE);
+    
+    }
+
+}
+
+static unsigned char *put_uint32 (unsigned char *p, unsigned long val) {
+
+    int i;
+    
+    for (i = 0; i < 4; ++i) {
+        p[4 - 1 - i] = (val >> (CHAR_BIT * i)) & UCHAR_MAX;
+    }
+    
+    return p + 4;
+
+}
+
+static unsigned char *put_header (unsigned char *p, const char *name, long size) {
+
+    struct ar_header header;
+    
+    char temp[16];
+    long len;
+    
+    memset (temp, 0x20, 16);
+    temp[0] = '0';
+    
+    len = strlen (name);
+    memcpy (header.name, name, len);
+    
+    while (len < 16) {
+        header.name[len++] = 0x20;
+    }
+    
+    memcpy (header.mtime, temp, 12);
+    memcpy (header.owner, temp, 6);
+    memcpy (header.group, temp, 6);
+    memcpy (header.mode, temp, 8);
+    
+    len = sprintf (temp, "%ld", size);
+    temp[len] = 0x20;
+    
+    memcpy (header.size, temp, 10);
+    
+    header.endsig[0] = 0x60;
+    header.endsig[1] = 0x0A;
+    
+    memcpy (p, &header, sizeof (header));
+    return p + sizeof (header);
+
+}
+
+/**
+ * 32-bit FNV-1a, pdld must hash the names the same way
+ * to find them in the hashed symbol index.
+ */
+static unsigned long symbol_hash (const char *name) {
+
+    unsigned long hash = 2166136261UL;
+    
+    while (*name) {
+    
+        hash ^= (unsigned char) *name++;
+        hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+    
+    }
+    
+    return hash;
+
+}
+
+void ranlib (void) {
+
+    struct cache_entry **entries;
+    
+    unsigned char *index, *p;
+    long *occurrences, *offsets;
+    
+    long bytes, i, j, index_size, val;
+    unsigned long nb_slots = 0;
+    
+    read_members ();
+    load_cache ();
+    
+    occurrences = xmalloc (sizeof (*occurrences) * (nb_members + 1));
+    entries = lookup_members (occurrences);
+    
+    /* Only members without a cache entry are read and parsed. */
+    for (i = 0; i < nb_members; i++) {
+    
+        if (!entries[i]) {
         
-            fclose (tfp);
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whilst writing header");
-            exit (EXIT_FAILURE);
+            entries[i] = parse_member (members[i], member_keys + i * CACHE_KEY_SIZE, occurrences[i]);
+            dynarray_add (&cache_entries, &nb_cache_entries, entries[i]);
         
         }
         
-        contents = xmalloc (512);
-        
-        for (;;) {
+        for (j = 0; j < entries[i]->nb_names; j++) {
         
-            if (bytes == 0 || feof (arfp)) {
-                break;
-            } else if (bytes >= 512) {
-                read = 512;
-            } else {
-                read = bytes;
-            }
+            struct strtab strtab;
             
-            if (fread (contents, read, 1, arfp) != 1) {
+            strtab.name = entries[i]->names[j];
+            strtab.length = strlen (strtab.name);
+            strtab.offset = i;
             
-                free (contents);
-                fclose (tfp);
-                
-                report_at (NULL, 0, REPORT_ERROR, "failed to read %ld bytes from %s", bytes, state->outfile);
-                exit (EXIT_FAILURE);
+            if (add_strtab (&gstrtab, &strtab)) {
             
-            }
-            
-            bytes -= read;
-            
-            if (fwrite (contents, read, 1, tfp) != 1) {
-            
-                free (contents);
-                fclose (tfp);
-                
-                report_at (NULL, 0, REPORT_ERROR, "failed to write temp file");
+                report_at (program_name, 0, REPORT_ERROR, "memory full (malloc)");
                 exit (EXIT_FAILURE);
             
             }
         
         }
-        
-        free (contents);
     
     }
     
-    fclose (arfp);
-    remove (state->outfile);
+    bytes = 0;
+    
+    for (i = 0; i < gstrtab.count; ++i) {
+        bytes += gstrtab.strtabs[i].length + 5;
+    }
+    
+    index_size = sizeof (struct ar_header) + bytes + 4 + (bytes % 2);
     
-    if ((arfp = fopen (state->outfile, "w+b")) == NULL) {
+    if (state->hash) {
     
-        fclose (tfp);
+        for (nb_slots = 1; nb_slots < (unsigned long) gstrtab.count * 2; nb_slots *= 2) {
+            ;
+        }
         
-        report_at (program_name, 0, REPORT_ERROR, "failed to open %s for writing", state->outfile);
-        exit (EXIT_FAILURE);
+        index_size += sizeof (struct ar_header) + 8 + nb_slots * 4;
     
     }
     
-    contents = xmalloc (512);
-    bytes = ftell (tfp);
+    /* Offsets of the member headers once the index is in front of them. */
+    offsets = xmalloc (sizeof (*offsets) * (nb_members + 1));
+    val = 8 + index_size;
     
-    fseek (arfp, 0, SEEK_SET);
-    fseek (tfp, 0, SEEK_SET);
+    for (i = 0; i < nb_members; i++) {
     
-    for (;;) {
+        offsets[i] = val;
+        val += sizeof (struct ar_header) + members[i]->size + (members[i]->size % 2);
     
-        if (bytes == 0 || feof (tfp)) {
-            break;
-        } else if (bytes >= 512) {
-            read = 512;
-        } else {
-            read = bytes;
-        }
+    }
+    
+    p = index = xmalloc (index_size);
+    
+    p = put_header (p, "/", bytes + 4);
+    p = put_uint32 (p, gstrtab.count);
+    
+    for (i = 0; i < gstrtab.count; ++i) {
+        p = put_uint32 (p, offsets[gstrtab.strtabs[i].offset]);
+    }
+    
+    for (i = 0; i < gstrtab.count; ++i) {
+    
+        memcpy (p, gstrtab.strtabs[i].name, gstrtab.strtabs[i].length + 1);
+        p += gstrtab.strtabs[i].length + 1;
+    
+    }
+    
+    if (bytes % 2) {
+        *p++ = '\0';
+    }
+    
+    if (state->hash) {
+    
+        /* xmalloc returns zeroed memory, so all slots start empty. */
+        unsigned long *slots = xmalloc (sizeof (*slots) * nb_slots);
+        
+        for (i = 0; i < gstrtab.count; ++i) {
         
-        if (fread (contents, read, 1, tfp) != 1) {
+            unsigned long slot = symbol_hash (gstrtab.strtabs[i].name) & (nb_slots - 1);
             
-            free (contents);
-            fclose (tfp);
+            while (slots[slot]) {
+                slot = (slot + 1) & (nb_slots - 1);
+            }
             
-            report_at (program_name, 0, REPORT_ERROR, "failed whilst reading temp file");
-            return;
+            slots[slot] = i + 1;
         
         }
         
-        bytes -= read;
-        
-        if (fwrite (contents, read, 1, arfp) != 1) {
-        
-            free (contents);
-            fclose (tfp);
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whist writing %s", state->outfile);
-            exit (EXIT_FAILURE);
+        p = put_header (p, HASH_MEMBER_NAME, 8 + nb_slots * 4);
+        p = put_uint32 (p, gstrtab.count);
+        p = put_uint32 (p, nb_slots);
         
+        for (i = 0; i < (long) nb_slots; ++i) {
+            p = put_uint32 (p, slots[i]);
         }
+        
+        free (slots);
     
     }
     
-    free (contents);
-    fclose (tfp);
+    if (old_index_size () == index_size) {
+        write_index (index, index_size);
+    } else {
+        write_members (index, index_size);
+    }
+    
+    save_cache (entries, nb_members);
+    
+    free (member_keys);
+    member_keys = 0;
+    
+    free (index);
+    free (offsets);
+    free (entries);
+    free (occurrences);
+    
+    free (gstrtab.strtabs);
+    gstrtab.strtabs = NULL;
+    gstrtab.count = 0;
+    
+    free_cache ();
+    free_members ();
 
 }
@@ -11,182 +11,39 @@
 
 void replace (char *fname) {
 
-    FILE *tfp = tmpfile ();
+    struct member *member;
     
-    char temp[17], *name, *p, *contents;
-    long bytes, len, read;
+    char temp[17];
+    long i, len;
     
-    if (fwrite ("!<arch>\x0A", 8, 1, tfp) != 1) {
+    int found = 0;
     
-        fclose (tfp);
-        
-        report_at (program_name, 0, REPORT_ERROR, "failed whist writing ar header");
-        return;
-    
-    }
-    
-    name = fname;
-    
-    if ((p = strrchr (fname, '/'))) {
-        name = (p + 1);
-    }
+    len = member_name (temp, fname);
     
-    len = strlen (name);
+    for (i = 0; i < nb_members; i++) {
     
-    if (len > 16) {
-        len = 16;
-    }
-    
-    memcpy (temp, name, len);
-    temp[len] = '\0';
-    
-    state->append = 1;
-    
-    for (;;) {
-    
-        struct ar_header hdr;
-        
-        if (fread (&hdr, sizeof (hdr), 1, arfp) != 1) {
-        
-            if (feof (arfp)) {
-                break;
-            }
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whilst reading '%s'", state->outfile);
-            return;
-        
-        }
-        
-        bytes = conv_dec (hdr.size, 10);
-        
-        if (bytes % 2) {
-            bytes++;
-        }
-        
-        if (memcmp (hdr.name, "/", 1) == 0) {
-        
-            fseek (arfp, bytes, SEEK_CUR);
-            continue;
-        
-        }
-        
-        if (memcmp (hdr.name, temp, len) == 0) {
-        
-            state->append = 0;
-            append (tfp, fname);
-            
-            fseek (arfp, bytes, SEEK_CUR);
-            continue;
-        
-        }
-        
-        if (fwrite (&hdr, sizeof (hdr), 1, tfp) != 1) {
+        if (member_matches (members[i], temp)) {
         
-            fclose (tfp);
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whilst writing header");
-            exit (EXIT_FAILURE);
+            members[i]->fname = fname;
+            found = 1;
         
         }
-        
-        contents = xmalloc (512);
-        
-        for (;;) {
-        
-            if (bytes == 0 || feof (arfp)) {
-                break;
-            } else if (bytes >= 512) {
-                read = 512;;
-            } else {
-                read = bytes;
-            }
-            
-            if (fread (contents, read, 1, arfp) != 1) {
-            
-                free (contents);
-                
-                report_at (NULL, 0, REPORT_ERROR, "failed to read %ld bytes from %s", bytes, state->outfile);
-                exit (EXIT_FAILURE);
-            
-            }
-            
-            bytes -= read;
-            
-            if (fwrite (contents, read, 1, tfp) != 1) {
-            
-                free (contents);
-                
-                report_at (NULL, 0, REPORT_ERROR, "failed to write temp file");
-                exit (EXIT_FAILURE);
-            
-            }
-        
-        }
-        
-        free (contents);
-    
-    }
-    
-    if (state->append) {
-    
-        state->append = 0;
-        append (tfp, fname);
     
     }
     
-    fclose (arfp);
-    remove (state->outfile);
-    
-    if ((arfp = fopen (state->outfile, "w+b")) == NULL) {
-    
-        fclose (tfp);
-        
-        report_at (program_name, 0, REPORT_ERROR, "failed to open %s", state->outfile);
-        exit (EXIT_FAILURE);
-    
+    if (found) {
+        return;
     }
     
-    contents = xmalloc (512);
-    bytes = ftell (tfp);
-    
-    fseek (arfp, 0, SEEK_SET);
-    fseek (tfp, 0, SEEK_SET);
+    member = xmalloc (sizeof (*member));
     
-    for (;;) {
+    memset (member->hdr.name, 0x20, 16);
+    memcpy (member->hdr.name, temp, len);
+    strcpy (member->name, temp);
     
-        if (bytes == 0 || feof (tfp)) {
-            break;
-        } else if (bytes >= 512) {
-            read = 512;
-        } else {
-            read = bytes;
-        }
-        
-        if (fread (contents, read, 1, tfp) != 1) {
-            
-            free (contents);
-            fclose (tfp);
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whilst reading temp file");
-            return;
-        
-        }
-        
-        bytes -= read;
-        
-        if (fwrite (contents, read, 1, arfp) != 1) {
-        
-            free (contents);
-            fclose (tfp);
-            
-            report_at (program_name, 0, REPORT_ERROR, "failed whist writing %s", state->outfile);
-            exit (EXIT_FAILURE);
-        
-        }
-    
-    }
+    member->offset = -1;
+    member->fname = fname;
     
-    free (contents);
-    fclose (tfp);
+    dynarray_add (&members, &nb_members, member);
 
 }
@@ -72,20 +72,83 @@ int hash_table__dispose(struct hash_table *self)
 {
     int i;
     struct hash_elem *s;
+    struct hash_elem *n;
+    struct hash_arena *a;
 
     for (i = 0; i < self->size; i++)
     {
         s = self->elem[i];
         while (s)
         {
-            hash_elem__dispose(s);
-            s = s->next;
+            n = s->next;
+            if (!(s->flags & hash_elem__ARENA)) {
+                hash_elem__dispose(s);
+            }
+            s = n;
         }
     }
+    while (self->arena)
+    {
+        a = self->arena;
+        self->arena = a->next;
+        free(a->mem);
+        free(a);
+    }
     free(self);
     return 0;
 }
 
+static void *hash_table__alloc(struct hash_table *self, int s)
+{
+    struct hash_arena *a;
+    void *p;
+
+    /* keep the elements aligned for their pointer members */
+    s = (s + sizeof(void *) - 1) & ~(int)(sizeof(void *) - 1);
+    a = self->arena;
+    if (!a || a->size - a->used < s)
+    {
+        a = malloc(sizeof(*a));
+        a->size = s > hash_arena__SIZE ? s : hash_arena__SIZE;
+        a->mem = malloc(a->size);
+        a->used = 0;
+        a->next = self->arena;
+        self->arena = a;
+    }
+    p = a->mem + a->used;
+    a->used += s;
+    return p;
+}
+
+/*
+ * Returns the only element for this spelling, so names can be
+ * compared by pointer.
+ */
+struct hash_elem *hash_table__intern(struct hash_table *self, 
+		char *name, int len)
+{
+    int s;
+    int hash;
+    struct hash_elem *e;
+
+    hash = hash_elem__hash(name, len);
+    e = hash_table__get(self, hash, name, len);
+    if (e) {
+        return e;
+    }
+    s = sizeof(*e) + len;
+    e = hash_table__alloc(self, s);
+    memset(e, 0, s);
+    memcpy(e->buf, name, len);
+    e->buf[len] = '\0';
+    e->name = e->buf;
+    e->name_len = len;
+    e->hash = hash;
+    e->flags = hash_elem__ARENA;
+    hash_table__add(self, e);
+    return e;
+}
+
 int hash_table__add(struct hash_table *self, struct hash_elem *elem)
 {
     int c;
@@ -3,17 +3,32 @@
 #define HASH_H_
 
 
+#define hash_elem__ARENA 0x01
+
 struct hash_elem {
     int hash;
     struct hash_elem *next;
     void *value;
     int name_len;
+    int flags;
     char *name;
     char buf[1];
 };
 
+/* Interned elements are carved out of chunks owned by the table
+ * and freed all at once by hash_table__dispose(). */
+#define hash_arena__SIZE 65536
+
+struct hash_arena {
+    struct hash_arena *next;
+    int used;
+    int size;
+    char *mem;
+};
+
 struct hash_table {
     int size;
+    struct hash_arena *arena;
     struct hash_elem *elem[1];
 };
 
@@ -28,6 +43,8 @@ int hash_table__dispose(struct hash_table *self);
 int hash_table__add(struct hash_table *self, struct hash_elem *elem);
 struct hash_elem *hash_table__get(struct hash_table *self, 
 		int hash, char *name, int len);
+struct hash_elem *hash_table__intern(struct hash_table *self, 
+		char *name, int len);
 int hash_table__foreach(struct hash_table *self, 
 		int (*cb)(const void*, const void*, void*), void *arg);
 
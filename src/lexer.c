@@ -90,7 +90,6 @@ int lexer__error(struct lexer *self, char *txt)
 int lexer__add_token(struct lexer *self, int type, char *begin, char *end)
 {
 	struct hash_elem *he;
-	int hash;
 	if (type == token__HASHTAG && self->newline) {
 		if (!self->preb) {
 			self->preb = self->current;
@@ -100,11 +99,7 @@ int lexer__add_token(struct lexer *self, int type, char *begin, char *end)
 		return -1;
 	}
 	self->newline = 0;
-	hash = hash_elem__hash(begin, end - begin);
-	he = hash_table__get(self->symbols, hash, begin, end - begin);
-	if (!he) {
-		he = hash_elem__new(begin, end - begin);
-	}
+	he = hash_table__intern(self->symbols, begin, end - begin);
 	self->current->next = token__new(type, he->name);
 	self->ptr = end;
 	self->current = self->current->next;